@@ -16,6 +16,11 @@ for all files so that.
 #include <setjmp.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
 
 #include <gsl/gsl_cdf.h>
 #include <glib.h>
@@ -30,55 +35,238 @@ for all files so that.
 
 typedef void (*routine_ptr)(gpointer entry);  /**< \brief Function pointer type for the routine of an Entry */
 
-/** \brief Structure of Dictionary entries
+typedef struct _Instruction Instruction;      /**< \brief One step of a compiled definition (see below) */
+typedef struct _Param Param;                  /**< \brief A value on the stack or in an Entry (see below) */
+typedef struct _Array Array;                  /**< \brief Contiguous elements of an 'A' param (see below) */
+typedef struct _Object Object;                /**< \brief Reference counted custom data of an 'O' param (see below) */
+typedef struct _Superinstruction Superinstruction;  /**< \brief A fused sequence of Instructions (see fuse.c) */
+
+/** \brief A named group of dictionary entries
+
+Each lexicon adds its words to its own Wordlist so that words with the same
+name from different lexicons can be told apart (see find_entry_in_wordlist).
 */
 typedef struct {
+    gchar name[MAX_WORD_LEN];   /**< \brief Name of the wordlist (e.g., "notes") */
+} Wordlist;
+
+/** \brief Structure of Dictionary entries
+*/
+typedef struct _Entry {
     gchar word[MAX_WORD_LEN];   /**< \brief Key used for Dictionary lookup */
     gboolean immediate;         /**< \brief 1 if should be executed during compilation; 0 otherwise */
     gboolean complete;          /**< \brief 1 if completely defined; 0 if being defined */
+    gboolean interpret_only;    /**< \brief 1 if it reads the input or resets the interpreter, so it can't be compiled into a line */
     GSequence *params;          /**< \brief Sequence of Param objects */
     routine_ptr routine;        /**< \brief Code to be run when Entry is executed */
+    Wordlist *wordlist;         /**< \brief Wordlist this Entry was added to */
+    struct _Entry *shadowed;    /**< \brief Older Entry with the same word (NULL if none) */
+    Instruction *code;          /**< \brief Threaded code compiled from params at ';' (NULL if none) */
+    GPtrArray *code_params;     /**< \brief Literals created by optimize_code (NULL if none) */
+    Param *value;               /**< \brief Value slot of a variable (its first param); NULL for anything else */
 } Entry;
 
 
 /** \brief Structure of objects that go onto the stack or are part of an Entry
 
-A Param struct has all possible fields for values that a parameter might have.
-Its "type" is a character that indicates which field holds the parameter's value:
+A Param is a small tagged value. Its "type" is a character that indicates which
+field of the union holds the parameter's value:
 
 \anchor param_types
 
 - 'I': Integer value
 - 'D': Double value
-- 'S': String value (*must* be dynamically allocated because it will be freed when the parameter is freed)
+- 'S': String value (*must* be a GRefString because it will be released when the parameter is freed)
 - 'E': Points to an Entry in _dictionary
 - 'R': Routine pointer
-- 'P': Pseudo entry
-- 'C': Custom data
+- 'P': Pseudo entry (*must* be dynamically allocated because it will be freed when the parameter is freed)
+- 'C': Custom data (borrowed: whoever made it frees it)
+- 'A': Array (reference counted, so copies share it; see array.c)
+- 'O': Object (reference counted custom data with an ObjectType; see object.c)
 
+Params are stored by value on the stack (see stack.c), so this should be kept
+small.
 */
-typedef struct {
+struct _Param {
     gchar type;               /**< \brief Indicates type of Param (see \ref param_types "Param types") */
 
-    gint64 val_int;           /**< \brief Integer value of an 'I' param */
-    gdouble val_double;       /**< \brief Double value of a 'D' param */
-    gchar *val_string;        /**< \brief String value of an 'S' param */
-    gpointer val_entry;       /**< \brief Entry pointer value of an 'E' param */
-    routine_ptr val_routine;  /**< \brief Routine ptr of an 'R' param */
-    Entry val_pseudo_entry;   /**< \brief Pseudo Entry of a 'P' param */
-    gpointer val_custom;      /**< \brief Custom data *not* freed  by free_param */
-    gchar val_custom_comment[MAX_WORD_LEN];  /**< \brief Describes custom data */ 
-} Param;
+    union {
+        gint64 val_int;           /**< \brief Integer value of an 'I' param */
+        gdouble val_double;       /**< \brief Double value of a 'D' param */
+        gchar *val_string;        /**< \brief String value of an 'S' param (a GRefString) */
+        gpointer val_entry;       /**< \brief Entry pointer value of an 'E' param */
+        routine_ptr val_routine;  /**< \brief Routine ptr of an 'R' param */
+        Entry *val_pseudo_entry;  /**< \brief Pseudo Entry of a 'P' param */
+        gpointer val_custom;      /**< \brief Custom data *not* freed  by free_param */
+        Array *val_array;         /**< \brief Array of an 'A' param (released by free_param) */
+        Object *val_object;       /**< \brief Object of an 'O' param (released by free_param) */
+    };
+
+    const gchar *val_custom_comment;  /**< \brief Describes custom data (interned string) */
+};
+
+
+/** \brief Elements of an array value (see array.c)
+
+Arrays of numbers store raw values so they can be worked on with SIMD kernels.
+Anything else is stored as Params.
+*/
+struct _Array {
+    gint ref_count;             /**< \brief Number of params sharing the Array */
+    gchar type;                 /**< \brief 'I' (ints), 'D' (doubles), or '*' (Params) */
+    guint len;                  /**< \brief Number of elements */
+
+    union {
+        gint64 *ints;           /**< \brief Elements of an 'I' Array */
+        gdouble *doubles;       /**< \brief Elements of a 'D' Array */
+        Param *params;          /**< \brief Elements of a '*' Array */
+        gpointer data;          /**< \brief Elements of any type */
+    };
+
+    gpointer owner;             /**< \brief What custom elements point into (e.g., an Object of Tasks) */
+    GDestroyNotify free_owner;  /**< \brief Frees owner along with the Array */
+};
+
+
+/** \brief Describes a kind of custom data held by Objects (see object.c)
+
+Only name and free are required. A collection (e.g., a sequence of Tasks)
+should also have length and get_element so that generic words like "len" work
+on it.
+*/
+typedef struct {
+    const gchar *name;                              /**< \brief Name of the type (e.g., "[tasks]") */
+    GDestroyNotify free;                            /**< \brief Frees the data */
+    gpointer (*clone)(gconstpointer data);          /**< \brief Copies the data so it can be changed (NULL if it can't be) */
+    void (*print)(gconstpointer data, FILE *file);  /**< \brief Prints the data on one line (NULL to print the name) */
+    guint (*length)(gconstpointer data);            /**< \brief Number of elements (NULL if not a collection) */
+    void (*get_element)(gconstpointer data, guint index, Param *dst);  /**< \brief Gets an element (e.g., a borrowed 'C' param) */
+    gboolean is_sequence;                           /**< \brief 1 if the data is a GSequence (see ext_sequence.c) */
+} ObjectType;
+
+
+/** \brief Custom data shared by 'O' params
+*/
+struct _Object {
+    gint ref_count;             /**< \brief Number of params (and Arrays) sharing the Object */
+    const ObjectType *type;     /**< \brief How to free, copy, and inspect the data */
+    gpointer data;              /**< \brief The custom data (e.g., a GSequence of Tasks) */
+};
+
+
+typedef void (*instruction_ptr)(Instruction *instruction);  /**< \brief Function pointer type for the code of an Instruction */
+
+/** \brief Structure of the threaded code of a definition
+
+When a definition is completed, its params are flattened into a contiguous
+array of Instructions (see compile_definition). Each Instruction has the code
+to run when it is dispatched along with an inline operand. Branch targets are
+resolved to Instruction addresses.
+*/
+struct _Instruction {
+    instruction_ptr code;       /**< \brief Code run when the Instruction is dispatched */
+
+    union {
+        Entry *entry;           /**< \brief Entry to execute (or pseudo entry to run) */
+        Param *param;           /**< \brief Literal to push onto the stack */
+        Instruction *target;    /**< \brief Instruction to jump to */
+        Superinstruction *fused;  /**< \brief Sequence run by a fused Instruction */
+        guint local;            /**< \brief Index of a local in the Frame (see locals.c) */
+    } operand;                  /**< \brief Inline operand for the code */
+
+    struct {
+        gconstpointer guard;    /**< \brief What the inputs must match (e.g., a variable Entry) */
+        gpointer data;          /**< \brief What was learned about them (e.g., the variable's value slot) */
+    } cache;                    /**< \brief Inline cache of a quickened Instruction (see quicken.c) */
+};
+
+
+/** \brief A free-list allocator for objects of one size (see pool.c)
+*/
+typedef struct {
+    const gchar *name;          /**< \brief Name used when reporting counts */
+    gsize slot_size;            /**< \brief Size of each slot, including its header */
+    GSList *slabs;              /**< \brief Blocks of memory that slots are carved from */
+    gpointer free_list;         /**< \brief Slots available for reuse */
+    guint slab_used;            /**< \brief Number of slots carved from the newest slab */
+    guint num_live;             /**< \brief Number of objects currently allocated */
+    guint num_peak;             /**< \brief Largest num_live seen */
+    guint num_recycled;         /**< \brief Number of allocations served from the free list */
+} Pool;
+
+
+/** \brief A handle for reading and writing a variable from C (see variable_value)
+
+Lexicons use these instead of running "my-var @" through execute_string.
+*/
+typedef struct {
+    gchar word[MAX_WORD_LEN];   /**< \brief Word of the variable */
+    Entry *entry;               /**< \brief Variable Entry (NULL if not found) */
+    guint version;              /**< \brief _dictionary_version when the entry was looked up */
+} VariableRef;
+
+
+/** \brief An LRU cache of compiled lines of input (see line.c)
+*/
+typedef struct {
+    GHashTable *lines;          /**< \brief Maps the key of a line (usually its text) to its CachedLine */
+    GQueue *lru;                /**< \brief CachedLines from most to least recently used */
+} LineCache;
+
+
+/** \brief A region allocator for scratch memory (see arena.c)
+*/
+typedef struct {
+    struct _ArenaChunk *first;     /**< \brief First chunk (reused after each reset) */
+    struct _ArenaChunk *current;   /**< \brief Chunk being allocated from */
+    gsize used;                    /**< \brief Number of bytes used in the current chunk */
+} Arena;
+
+
+/** \brief Structure of a return stack frame
+
+A Frame is pushed when a definition is called and popped when it returns.
+*/
+typedef struct {
+    Instruction *return_ip;     /**< \brief Instruction to continue with when the definition returns */
+    Entry *entry;               /**< \brief Definition being executed */
+    guint locals;               /**< \brief Index of the Frame's first slot in _locals */
+    guint num_locals;           /**< \brief Number of locals the Frame has (see locals.c) */
+    guint loops;                /**< \brief Index of the Frame's first Loop in _loops (see loops.c) */
+} Frame;
+
+
+/** \brief A counted loop that's running (see loops.c)
+*/
+typedef struct {
+    gint64 index;               /**< \brief Current index ("i") */
+    gint64 limit;               /**< \brief Index the loop stops at */
+} Loop;
 
 
 
 #include "globals.h"
+#include "pool.h"
+#include "arena.h"
 #include "param.h"
+#include "array.h"
+#include "object.h"
 #include "entry.h"
+#include "code.h"
+#include "optimize.h"
+#include "fuse.h"
+#include "quicken.h"
+#include "aot.h"
+#include "line.h"
+#include "locals.h"
+#include "loops.h"
+#include "image.h"
 #include "dictionary.h"
 #include "stack.h"
 #include "return_stack.h"
 #include "ec_basic.h"
+#include "ec_math.h"
+#include "ec_array.h"
 #include "ext_notes.h"
 #include "ext_sequence.h"
 #include "ext_sqlite.h"
@@ -0,0 +1,723 @@
+/** \file aot.c
+
+\brief Compiles definitions ahead of time into a shared library of C routines.
+
+With `kit --aot <library> <forth file>`, definitions are translated into C when
+the interpreter exits. The C is compiled with the system compiler ($CC or gcc)
+into the library, which is loaded with dlopen the next time kit is started with
+the same options.
+
+Each definition becomes a C function that runs its Instructions in order with
+literals and branch targets baked in: numbers are pushed as constants and
+branches become gotos. Calls still go through the Entries in the definition's
+own code (see the aot_* helpers below), so the C only depends on the shape of
+the definition and not on where anything is in memory.
+
+A definition is matched to its C function by its signature, a text rendering of
+its code (see definition_signature). When compile_definition completes a
+definition whose signature is in the loaded library, the definition's routine
+is replaced by the C function. Everything else is interpreted as usual, so a
+stale or missing library just means less native code. If any definition had to
+be interpreted, the library is rebuilt at exit.
+
+The C functions use the return stack like EC_execute: each pushes a Frame,
+stops as soon as an error clears the return stack, and pops its Frame at
+IC_exit. A tail call to the definition itself loops; any other tail call pops
+the Frame before calling so the return stack doesn't grow. The threaded code is
+kept, so ".d" still works.
+
+Unlike the interpreter, the C functions call each other on the C stack: a call
+from C (including a tail call to another definition) returns only after the
+callee does. To keep deep recursion from overflowing the C stack, calls from C
+nested more than MAX_NATIVE_DEPTH deep run definitions with the interpreter
+(see execute_from_native). So recursion deeper than that runs at interpreter
+speed, though it's still limited only by the return stack.
+
+\note The library calls back into kit (e.g., push_int), so kit must be linked
+      with -rdynamic. A library is only used with the build that made it; this
+      is checked with AOT_ABI_VERSION.
+*/
+
+#define AOT_ABI_VERSION  4      /**< \brief Bump whenever the aot_* helpers change */
+
+
+/** \brief A row of the table of C routines in a library
+*/
+typedef struct {
+    const gchar *word;          /**< \brief Word of the definition (for reference) */
+    const gchar *signature;     /**< \brief See definition_signature */
+    routine_ptr routine;        /**< \brief C function that runs the definition */
+} NativeDefinition;
+
+
+// =============================================================================
+// Helpers called from the generated C
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/** Pushes a Frame for a definition like EC_execute does.
+
+\param depth: Receives the depth of the return stack before the Frame
+\returns 1 if the definition should run; 0 if the return stack overflowed
+*/
+// -----------------------------------------------------------------------------
+gboolean aot_enter(Entry *entry, guint *depth) {
+    *depth = _return_stack_depth;
+    return push_frame_r(_ip, entry);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Executes an Entry called from a C routine.
+
+Unlike IC_call, this nests on the C stack. Once calls from C are nested
+MAX_NATIVE_DEPTH deep, a definition is run by EC_execute instead, and IC_call
+and IC_tail_call interpret the definitions it calls, so deeper recursion is
+flat like it is without a library.
+*/
+// -----------------------------------------------------------------------------
+static void execute_from_native(Entry *callee) {
+    _native_depth++;
+    if (_native_depth >= MAX_NATIVE_DEPTH && callee->code) {
+        EC_execute(callee);
+    }
+    else {
+        execute(callee);
+    }
+    _native_depth--;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Executes the Entry called by an Instruction of a definition.
+
+\returns 1 if the definition should continue; 0 if an error stopped it
+*/
+// -----------------------------------------------------------------------------
+gboolean aot_call(Entry *entry, gint index, guint depth) {
+    execute_from_native(entry->code[index].operand.entry);
+    return _return_stack_depth > depth;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs the pseudo entry of an IC_pseudo Instruction of a definition.
+
+\returns 1 if the definition should continue; 0 if an error stopped it
+*/
+// -----------------------------------------------------------------------------
+gboolean aot_pseudo(Entry *entry, gint index, guint depth) {
+    Entry *pseudo_entry = entry->code[index].operand.entry;
+    pseudo_entry->routine(pseudo_entry);
+    return _return_stack_depth > depth;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a literal that isn't baked into the C (e.g., a string).
+*/
+// -----------------------------------------------------------------------------
+void aot_push_literal(Entry *entry, gint index) {
+    push_value(entry->code[index].operand.param);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops the condition of a branch like IC_jmp_if_false does.
+
+\returns 1 if true, 0 if false, or -1 if the stack was empty
+*/
+// -----------------------------------------------------------------------------
+gint aot_pop_condition() {
+    Param param_bool;
+    if (!pop_value(&param_bool)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return -1;
+    }
+
+    gint result = param_bool.val_int != 0;
+    clear_param(&param_bool);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if an IC_tail_call Instruction calls the definition it's in.
+*/
+// -----------------------------------------------------------------------------
+gboolean aot_is_self(Entry *entry, gint index) {
+    return entry->code[index].operand.entry == entry;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Makes the tail call of an IC_tail_call Instruction.
+
+A definition is called after popping the caller's Frame, which is what reusing
+the Frame amounts to. Anything else is executed before popping it, as in
+IC_tail_call.
+*/
+// -----------------------------------------------------------------------------
+void aot_tail_call(Entry *entry, gint index) {
+    Entry *callee = entry->code[index].operand.entry;
+
+    if (callee->code) {
+        _ip = pop_frame_r();
+        execute_from_native(callee);
+        return;
+    }
+
+    execute_from_native(callee);
+    _ip = pop_frame_r();
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops the locals of a definition off the stack like IC_enter_locals does.
+
+\returns 1 if the definition should continue; 0 if an error stopped it
+*/
+// -----------------------------------------------------------------------------
+gboolean aot_enter_locals(Entry *entry, gint index, guint depth) {
+    IC_enter_locals(entry->code + index);
+    return _return_stack_depth > depth;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a local like IC_fetch_local does.
+*/
+// -----------------------------------------------------------------------------
+void aot_fetch_local(guint local) {
+    push_value(_locals + top_frame_r()->locals + local);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a value into a local like IC_store_local does.
+
+\returns 1 if the definition should continue; 0 if an error stopped it
+*/
+// -----------------------------------------------------------------------------
+gboolean aot_store_local(Entry *entry, gint index, guint depth) {
+    IC_store_local(entry->code + index);
+    return _return_stack_depth > depth;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Starts a counted loop like IC_do does.
+
+\returns 1 if the body should run; 0 if it should be skipped; -1 on error
+*/
+// -----------------------------------------------------------------------------
+gint aot_do() {
+    return start_loop();
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Steps a counted loop by 1 like IC_loop does.
+
+\returns 1 if the body should run again; 0 if the loop has ended
+*/
+// -----------------------------------------------------------------------------
+gint aot_loop() {
+    return step_loop(1);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Steps a counted loop by a popped step like IC_plus_loop does.
+
+\returns 1 if the body should run again; 0 if the loop has ended; -1 on error
+*/
+// -----------------------------------------------------------------------------
+gint aot_plus_loop() {
+    return step_loop_by_top();
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends a counted loop like IC_leave does.
+*/
+// -----------------------------------------------------------------------------
+void aot_leave() {
+    end_loop();
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a literal word Instruction (e.g., "2 *") of a definition.
+
+The literal stays in the Instruction, so the C only depends on the word.
+
+\returns 1 if the definition should continue; 0 if an error stopped it
+*/
+// -----------------------------------------------------------------------------
+gboolean aot_literal_word(Entry *entry, gint index, guint depth) {
+    entry->code[index].code(entry->code + index);
+    return _return_stack_depth > depth;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns from a definition like IC_exit does.
+*/
+// -----------------------------------------------------------------------------
+void aot_exit() {
+    _ip = pop_frame_r();
+}
+
+
+
+// =============================================================================
+// Signatures
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if an int literal can be written as a C constant.
+*/
+// -----------------------------------------------------------------------------
+static gboolean is_baked_int(const Param *param) {
+    return param->type == 'I' && param->val_int != G_MININT64;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if a double literal can be written as a C constant.
+*/
+// -----------------------------------------------------------------------------
+static gboolean is_baked_double(const Param *param) {
+    return param->type == 'D' && isfinite(param->val_double);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Appends the word of an Entry along with its wordlist.
+*/
+// -----------------------------------------------------------------------------
+static void append_entry_name(GString *str, const Entry *entry) {
+    g_string_append_printf(str, "%s:%s", entry->wordlist ? entry->wordlist->name : "", entry->word);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns a text rendering of a definition's code that identifies its C function.
+
+Each Instruction is written on its own line: the kind of Instruction followed
+by the word it calls, the literal it pushes, or the index it branches to.
+Fused and quickened Instructions are written as the calls they came from.
+
+\returns A newly allocated string
+*/
+// -----------------------------------------------------------------------------
+gchar *definition_signature(Entry *entry) {
+    GString *result = g_string_new(NULL);
+
+    for (Instruction *ip = entry->code; ip->code; ip++) {
+        const Instruction *instruction = unfused_instruction(ip);
+
+        if (instruction->code == IC_call || is_quickened_call(instruction)) {
+            g_string_append(result, "call ");
+            append_entry_name(result, instruction->operand.entry);
+        }
+        else if (instruction->code == IC_tail_call) {
+            g_string_append(result, "tail-call ");
+            append_entry_name(result, instruction->operand.entry);
+        }
+        else if (instruction->code == IC_push_literal) {
+            const Param *param = instruction->operand.param;
+            if (is_baked_int(param)) {
+                g_string_append_printf(result, "int %" G_GINT64_FORMAT, param->val_int);
+            }
+            else if (is_baked_double(param)) {
+                g_string_append_printf(result, "double %a", param->val_double);
+            }
+            else {
+                g_string_append_printf(result, "literal %c", param->type);
+            }
+        }
+        else if (instruction->code == IC_jmp) {
+            g_string_append_printf(result, "jmp %ld", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_jmp_if_false) {
+            g_string_append_printf(result, "jmp-if-false %ld", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_do) {
+            g_string_append_printf(result, "do %ld", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_loop) {
+            g_string_append_printf(result, "loop %ld", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_plus_loop) {
+            g_string_append_printf(result, "+loop %ld", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_leave) {
+            g_string_append_printf(result, "leave %ld", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_exit) {
+            g_string_append(result, "exit");
+        }
+        else if (instruction->code == IC_enter_locals) {
+            g_string_append_printf(result, "locals %u", instruction->operand.local);
+        }
+        else if (instruction->code == IC_fetch_local) {
+            g_string_append_printf(result, "local@ %u", instruction->operand.local);
+        }
+        else if (instruction->code == IC_store_local) {
+            g_string_append_printf(result, "local! %u", instruction->operand.local);
+        }
+        else if (literal_word(instruction->code)) {
+            g_string_append_printf(result, "literal-word %s", literal_word(instruction->code));
+        }
+        else {
+            g_string_append_printf(result, "pseudo %s", instruction->operand.entry->word);
+        }
+        g_string_append_c(result, '\n');
+    }
+
+    return g_string_free(result, FALSE);
+}
+
+
+
+// =============================================================================
+// Loading and binding
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/** Loads the C routines from a library built by build_native_library.
+
+\returns 1 if the library was loaded; 0 if it is missing or can't be used
+
+A missing library isn't an error: all definitions are simply interpreted.
+*/
+// -----------------------------------------------------------------------------
+gboolean load_native_library(const gchar *path) {
+    if (!g_file_test(path, G_FILE_TEST_EXISTS)) return 0;
+
+    // dlopen needs a path to avoid searching the library path
+    gchar *full_path = g_canonicalize_filename(path, NULL);
+    gpointer library = dlopen(full_path, RTLD_NOW | RTLD_LOCAL);
+    g_free(full_path);
+
+    if (!library) {
+        fprintf(stderr, "-----> Unable to load native library: %s\n", dlerror());
+        return 0;
+    }
+
+    const gint *abi_version = dlsym(library, "kit_aot_abi");
+    const NativeDefinition *definitions = dlsym(library, "kit_aot_definitions");
+    if (!abi_version || *abi_version != AOT_ABI_VERSION || !definitions) {
+        fprintf(stderr, "-----> Ignoring out of date native library: %s\n", path);
+        dlclose(library);
+        return 0;
+    }
+
+    _native_library = library;
+    _native_definitions = g_hash_table_new(g_str_hash, g_str_equal);
+    for (const NativeDefinition *definition = definitions; definition->signature; definition++) {
+        g_hash_table_insert(_native_definitions, (gpointer) definition->signature, (gpointer) definition->routine);
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Replaces a definition's routine with its C function if the library has one.
+
+\param entry: A definition whose code was just compiled
+
+This does nothing unless AOT compilation is on (see `kit --aot`).
+*/
+// -----------------------------------------------------------------------------
+void bind_native_definition(Entry *entry) {
+    // Lines (see interpret_line) aren't in the library
+    if (!_aot || entry == _compile_target) return;
+
+    routine_ptr routine = NULL;
+    if (_native_definitions) {
+        gchar *signature = definition_signature(entry);
+        routine = g_hash_table_lookup(_native_definitions, signature);
+        g_free(signature);
+    }
+
+    if (routine) {
+        entry->routine = routine;
+        _num_native_definitions++;
+    }
+    else {
+        _num_interpreted_definitions++;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Unloads the native library.
+
+This must be done after the dictionary is destroyed.
+*/
+// -----------------------------------------------------------------------------
+void unload_native_library() {
+    if (_native_definitions) {
+        g_hash_table_destroy(_native_definitions);
+        _native_definitions = NULL;
+    }
+
+    if (_native_library) {
+        dlclose(_native_library);
+        _native_library = NULL;
+    }
+}
+
+
+
+// =============================================================================
+// Building
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/** Writes the C function for a definition.
+*/
+// -----------------------------------------------------------------------------
+static void write_definition(FILE *file, Entry *entry, guint id) {
+    fprintf(file, "/* : %s */\n", entry->word);
+    fprintf(file, "static void definition_%u(void *entry) {\n", id);
+    fprintf(file, "    unsigned depth;\n");
+    fprintf(file, "    if (!aot_enter(entry, &depth)) return;\n");
+
+    gint index = 0;
+    for (Instruction *ip = entry->code; ip->code; ip++, index++) {
+        const Instruction *instruction = unfused_instruction(ip);
+        fprintf(file, "L%d: ", index);
+
+        if (instruction->code == IC_call || is_quickened_call(instruction)) {
+            fprintf(file, "if (!aot_call(entry, %d, depth)) return;", index);
+        }
+        else if (instruction->code == IC_tail_call) {
+            fprintf(file, "if (aot_is_self(entry, %d)) goto L0; aot_tail_call(entry, %d); return;", index, index);
+        }
+        else if (instruction->code == IC_push_literal) {
+            const Param *param = instruction->operand.param;
+            if (is_baked_int(param)) {
+                fprintf(file, "push_int(%" G_GINT64_FORMAT "LL);", param->val_int);
+            }
+            else if (is_baked_double(param)) {
+                fprintf(file, "push_double(%a);", param->val_double);
+            }
+            else {
+                fprintf(file, "aot_push_literal(entry, %d);", index);
+            }
+        }
+        else if (instruction->code == IC_jmp) {
+            fprintf(file, "goto L%ld;", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_jmp_if_false) {
+            fprintf(file, "{ int cond = aot_pop_condition(); if (cond < 0) return; if (!cond) goto L%ld; }",
+                    (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_do) {
+            fprintf(file, "{ int r = aot_do(); if (r < 0) return; if (!r) goto L%ld; }",
+                    (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_loop) {
+            fprintf(file, "if (aot_loop()) goto L%ld;", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_plus_loop) {
+            fprintf(file, "{ int r = aot_plus_loop(); if (r < 0) return; if (r) goto L%ld; }",
+                    (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_leave) {
+            fprintf(file, "aot_leave(); goto L%ld;", (glong) (instruction->operand.target - entry->code));
+        }
+        else if (instruction->code == IC_exit) {
+            fprintf(file, "aot_exit(); return;");
+        }
+        else if (instruction->code == IC_enter_locals) {
+            fprintf(file, "if (!aot_enter_locals(entry, %d, depth)) return;", index);
+        }
+        else if (instruction->code == IC_fetch_local) {
+            fprintf(file, "aot_fetch_local(%u);", instruction->operand.local);
+        }
+        else if (instruction->code == IC_store_local) {
+            fprintf(file, "if (!aot_store_local(entry, %d, depth)) return;", index);
+        }
+        else if (literal_word(instruction->code)) {
+            fprintf(file, "if (!aot_literal_word(entry, %d, depth)) return;", index);
+        }
+        else {
+            fprintf(file, "if (!aot_pseudo(entry, %d, depth)) return;", index);
+        }
+        fprintf(file, "\n");
+    }
+
+    // Code always ends with IC_exit, so this is only a label for the end
+    fprintf(file, "L%d: return;\n", index);
+    fprintf(file, "}\n\n");
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Writes the C for every definition in the dictionary.
+*/
+// -----------------------------------------------------------------------------
+static guint write_library_source(FILE *file) {
+    fprintf(file, "/* Generated by kit --aot. Rebuilt whenever a definition changes. */\n\n");
+    fprintf(file, "typedef struct { const char *word; const char *signature; void (*routine)(void *); } NativeDefinition;\n\n");
+    fprintf(file, "extern void push_int(long long val_int);\n");
+    fprintf(file, "extern void push_double(double val_double);\n");
+    fprintf(file, "extern int aot_enter(void *entry, unsigned *depth);\n");
+    fprintf(file, "extern int aot_call(void *entry, int index, unsigned depth);\n");
+    fprintf(file, "extern int aot_pseudo(void *entry, int index, unsigned depth);\n");
+    fprintf(file, "extern void aot_push_literal(void *entry, int index);\n");
+    fprintf(file, "extern int aot_pop_condition(void);\n");
+    fprintf(file, "extern int aot_enter_locals(void *entry, int index, unsigned depth);\n");
+    fprintf(file, "extern void aot_fetch_local(unsigned local);\n");
+    fprintf(file, "extern int aot_store_local(void *entry, int index, unsigned depth);\n");
+    fprintf(file, "extern int aot_literal_word(void *entry, int index, unsigned depth);\n");
+    fprintf(file, "extern int aot_do(void);\n");
+    fprintf(file, "extern int aot_loop(void);\n");
+    fprintf(file, "extern int aot_plus_loop(void);\n");
+    fprintf(file, "extern void aot_leave(void);\n");
+    fprintf(file, "extern int aot_is_self(void *entry, int index);\n");
+    fprintf(file, "extern void aot_tail_call(void *entry, int index);\n");
+    fprintf(file, "extern void aot_exit(void);\n\n");
+    fprintf(file, "const int kit_aot_abi = %d;\n\n", AOT_ABI_VERSION);
+
+    // Definitions with the same code share a function
+    GHashTable *written = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    GString *table = g_string_new(NULL);
+    guint result = 0;
+
+    for (GList *link = g_list_last(_dictionary); link; link = link->prev) {
+        Entry *entry = link->data;
+        if (!entry->code || !entry->complete) continue;
+
+        gchar *signature = definition_signature(entry);
+        if (g_hash_table_contains(written, signature)) {
+            g_free(signature);
+            continue;
+        }
+
+        write_definition(file, entry, result);
+
+        gchar *escaped_word = g_strescape(entry->word, NULL);
+        gchar *escaped_signature = g_strescape(signature, NULL);
+        g_string_append_printf(table, "    {\"%s\", \"%s\", definition_%u},\n", escaped_word, escaped_signature, result);
+        g_free(escaped_word);
+        g_free(escaped_signature);
+
+        g_hash_table_add(written, signature);
+        result++;
+    }
+
+    fprintf(file, "const NativeDefinition kit_aot_definitions[] = {\n%s    {0, 0, 0}\n};\n", table->str);
+
+    g_string_free(table, TRUE);
+    g_hash_table_destroy(written);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Translates the definitions in the dictionary into C and builds a library.
+
+\param path: Library to build. The C source is written next to it (path.c).
+\returns 1 if the library was built
+
+The library is built under a temporary name and then renamed, so a library
+that is currently loaded isn't modified.
+*/
+// -----------------------------------------------------------------------------
+gboolean build_native_library(const gchar *path) {
+    gchar *source_path = g_strconcat(path, ".c", NULL);
+    gchar *temp_path = g_strconcat(path, ".tmp", NULL);
+    gboolean result = 0;
+
+    FILE *file = fopen(source_path, "w");
+    if (!file) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Unable to write %s\n", source_path);
+        goto done;
+    }
+    write_library_source(file);
+    fclose(file);
+
+    const gchar *compiler = g_getenv("CC") ? g_getenv("CC") : "gcc";
+    gchar *argv[] = {(gchar *) compiler, "-shared", "-fPIC", "-O2", "-w", "-o", temp_path, source_path, NULL};
+
+    gint exit_status = -1;
+    gchar *error_output = NULL;
+    if (!g_spawn_sync(NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
+                      NULL, NULL, NULL, &error_output, &exit_status, NULL) || exit_status != 0) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Unable to compile %s\n%s", source_path, error_output ? error_output : "");
+        g_free(error_output);
+        unlink(temp_path);
+        goto done;
+    }
+    g_free(error_output);
+
+    if (rename(temp_path, path) != 0) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Unable to replace %s\n", path);
+        unlink(temp_path);
+        goto done;
+    }
+    result = 1;
+
+done:
+    g_free(source_path);
+    g_free(temp_path);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Rebuilds the library at exit if any definition had to be interpreted.
+*/
+// -----------------------------------------------------------------------------
+void update_native_library(const gchar *path) {
+    if (!_aot || _num_interpreted_definitions == 0) return;
+    build_native_library(path);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints how many definitions are running as native code.
+*/
+// -----------------------------------------------------------------------------
+void EC_print_aot(gpointer gp_entry) {
+    if (!_aot) {
+        printf("AOT compilation is off (see kit --aot)\n");
+        return;
+    }
+
+    printf("native: %u, interpreted: %u\n", _num_native_definitions, _num_interpreted_definitions);
+}
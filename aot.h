@@ -0,0 +1,32 @@
+/** \file aot.h
+*/
+
+#pragma once
+
+#define MAX_NATIVE_DEPTH  1024   /**< \brief Nesting of calls from C routines past which definitions are interpreted (see aot_call) */
+
+gboolean aot_enter(Entry *entry, guint *depth);
+gboolean aot_call(Entry *entry, gint index, guint depth);
+gboolean aot_pseudo(Entry *entry, gint index, guint depth);
+void aot_push_literal(Entry *entry, gint index);
+gint aot_pop_condition();
+gboolean aot_enter_locals(Entry *entry, gint index, guint depth);
+void aot_fetch_local(guint local);
+gboolean aot_store_local(Entry *entry, gint index, guint depth);
+gboolean aot_literal_word(Entry *entry, gint index, guint depth);
+gint aot_do();
+gint aot_loop();
+gint aot_plus_loop();
+void aot_leave();
+gboolean aot_is_self(Entry *entry, gint index);
+void aot_tail_call(Entry *entry, gint index);
+void aot_exit();
+
+gchar *definition_signature(Entry *entry);
+gboolean load_native_library(const gchar *path);
+void bind_native_definition(Entry *entry);
+void unload_native_library();
+gboolean build_native_library(const gchar *path);
+void update_native_library(const gchar *path);
+
+void EC_print_aot(gpointer gp_entry);
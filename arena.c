@@ -0,0 +1,177 @@
+/** \file arena.c
+
+\brief A region allocator for scratch memory used while running one command.
+
+Routines often need temporary memory: SQL statements built with
+arena_strconcat, macro substitutions, and so on. Instead of freeing each of
+these individually, they can be allocated from the arena. Everything allocated
+from the arena is released at once by arena_reset, which the control loop in
+kit.c calls before each top-level command. This is also how arena memory is
+reclaimed after handle_error.
+
+Arena memory must not be kept past the end of the current command. In
+particular, it must never be stored in a Param or an Entry.
+
+The arena is a list of chunks. Allocation bumps an offset into the current
+chunk and moves on to the next chunk when it's full. Resetting just goes back
+to the first chunk, so the chunks are reused by the next command. Allocations
+too large for a chunk get a chunk of their own, which is freed on reset.
+*/
+
+#define ARENA_CHUNK_SIZE  (64*1024)   /**< \brief Size of each reusable chunk */
+#define ARENA_ALIGN       8           /**< \brief Alignment of every allocation */
+
+
+/** \brief Header at the start of every chunk. The memory follows it.
+*/
+typedef struct _ArenaChunk {
+    struct _ArenaChunk *next;   /**< \brief Next chunk in the arena */
+    gsize size;                 /**< \brief Number of bytes after the header */
+} ArenaChunk;
+
+
+// -----------------------------------------------------------------------------
+/** Adds a chunk of at least size bytes after the current one.
+*/
+// -----------------------------------------------------------------------------
+static ArenaChunk *add_chunk(ArenaChunk *after, gsize size) {
+    ArenaChunk *result = g_malloc(sizeof(ArenaChunk) + size);
+    result->size = size;
+    result->next = after ? after->next : NULL;
+    if (after) after->next = result;
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Creates the arena with one chunk.
+*/
+// -----------------------------------------------------------------------------
+void create_arena() {
+    _arena.first = add_chunk(NULL, ARENA_CHUNK_SIZE);
+    _arena.current = _arena.first;
+    _arena.used = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Releases everything allocated from the arena.
+
+Chunks of the normal size are kept for reuse. Oversized chunks are freed.
+*/
+// -----------------------------------------------------------------------------
+void arena_reset() {
+    ArenaChunk *chunk = _arena.first;
+    while (chunk->next) {
+        if (chunk->next->size > ARENA_CHUNK_SIZE) {
+            ArenaChunk *oversized = chunk->next;
+            chunk->next = oversized->next;
+            g_free(oversized);
+        }
+        else {
+            chunk = chunk->next;
+        }
+    }
+
+    _arena.current = _arena.first;
+    _arena.used = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees all of the arena's chunks.
+*/
+// -----------------------------------------------------------------------------
+void destroy_arena() {
+    ArenaChunk *chunk = _arena.first;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        g_free(chunk);
+        chunk = next;
+    }
+
+    _arena.first = NULL;
+    _arena.current = NULL;
+    _arena.used = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Allocates scratch memory that lasts until the end of the current command.
+
+\param size: Number of bytes to allocate
+\returns Uninitialized memory
+*/
+// -----------------------------------------------------------------------------
+gpointer arena_alloc(gsize size) {
+    size = (size + ARENA_ALIGN - 1) & ~(gsize) (ARENA_ALIGN - 1);
+
+    ArenaChunk *chunk = _arena.current;
+    if (_arena.used + size > chunk->size) {
+        // Use the next chunk if it's big enough; otherwise add one
+        if (size <= ARENA_CHUNK_SIZE && chunk->next && chunk->next->size >= size) {
+            chunk = chunk->next;
+        }
+        else {
+            chunk = add_chunk(chunk, MAX(size, ARENA_CHUNK_SIZE));
+        }
+        _arena.current = chunk;
+        _arena.used = 0;
+    }
+
+    gpointer result = (gchar *) (chunk + 1) + _arena.used;
+    _arena.used += size;
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Copies a string into the arena.
+*/
+// -----------------------------------------------------------------------------
+gchar *arena_strdup(const gchar *str) {
+    if (!str) return NULL;
+
+    gsize len = strlen(str);
+    gchar *result = arena_alloc(len + 1);
+    memcpy(result, str, len + 1);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Concatenates strings into the arena.
+
+\param first: First string to concatenate
+\param ...: More strings, ending with NULL
+\returns Concatenated string (like g_strconcat, but not to be freed)
+*/
+// -----------------------------------------------------------------------------
+gchar *arena_strconcat(const gchar *first, ...) {
+    va_list args;
+    gsize len = 0;
+
+    va_start(args, first);
+    for (const gchar *str = first; str; str = va_arg(args, const gchar *)) {
+        len += strlen(str);
+    }
+    va_end(args);
+
+    gchar *result = arena_alloc(len + 1);
+    gchar *end = result;
+
+    va_start(args, first);
+    for (const gchar *str = first; str; str = va_arg(args, const gchar *)) {
+        end = g_stpcpy(end, str);
+    }
+    va_end(args);
+
+    *end = '\0';
+    return result;
+}
@@ -0,0 +1,12 @@
+/** \file arena.h
+*/
+
+#pragma once
+
+gpointer arena_alloc(gsize size);
+gchar *arena_strdup(const gchar *str);
+gchar *arena_strconcat(const gchar *first, ...);
+
+void create_arena();
+void arena_reset();
+void destroy_arena();
@@ -0,0 +1,461 @@
+/** \file array.c
+
+\brief Defines arrays: contiguous, reference counted sequences of values.
+
+An 'A' param holds an Array. Like strings, arrays are shared rather than copied:
+copy_param acquires another reference and clear_param releases it, so "dup" and
+variables don't copy their elements.
+
+An array of numbers stores raw values: gint64s for an array of ints and gdoubles
+otherwise (see new_array_from_values). Arithmetic on these (see
+array_arithmetic) and sums are computed by SIMD kernels that work on
+VECTOR_BYTES at a time using GCC vector extensions. An array with anything else
+in it stores Params.
+
+An array can also be made from a collection Object (e.g., a sequence of Tasks)
+without copying its elements (see new_object_array). The array keeps a
+reference to the Object so the elements stay valid.
+*/
+
+#define VECTOR_BYTES  32             /**< \brief Size of the vectors used by the SIMD kernels */
+#define MAX_PRINTED_ELEMENTS  16     /**< \brief Elements printed by print_array before "..." */
+
+typedef guint64 IntVector __attribute__((vector_size(VECTOR_BYTES)));    /**< \brief Ints (as unsigned so they wrap) */
+typedef gdouble DoubleVector __attribute__((vector_size(VECTOR_BYTES))); /**< \brief Doubles */
+
+
+// -----------------------------------------------------------------------------
+/** Creates an Array with uninitialized elements.
+
+\param type: 'I', 'D', or '*' (see Array)
+\param len: Number of elements
+\returns A new Array with one reference
+*/
+// -----------------------------------------------------------------------------
+Array *new_array(gchar type, guint len) {
+    gsize element_size = type == 'I' ? sizeof(gint64) : type == 'D' ? sizeof(gdouble) : sizeof(Param);
+
+    Array *result = g_new0(Array, 1);
+    result->ref_count = 1;
+    result->type = type;
+    result->len = len;
+    result->data = len ? g_malloc(element_size * len) : NULL;
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Creates an Array from param values, taking over their contents.
+
+\param values: Params to move into the Array (they must not be cleared afterwards)
+\param len: Number of values
+
+If every value is an int, the Array holds ints. If they're all numbers, it
+holds doubles. Otherwise, it holds the Params themselves.
+*/
+// -----------------------------------------------------------------------------
+Array *new_array_from_values(Param *values, guint len) {
+    gboolean all_ints = 1;
+    gboolean all_numbers = 1;
+    for (guint i=0; i < len; i++) {
+        if (values[i].type != 'I') all_ints = 0;
+        if (values[i].type != 'I' && values[i].type != 'D') all_numbers = 0;
+    }
+
+    Array *result;
+    if (all_ints) {
+        result = new_array('I', len);
+        for (guint i=0; i < len; i++) result->ints[i] = values[i].val_int;
+    }
+    else if (all_numbers) {
+        result = new_array('D', len);
+        for (guint i=0; i < len; i++) {
+            result->doubles[i] = values[i].type == 'I' ? (gdouble) values[i].val_int : values[i].val_double;
+        }
+    }
+    else {
+        result = new_array('*', len);
+        memcpy(result->params, values, sizeof(Param) * len);
+    }
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Creates an Array of the elements of a collection Object.
+
+\param object: Object whose type has length and get_element
+
+The elements are borrowed from the Object (e.g., 'C' params pointing to its
+Tasks), so the Array acquires a reference to the Object and releases it along
+with itself.
+*/
+// -----------------------------------------------------------------------------
+Array *new_object_array(Object *object) {
+    const ObjectType *type = object->type;
+    Array *result = new_array('*', type->length(object->data));
+
+    for (guint i=0; i < result->len; i++) {
+        type->get_element(object->data, i, result->params + i);
+    }
+
+    result->owner = acquire_object(object);
+    result->free_owner = (GDestroyNotify) release_object;
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Acquires another reference to an Array.
+*/
+// -----------------------------------------------------------------------------
+Array *acquire_array(Array *array) {
+    array->ref_count++;
+    return array;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Releases a reference to an Array, freeing it once no params share it.
+*/
+// -----------------------------------------------------------------------------
+void release_array(Array *array) {
+    if (--array->ref_count > 0) return;
+
+    if (array->type == '*') {
+        for (guint i=0; i < array->len; i++) clear_param(array->params + i);
+    }
+    g_free(array->data);
+    if (array->free_owner) array->free_owner(array->owner);
+    g_free(array);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Copies an element of an Array into a param value.
+
+\note The caller is responsible for releasing dst with clear_param.
+*/
+// -----------------------------------------------------------------------------
+void get_array_element(const Array *array, guint index, Param *dst) {
+    dst->val_custom_comment = NULL;
+
+    if (array->type == 'I') {
+        dst->type = 'I';
+        dst->val_int = array->ints[index];
+    }
+    else if (array->type == 'D') {
+        dst->type = 'D';
+        dst->val_double = array->doubles[index];
+    }
+    else {
+        copy_param(dst, array->params + index);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints the elements of an Array on one line (e.g., "[ 1 2 3 ]").
+*/
+// -----------------------------------------------------------------------------
+void print_array(const Array *array, FILE *file) {
+    fprintf(file, "[");
+
+    for (guint i=0; i < array->len && i < MAX_PRINTED_ELEMENTS; i++) {
+        if (array->type == 'I') {
+            fprintf(file, " %ld", array->ints[i]);
+            continue;
+        }
+        if (array->type == 'D') {
+            fprintf(file, " %lf", array->doubles[i]);
+            continue;
+        }
+
+        const Param *param = array->params + i;
+        switch (param->type) {
+            case 'I': fprintf(file, " %ld", param->val_int); break;
+            case 'D': fprintf(file, " %lf", param->val_double); break;
+            case 'S': fprintf(file, " \"%s\"", param->val_string); break;
+            case 'C': fprintf(file, " C:%s", param->val_custom_comment); break;
+            case 'A': fprintf(file, " "); print_array(param->val_array, file); break;
+            case 'O': fprintf(file, " "); print_object(param->val_object, file); break;
+            default: fprintf(file, " %c", param->type); break;
+        }
+    }
+
+    if (array->len > MAX_PRINTED_ELEMENTS) {
+        fprintf(file, " ... (%u elements)", array->len);
+    }
+    fprintf(file, " ]");
+}
+
+
+
+/** \brief Defines a SIMD kernel that computes dst = x op y elementwise.
+
+Either x or y may be NULL, in which case its scalar is used for every element.
+dst may be the same as x or y.
+*/
+#define ELEMENTWISE_KERNEL(_name_, _type_, _Vector_, _operator_) \
+static void _name_(_type_ *dst, const _type_ *x, _type_ x_scalar, const _type_ *y, _type_ y_scalar, guint len) { \
+    const guint lanes = sizeof(_Vector_) / sizeof(_type_); \
+    _Vector_ vx = (_Vector_){0} + x_scalar; \
+    _Vector_ vy = (_Vector_){0} + y_scalar; \
+    guint i = 0; \
+    for (; i + lanes <= len; i += lanes) { \
+        if (x) memcpy(&vx, x + i, sizeof(vx)); \
+        if (y) memcpy(&vy, y + i, sizeof(vy)); \
+        _Vector_ result = vx _operator_ vy; \
+        memcpy(dst + i, &result, sizeof(result)); \
+    } \
+    for (; i < len; i++) { \
+        dst[i] = (x ? x[i] : x_scalar) _operator_ (y ? y[i] : y_scalar); \
+    } \
+}
+
+ELEMENTWISE_KERNEL(add_ints, guint64, IntVector, +)
+ELEMENTWISE_KERNEL(subtract_ints, guint64, IntVector, -)
+ELEMENTWISE_KERNEL(multiply_ints, guint64, IntVector, *)
+ELEMENTWISE_KERNEL(add_doubles, gdouble, DoubleVector, +)
+ELEMENTWISE_KERNEL(subtract_doubles, gdouble, DoubleVector, -)
+ELEMENTWISE_KERNEL(multiply_doubles, gdouble, DoubleVector, *)
+ELEMENTWISE_KERNEL(divide_doubles, gdouble, DoubleVector, /)
+
+
+
+// -----------------------------------------------------------------------------
+/** Computes dst = x / y elementwise for ints (truncating toward zero).
+
+There's no SIMD int division, so this is a plain loop. The divisors must not
+be 0 (see has_zero_divisor).
+*/
+// -----------------------------------------------------------------------------
+static void divide_ints(gint64 *dst, const gint64 *x, gint64 x_scalar, const gint64 *y, gint64 y_scalar, guint len) {
+    for (guint i=0; i < len; i++) {
+        gint64 dividend = x ? x[i] : x_scalar;
+        gint64 divisor = y ? y[i] : y_scalar;
+
+        // G_MININT64 / -1 overflows, so negate instead
+        dst[i] = divisor == -1 ? (gint64) (0 - (guint64) dividend) : dividend / divisor;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the sum of an int Array (wrapping around on overflow).
+*/
+// -----------------------------------------------------------------------------
+static gint64 sum_ints(const gint64 *values, guint len) {
+    const guint lanes = sizeof(IntVector) / sizeof(gint64);
+    IntVector sums = {0};
+    guint i = 0;
+    for (; i + lanes <= len; i += lanes) {
+        IntVector v;
+        memcpy(&v, values + i, sizeof(v));
+        sums += v;
+    }
+
+    guint64 result = 0;
+    for (guint lane=0; lane < lanes; lane++) result += sums[lane];
+    for (; i < len; i++) result += (guint64) values[i];
+    return (gint64) result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the sum of a double Array.
+
+\note The elements are added in VECTOR_BYTES lanes, so rounding can differ
+      slightly from adding them in order.
+*/
+// -----------------------------------------------------------------------------
+static gdouble sum_doubles(const gdouble *values, guint len) {
+    const guint lanes = sizeof(DoubleVector) / sizeof(gdouble);
+    DoubleVector sums = {0};
+    guint i = 0;
+    for (; i + lanes <= len; i += lanes) {
+        DoubleVector v;
+        memcpy(&v, values + i, sizeof(v));
+        sums += v;
+    }
+
+    gdouble result = 0;
+    for (guint lane=0; lane < lanes; lane++) result += sums[lane];
+    for (; i < len; i++) result += values[i];
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Computes the sum of a numeric Array.
+
+\param result: Receives an int (for an int Array) or a double
+\returns 1 if the sum was computed; 0 if the Array isn't numeric
+*/
+// -----------------------------------------------------------------------------
+gboolean sum_array(const Array *array, Param *result) {
+    result->val_custom_comment = NULL;
+
+    if (array->type == 'I') {
+        result->type = 'I';
+        result->val_int = sum_ints(array->ints, array->len);
+        return 1;
+    }
+    if (array->type == 'D') {
+        result->type = 'D';
+        result->val_double = sum_doubles(array->doubles, array->len);
+        return 1;
+    }
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the type of the elements of an operand of array_arithmetic ('I',
+'D', or 0 if it can't be used).
+*/
+// -----------------------------------------------------------------------------
+static gchar operand_type(const Param *param) {
+    if (param->type == 'I' || param->type == 'D') return param->type;
+    if (param->type == 'A' && param->val_array->type != '*') return param->val_array->type;
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if an int divisor (or any element of one) is 0.
+*/
+// -----------------------------------------------------------------------------
+static gboolean has_zero_divisor(const Param *divisor) {
+    if (divisor->type != 'A') return divisor->val_int == 0;
+
+    for (guint i=0; i < divisor->val_array->len; i++) {
+        if (divisor->val_array->ints[i] == 0) return 1;
+    }
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the elements of a numeric operand as doubles.
+
+\param scalar: Receives the value if the operand is a number
+\returns The doubles (NULL for a number); free them with g_free if they're not
+         the Array's own elements
+*/
+// -----------------------------------------------------------------------------
+static gdouble *operand_doubles(const Param *param, gdouble *scalar) {
+    *scalar = 0;
+
+    if (param->type == 'I') *scalar = param->val_int;
+    if (param->type == 'D') *scalar = param->val_double;
+    if (param->type != 'A') return NULL;
+
+    const Array *array = param->val_array;
+    if (array->type == 'D') return array->doubles;
+
+    gdouble *result = g_new(gdouble, array->len);
+    for (guint i=0; i < array->len; i++) result[i] = array->ints[i];
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Computes a = a op b elementwise where a or b is a numeric array.
+
+\param a: Left operand; receives the result
+\param b: Right operand
+\param op: '+', '-', '*', or '/'
+\returns 1 on success; 0 if the error has been handled
+
+A number is combined with every element of an array. The result is an array
+of ints if both operands are ints and an array of doubles otherwise. If no
+other param shares a's array and it has the right type, the result is computed
+in place.
+*/
+// -----------------------------------------------------------------------------
+gboolean array_arithmetic(Param *a, const Param *b, gchar op) {
+    gchar a_type = operand_type(a);
+    gchar b_type = operand_type(b);
+
+    if (!a_type || !b_type) {
+        Param copy;
+        copy_param(&copy, a_type ? b : a);
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&copy, stderr, "----> ");
+        clear_param(&copy);
+        return 0;
+    }
+
+    Array *x = a->type == 'A' ? a->val_array : NULL;
+    Array *y = b->type == 'A' ? b->val_array : NULL;
+
+    if (x && y && x->len != y->len) {
+        guint x_len = x->len, y_len = y->len;   // handle_error releases the arrays
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Arrays have different lengths (%u and %u)\n", x_len, y_len);
+        return 0;
+    }
+
+    gboolean is_int = a_type == 'I' && b_type == 'I';
+    if (is_int && op == '/' && has_zero_divisor(b)) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Division by zero\n");
+        return 0;
+    }
+
+    guint len = x ? x->len : y->len;
+    gchar result_type = is_int ? 'I' : 'D';
+    Array *result = x && x->ref_count == 1 && x->type == result_type && !x->owner ?
+                    x : new_array(result_type, len);
+
+    if (is_int) {
+        guint64 *dst = (guint64 *) result->ints;
+        const guint64 *xs = x ? (const guint64 *) x->ints : NULL;
+        const guint64 *ys = y ? (const guint64 *) y->ints : NULL;
+        guint64 x_scalar = x ? 0 : a->val_int;
+        guint64 y_scalar = y ? 0 : b->val_int;
+
+        switch (op) {
+            case '+': add_ints(dst, xs, x_scalar, ys, y_scalar, len); break;
+            case '-': subtract_ints(dst, xs, x_scalar, ys, y_scalar, len); break;
+            case '*': multiply_ints(dst, xs, x_scalar, ys, y_scalar, len); break;
+            case '/': divide_ints(result->ints, x ? x->ints : NULL, a->val_int, y ? y->ints : NULL, b->val_int, len); break;
+        }
+    }
+    else {
+        gdouble x_scalar, y_scalar;
+        gdouble *xs = operand_doubles(a, &x_scalar);
+        gdouble *ys = operand_doubles(b, &y_scalar);
+
+        switch (op) {
+            case '+': add_doubles(result->doubles, xs, x_scalar, ys, y_scalar, len); break;
+            case '-': subtract_doubles(result->doubles, xs, x_scalar, ys, y_scalar, len); break;
+            case '*': multiply_doubles(result->doubles, xs, x_scalar, ys, y_scalar, len); break;
+            case '/': divide_doubles(result->doubles, xs, x_scalar, ys, y_scalar, len); break;
+        }
+
+        if (x && xs != x->doubles) g_free(xs);
+        if (y && ys != y->doubles) g_free(ys);
+    }
+
+    if (result != x) {
+        clear_param(a);
+        a->type = 'A';
+        a->val_array = result;
+    }
+    return 1;
+}
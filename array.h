@@ -0,0 +1,16 @@
+/** \file array.h
+*/
+
+#pragma once
+
+Array *new_array(gchar type, guint len);
+Array *new_array_from_values(Param *values, guint len);
+Array *new_object_array(Object *object);
+Array *acquire_array(Array *array);
+void release_array(Array *array);
+
+void get_array_element(const Array *array, guint index, Param *dst);
+void print_array(const Array *array, FILE *file);
+
+gboolean sum_array(const Array *array, Param *result);
+gboolean array_arithmetic(Param *a, const Param *b, gchar op);
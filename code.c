@@ -0,0 +1,345 @@
+/** \file code.c
+
+\brief Functions for compiling definitions into threaded code and running it.
+
+While a definition is being compiled, its words are added to the params of its
+Entry (see compile). When the definition is completed, compile_definition
+flattens these params into one contiguous array of Instructions. Each param
+becomes exactly one Instruction, so the offsets recorded by "if", "else", and
+"then" can be resolved directly to Instruction addresses.
+
+The "code" of an Instruction (IC_*) is called with the Instruction itself so it
+can get at its inline operand. Instructions that change the flow of control do
+so by setting _ip, which always points to the next Instruction to dispatch
+(see EC_execute).
+
+Calling a definition doesn't recurse in C: IC_call pushes a Frame onto the
+return stack and points _ip at the definition's code, and IC_exit pops it. A
+call that is immediately followed by the end of the definition is compiled
+into IC_tail_call, which reuses the caller's Frame so that chains of tail calls
+don't grow the return stack.
+
+*/
+
+
+// -----------------------------------------------------------------------------
+/** Executes the Entry in the Instruction's operand.
+
+Definitions are entered directly by pushing a Frame and jumping to their code.
+Everything else has its routine executed, including definitions bound to C
+routines unless calls from C are nested too deeply (see aot_call).
+*/
+// -----------------------------------------------------------------------------
+void IC_call(Instruction *instruction) {
+    Entry *entry = instruction->operand.entry;
+
+    if (entry->routine != EC_execute && (_native_depth < MAX_NATIVE_DEPTH || !entry->code)) {
+        execute(entry);
+        return;
+    }
+
+    if (!push_frame_r(_ip, entry)) return;
+    _ip = entry->code;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Executes the Entry in the Instruction's operand as the last step of a definition.
+
+The current Frame is reused for the called definition, so it returns directly
+to the caller's caller.
+*/
+// -----------------------------------------------------------------------------
+void IC_tail_call(Instruction *instruction) {
+    Entry *entry = instruction->operand.entry;
+
+    if (entry->routine != EC_execute && (_native_depth < MAX_NATIVE_DEPTH || !entry->code)) {
+        execute(entry);
+        _ip = pop_frame_r();
+        return;
+    }
+
+    Frame *frame = top_frame_r();
+    if (frame->num_locals) release_locals(frame);
+    _loops_depth = frame->loops;
+    frame->entry = entry;
+    _ip = entry->code;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a copy of the Instruction's literal onto the stack.
+*/
+// -----------------------------------------------------------------------------
+void IC_push_literal(Instruction *instruction) {
+    push_value(instruction->operand.param);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Jumps to the Instruction's target.
+*/
+// -----------------------------------------------------------------------------
+void IC_jmp(Instruction *instruction) {
+    _ip = instruction->operand.target;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a param and jumps to the Instruction's target if its val_int is 0.
+*/
+// -----------------------------------------------------------------------------
+void IC_jmp_if_false(Instruction *instruction) {
+    Param param_bool;
+    if (!pop_value(&param_bool)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    if (param_bool.val_int == 0) {
+        _ip = instruction->operand.target;
+    }
+
+    clear_param(&param_bool);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns from a definition by popping its Frame off the return stack.
+*/
+// -----------------------------------------------------------------------------
+void IC_exit(Instruction *instruction) {
+    _ip = pop_frame_r();
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs the routine of a pseudo entry that has no dedicated Instruction code.
+*/
+// -----------------------------------------------------------------------------
+void IC_pseudo(Instruction *instruction) {
+    Entry *pseudo_entry = instruction->operand.entry;
+    pseudo_entry->routine(pseudo_entry);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the first param of an Entry or NULL if it has none.
+*/
+// -----------------------------------------------------------------------------
+static Param *get_param0(Entry *entry) {
+    GSequenceIter *begin = g_sequence_get_begin_iter(entry->params);
+    if (g_sequence_iter_is_end(begin)) return NULL;
+    return g_sequence_get(begin);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the code of the branch Instruction for a pseudo entry routine (or
+NULL if the routine isn't a branch).
+*/
+// -----------------------------------------------------------------------------
+static instruction_ptr branch_code(routine_ptr routine) {
+    if (routine == EC_jmp) return IC_jmp;
+    if (routine == EC_jmp_if_false) return IC_jmp_if_false;
+    if (routine == EC_enter_loop) return IC_do;
+    if (routine == EC_next_loop) return IC_loop;
+    if (routine == EC_next_loop_by) return IC_plus_loop;
+    if (routine == EC_exit_loop) return IC_leave;
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Flattens the params of a definition into threaded code.
+
+\param entry: A completed definition
+
+The resulting array of Instructions is stored in entry->code and is freed
+along with the Entry. The array is terminated by an Instruction whose code is
+NULL. The params are left in place since the literals they hold are referenced
+by the code.
+
+Pseudo entries are compiled according to their routine:
+
+- EC_push_param0: IC_push_literal with the pseudo entry's first param
+- EC_jmp: IC_jmp to the Instruction at the offset in the first param
+- EC_jmp_if_false: IC_jmp_if_false to the Instruction at the offset in the first param
+- EC_enter_loop, EC_next_loop, EC_next_loop_by, EC_exit_loop: IC_do, IC_loop,
+  IC_plus_loop, and IC_leave, which also branch to the offset in the first param
+- EC_pop_return_stack: IC_exit
+- Anything else: IC_pseudo, which runs the pseudo entry's routine
+
+Unless optimization has been turned off, the Instructions are then simplified
+by optimize_code, so an Instruction no longer necessarily corresponds to a
+param.
+
+An IC_call followed by IC_exit becomes an IC_tail_call. The IC_exit is kept
+since a branch may still target it. When optimizing, other calls to routines
+with a quickener become IC_quicken (see quicken.c).
+
+If the definition was compiled ahead of time, its routine is then replaced by
+the C function (see bind_native_definition).
+*/
+// -----------------------------------------------------------------------------
+void compile_definition(Entry *entry) {
+    gint num_instructions = g_sequence_get_length(entry->params);
+    Instruction *code = g_new0(Instruction, num_instructions + 1);
+    Instruction *instruction = code;
+
+    for (GSequenceIter *iter = g_sequence_get_begin_iter(entry->params);
+         !g_sequence_iter_is_end(iter);
+         iter = g_sequence_iter_next(iter), instruction++) {
+
+        Param *param = g_sequence_get(iter);
+
+        if (param->type == 'E') {
+            instruction->code = IC_call;
+            instruction->operand.entry = param->val_entry;
+
+            // A definition that reads the input has to be run as it's read (see line.c)
+            if (instruction->operand.entry->interpret_only) entry->interpret_only = 1;
+            continue;
+        }
+
+        Entry *pseudo_entry = param->val_pseudo_entry;
+        Param *param0 = get_param0(pseudo_entry);
+
+        if (pseudo_entry->routine == EC_push_param0) {
+            instruction->code = IC_push_literal;
+            instruction->operand.param = param0;
+        }
+        else if (branch_code(pseudo_entry->routine)) {
+            if (!param0 || param0->val_int < 0 || param0->val_int >= num_instructions) {
+                handle_error(ERR_GENERIC_ERROR);
+                fprintf(stderr, "-----> Unresolved branch in '%s'\n", entry->word);
+                g_free(code);
+                return;
+            }
+            instruction->code = branch_code(pseudo_entry->routine);
+            instruction->operand.target = code + param0->val_int;
+        }
+        else if (pseudo_entry->routine == EC_enter_locals) {
+            instruction->code = IC_enter_locals;
+            instruction->operand.local = param0->val_int;
+        }
+        else if (pseudo_entry->routine == EC_fetch_local) {
+            instruction->code = IC_fetch_local;
+            instruction->operand.local = param0->val_int;
+        }
+        else if (pseudo_entry->routine == EC_store_local) {
+            instruction->code = IC_store_local;
+            instruction->operand.local = param0->val_int;
+        }
+        else if (pseudo_entry->routine == EC_pop_return_stack) {
+            instruction->code = IC_exit;
+            instruction->operand.entry = NULL;
+        }
+        else {
+            instruction->code = IC_pseudo;
+            instruction->operand.entry = pseudo_entry;
+        }
+    }
+
+    // Terminate code so it can be walked without knowing its length
+    instruction->code = NULL;
+    instruction->operand.entry = NULL;
+
+    // Literals from an earlier compilation of this definition are no longer needed
+    if (entry->code_params) {
+        g_ptr_array_free(entry->code_params, TRUE);
+        entry->code_params = NULL;
+    }
+
+    if (_optimize) {
+        optimize_code(entry, code, num_instructions);
+    }
+
+    for (instruction = code; instruction->code; instruction++) {
+        if (instruction->code == IC_call && instruction[1].code == IC_exit) {
+            instruction->code = IC_tail_call;
+        }
+        else if (_optimize && instruction->code == IC_call && can_quicken(instruction->operand.entry)) {
+            instruction->code = IC_quicken;
+        }
+    }
+
+    g_free(entry->code);
+    entry->code = code;
+
+    bind_native_definition(entry);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints the threaded code of a definition, one Instruction per line.
+
+\param entry: Entry whose code should be printed
+\param file: Output file
+\param prefix: Prefix for each line
+
+Instructions are printed the same way as the params they were compiled from.
+Fused Instructions are printed as the Instructions they replaced (see fuse.c).
+*/
+// -----------------------------------------------------------------------------
+void print_code(Entry *entry, FILE *file, const gchar *prefix) {
+    if (!entry->code) return;
+
+    for (Instruction *ip = entry->code; ip->code; ip++) {
+        const Instruction *instruction = unfused_instruction(ip);
+
+        if (instruction->code == IC_call || instruction->code == IC_tail_call || is_quickened_call(instruction)) {
+            fprintf(file, "%sE: %s\n", prefix, instruction->operand.entry->word);
+        }
+        else if (instruction->code == IC_push_literal) {
+            fprintf(file, "%sP: push-literal-%c\n", prefix, instruction->operand.param->type);
+        }
+        else if (instruction->code == IC_jmp) {
+            fprintf(file, "%sP: jmp\n", prefix);
+        }
+        else if (instruction->code == IC_jmp_if_false) {
+            fprintf(file, "%sP: jmp-if-false\n", prefix);
+        }
+        else if (instruction->code == IC_do) {
+            fprintf(file, "%sP: do\n", prefix);
+        }
+        else if (instruction->code == IC_loop) {
+            fprintf(file, "%sP: loop\n", prefix);
+        }
+        else if (instruction->code == IC_plus_loop) {
+            fprintf(file, "%sP: +loop\n", prefix);
+        }
+        else if (instruction->code == IC_leave) {
+            fprintf(file, "%sP: leave\n", prefix);
+        }
+        else if (instruction->code == IC_exit) {
+            fprintf(file, "%sP: ;\n", prefix);
+        }
+        else if (instruction->code == IC_enter_locals) {
+            fprintf(file, "%sP: locals %u\n", prefix, instruction->operand.local);
+        }
+        else if (instruction->code == IC_fetch_local) {
+            fprintf(file, "%sP: local@ %u\n", prefix, instruction->operand.local);
+        }
+        else if (instruction->code == IC_store_local) {
+            fprintf(file, "%sP: local! %u\n", prefix, instruction->operand.local);
+        }
+        else if (literal_word(instruction->code)) {
+            fprintf(file, "%sP: push-literal-%c %s\n", prefix, instruction->operand.param->type,
+                    literal_word(instruction->code));
+        }
+        else {
+            fprintf(file, "%sP: %s\n", prefix, instruction->operand.entry->word);
+        }
+    }
+}
@@ -0,0 +1,15 @@
+/** \file code.h
+*/
+
+#pragma once
+
+void compile_definition(Entry *entry);
+void print_code(Entry *entry, FILE *file, const gchar *prefix);
+
+void IC_call(Instruction *instruction);
+void IC_tail_call(Instruction *instruction);
+void IC_push_literal(Instruction *instruction);
+void IC_jmp(Instruction *instruction);
+void IC_jmp_if_false(Instruction *instruction);
+void IC_exit(Instruction *instruction);
+void IC_pseudo(Instruction *instruction);
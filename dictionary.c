@@ -2,9 +2,20 @@
 
 \brief Defines functions for manipulating the global Forth dictionary: _dictionary.
 
-A Dictionary is just a GList of Entry objects. Each Entry is added to the end
-of the _dictionary. Searches for an Entry start at the end and move backwards.
-This allows older entries to be overridden.
+A Dictionary is a GList of Entry objects along with a hash index from each word
+to its newest Entry (_dictionary_index). When an Entry is added with the same
+word as an existing one, the new Entry records the older one in its "shadowed"
+field and replaces it in the index. This allows older entries to be overridden
+while still being reachable (e.g., when a definition uses the word it is
+redefining).
+
+Entries that are still being defined (i.e., not "complete") stay in the index
+but are skipped by find_entry, which falls through to the Entry they shadow.
+
+Every Entry belongs to a Wordlist. Lexicons add their words to their own
+Wordlist (see set_current_wordlist) so a specific lexicon's version of a word
+can be found with find_entry_in_wordlist or, from Forth, with a qualified
+word like "notes:N".
 
 The basic dictionary is built using build_dictionary. This should be functional
 as a control language. Any extensions to the dictionary should be done via
@@ -12,21 +23,113 @@ a word that can load new entries.
 
 */
 
+#define WORDLIST_SEPARATOR ':'   /**< \brief Separates wordlist from word in a qualified word */
+
+
+// -----------------------------------------------------------------------------
+/** Returns the Wordlist with the specified name or NULL if there isn't one.
+*/
+// -----------------------------------------------------------------------------
+Wordlist *find_wordlist(const gchar *name) {
+    for (GList *l=_wordlists; l != NULL; l = l->next) {
+        Wordlist *wordlist = l->data;
+        if (g_strcmp0(name, wordlist->name) == 0) return wordlist;
+    }
+    return NULL;
+}
+
+
 
 // -----------------------------------------------------------------------------
-/** Searches for an entry in the dictionary, starting from the most recent entry
-and moving backwards.
+/** Returns the Wordlist with the specified name, creating it if necessary.
+*/
+// -----------------------------------------------------------------------------
+Wordlist *add_wordlist(const gchar *name) {
+    Wordlist *result = find_wordlist(name);
+    if (result) return result;
+
+    result = g_new(Wordlist, 1);
+    g_strlcpy(result->name, name, MAX_WORD_LEN);
+    _wordlists = g_list_append(_wordlists, result);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Sets the Wordlist that new entries are added to.
+
+\param wordlist: Wordlist to add subsequent entries to
+\returns The previous current Wordlist so it can be restored
+
+Lexicons use this to put their words in their own Wordlist:
+
+    Wordlist *previous = set_current_wordlist(add_wordlist("notes"));
+    ...
+    set_current_wordlist(previous);
+*/
+// -----------------------------------------------------------------------------
+Wordlist *set_current_wordlist(Wordlist *wordlist) {
+    Wordlist *result = _current_wordlist;
+    _current_wordlist = wordlist;
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Searches for a complete entry in a specific wordlist.
+
+\param wordlist: Wordlist to search
+\param word: The string to search for
+\returns A pointer to the newest matching entry or NULL if not found
+*/
+// -----------------------------------------------------------------------------
+Entry *find_entry_in_wordlist(Wordlist *wordlist, const gchar *word) {
+    for (Entry *entry = g_hash_table_lookup(_dictionary_index, word); entry; entry = entry->shadowed) {
+        if (entry->complete && entry->wordlist == wordlist) return entry;
+    }
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Looks up a qualified word like "notes:N".
+
+\returns The entry or NULL if the word isn't qualified or isn't found
+*/
+// -----------------------------------------------------------------------------
+static Entry *find_qualified_entry(const gchar *word) {
+    const gchar *separator = strchr(word, WORDLIST_SEPARATOR);
+    if (!separator || separator == word || separator[1] == '\0') return NULL;
+
+    gchar name[MAX_WORD_LEN];
+    g_strlcpy(name, word, MIN(separator - word + 1, MAX_WORD_LEN));
+
+    Wordlist *wordlist = find_wordlist(name);
+    if (!wordlist) return NULL;
+
+    return find_entry_in_wordlist(wordlist, separator + 1);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Searches for the newest complete entry with the specified word.
 
 \param word: The string to search for
 \returns A pointer to the entry or NULL if not found
+
+If the word isn't in the dictionary, it's tried as a qualified word of the
+form "wordlist:word".
 */
 // -----------------------------------------------------------------------------
 Entry* find_entry(const gchar* word) {
-    for (GList* l=g_list_last(_dictionary); l != NULL; l = l->prev) {
-        Entry *entry = l->data;
-        if (entry->complete && g_strcmp0(word, entry->word) == 0) return entry;
+    for (Entry *entry = g_hash_table_lookup(_dictionary_index, word); entry; entry = entry->shadowed) {
+        if (entry->complete) return entry;
     }
-    return NULL;
+    return find_qualified_entry(word);
 }
 
 
@@ -35,12 +138,26 @@ Entry* find_entry(const gchar* word) {
 
 \param word: The word to use for the new entry
 \returns The newly created entry
+
+The entry is added to the current wordlist and becomes the latest entry.
 */
 // -----------------------------------------------------------------------------
 Entry *add_entry(const gchar *word) {
     Entry *result = new_entry();
     g_strlcpy(result->word, word, MAX_WORD_LEN);
-    _dictionary = g_list_append(_dictionary, result);
+    result->wordlist = _current_wordlist;
+    result->shadowed = g_hash_table_lookup(_dictionary_index, result->word);
+
+    // Lines compiled with the shadowed entry must be recompiled
+    if (result->shadowed) {
+        _dictionary_version++;
+        drop_lines_calling(result->word);
+    }
+
+    // NOTE: The key is owned by the entry, so we always replace it along with the value
+    g_hash_table_replace(_dictionary_index, result->word, result);
+    _dictionary = g_list_prepend(_dictionary, result);
+    _latest_entry = result;
     return result;
 }
 
@@ -51,10 +168,24 @@ Entry *add_entry(const gchar *word) {
 */
 // -----------------------------------------------------------------------------
 static void hook_up_extensions() {
-    add_entry("lex-sequence")->routine = EC_add_sequence_lexicon;
-    add_entry("lex-sqlite")->routine = EC_add_sqlite_lexicon;
-    add_entry("lex-notes")->routine = EC_add_notes_lexicon;
-    add_entry("lex-tasks")->routine = EC_add_tasks_lexicon;
+    Entry *entry;
+
+    // Lexicons add words, so lines calling them can't be compiled ahead (see line.c)
+    entry = add_entry("lex-sequence");
+    entry->routine = EC_add_sequence_lexicon;
+    entry->interpret_only = 1;
+
+    entry = add_entry("lex-sqlite");
+    entry->routine = EC_add_sqlite_lexicon;
+    entry->interpret_only = 1;
+
+    entry = add_entry("lex-notes");
+    entry->routine = EC_add_notes_lexicon;
+    entry->interpret_only = 1;
+
+    entry = add_entry("lex-tasks");
+    entry->routine = EC_add_tasks_lexicon;
+    entry->interpret_only = 1;
 }
 
 
@@ -62,16 +193,24 @@ static void hook_up_extensions() {
 // -----------------------------------------------------------------------------
 /** Builds the dictionary for the interpreter.
 
-This defines the basic words for the interpreter and will allow loading
+This defines the basic and math words for the interpreter and will allow loading
 of custom extensions for various applications. This is TBD, but the intent is
 that we can control the extensions dynamically.
 
+The basic, math, and array words go into the "forth" wordlist, which remains the current
+wordlist for definitions made by the user.
+
 \note Entries are new'd and so it's appropriate to do a g_list_free_full
       if the dictionary should be rebuilt.
 */
 // -----------------------------------------------------------------------------
 void build_dictionary() {
+    _dictionary_index = g_hash_table_new(g_str_hash, g_str_equal);
+    set_current_wordlist(add_wordlist("forth"));
+
     add_basic_words();
+    add_math_words();
+    add_array_words();
     hook_up_extensions();
 }
 
@@ -84,8 +223,20 @@ latest entry.
 */
 // -----------------------------------------------------------------------------
 Entry *latest_entry() {
-    Entry *result = g_list_last(_dictionary)->data;
-    return result;
+    return _latest_entry;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the entry that compile and words like "if" add params to.
+
+This is the line being compiled (see interpret_line) if there is one;
+otherwise, the latest entry.
+*/
+// -----------------------------------------------------------------------------
+Entry *compile_target() {
+    return _compile_target ? _compile_target : _latest_entry;
 }
 
 
@@ -94,5 +245,18 @@ Entry *latest_entry() {
 */
 // -----------------------------------------------------------------------------
 void destroy_dictionary() {
+    // Fusions and cached lines point into the code of the entries
+    clear_fusions();
+    clear_line_cache();
+    _dictionary_version++;
+
+    g_hash_table_destroy(_dictionary_index);
     g_list_free_full(_dictionary, free_entry);
+    g_list_free_full(_wordlists, g_free);
+
+    _dictionary_index = NULL;
+    _dictionary = NULL;
+    _wordlists = NULL;
+    _latest_entry = NULL;
+    _current_wordlist = NULL;
 }
@@ -7,4 +7,10 @@ void build_dictionary();
 Entry *add_entry(const gchar *word);
 Entry* find_entry(const gchar* word);
 Entry *latest_entry();
+Entry *compile_target();
 void destroy_dictionary();
+
+Wordlist *add_wordlist(const gchar *name);
+Wordlist *find_wordlist(const gchar *name);
+Wordlist *set_current_wordlist(Wordlist *wordlist);
+Entry *find_entry_in_wordlist(Wordlist *wordlist, const gchar *word);
@@ -0,0 +1,444 @@
+/** \file ec_array.c
+
+\brief Defines the array words.
+
+An array literal is written with "[" and "]": "[" marks the depth of the
+stack, and "]" moves everything pushed since into a new array. Since these are
+ordinary words, the elements can be computed (e.g., "[ 1 2 + 10 ]") and
+literals can be nested.
+
+map, filter, and reduce look up their word once and then run it on each
+element with execute, so the word may be a definition and no strings are
+evaluated per element.
+*/
+
+
+// -----------------------------------------------------------------------------
+/** Returns the array at a depth of the stack.
+
+\returns The Array or NULL (after handling the error) if the param isn't an array
+*/
+// -----------------------------------------------------------------------------
+static Array *stack_array(guint depth) {
+    const Param *param = peek_param(depth);
+    if (!param) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return NULL;
+    }
+    if (param->type == 'A') return param->val_array;
+
+    Param copy;
+    copy_param(&copy, param);
+    handle_error(ERR_INVALID_PARAM);
+    print_param(&copy, stderr, "----> ");
+    clear_param(&copy);
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets the Entry of a word param (a word name or an entry address).
+
+\returns The Entry or NULL (after handling the error) if there isn't one
+*/
+// -----------------------------------------------------------------------------
+static Entry *word_param_entry(const Param *param) {
+    Entry *result = NULL;
+    if (param->type == 'E') result = param->val_entry;
+    if (param->type == 'S') result = find_entry(param->val_string);
+    if (result) return result;
+
+    Param copy;
+    copy_param(&copy, param);
+    handle_error(ERR_UNKNOWN_WORD);
+    print_param(&copy, stderr, "----> ");
+    clear_param(&copy);
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a word on the stack and pops the one value it should leave.
+
+\param entry: Word to run
+\param depth: Depth of the stack before the word's arguments were pushed
+\param dst: Receives the result
+\returns 1 on success; 0 if the error has been handled
+*/
+// -----------------------------------------------------------------------------
+static gboolean run_element_word(Entry *entry, guint depth, Param *dst) {
+    execute(entry);
+    if (_release_transients) return 0;
+
+    if (stack_depth() != depth + 1) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> '%s' must leave one value\n", entry->word);
+        return 0;
+    }
+    pop_value(dst);
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Keeps the source of a derived array alive if its elements point into an
+owner (e.g., filtering an array of Tasks).
+*/
+// -----------------------------------------------------------------------------
+static void share_owner(Array *result, Array *source) {
+    if (!source->owner) return;
+
+    result->owner = acquire_array(source);
+    result->free_owner = (GDestroyNotify) release_array;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Releases values collected from an array before an error.
+*/
+// -----------------------------------------------------------------------------
+static void free_values(Param *values, guint len) {
+    for (guint i=0; i < len; i++) clear_param(values + i);
+    g_free(values);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Starts an array literal by marking the depth of the stack.
+*/
+// -----------------------------------------------------------------------------
+static void EC_open_array(gpointer gp_entry) {
+    guint depth = stack_depth();
+    g_array_append_val(_array_marks, depth);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends an array literal by moving the values pushed since its "[" into an array.
+*/
+// -----------------------------------------------------------------------------
+static void EC_close_array(gpointer gp_entry) {
+    if (_array_marks->len == 0) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> ']' without '['\n");
+        return;
+    }
+
+    guint mark = g_array_index(_array_marks, guint, _array_marks->len - 1);
+    g_array_set_size(_array_marks, _array_marks->len - 1);
+    if (mark > stack_depth()) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        fprintf(stderr, "-----> Values below '[' were consumed\n");
+        return;
+    }
+
+    guint len = stack_depth() - mark;
+    Param *values = g_new(Param, len);
+    pop_values(values, len);
+    push_array(new_array_from_values(values, len));
+    g_free(values);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets the number of elements of an array or collection Object on the stack.
+
+\param depth: Depth of the collection on the stack
+\param len: Receives the number of elements
+\returns 1 on success; 0 (after handling the error) if the param isn't a collection
+*/
+// -----------------------------------------------------------------------------
+static gboolean stack_collection_length(guint depth, guint *len) {
+    const Param *param = peek_param(depth);
+    if (!param) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return 0;
+    }
+
+    if (param->type == 'A') {
+        *len = param->val_array->len;
+        return 1;
+    }
+    if (param->type == 'O' && param->val_object->type->length) {
+        *len = param->val_object->type->length(param->val_object->data);
+        return 1;
+    }
+
+    Param copy;
+    copy_param(&copy, param);
+    handle_error(ERR_INVALID_PARAM);
+    print_param(&copy, stderr, "----> ");
+    clear_param(&copy);
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (collection n -- elem)
+
+A custom element (e.g., a Task) points into the collection, so it's pushed as
+an element object that keeps the collection alive (see own_element).
+*/
+// -----------------------------------------------------------------------------
+static void EC_nth(gpointer gp_entry) {
+    guint len;
+    if (!stack_collection_length(1, &len)) return;
+
+    const Param *param_index = top();
+    if (param_index->type != 'I' || param_index->val_int < 0 || param_index->val_int >= len) {
+        Param copy;
+        copy_param(&copy, param_index);
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&copy, stderr, "----> ");
+        fprintf(stderr, "-----> Index out of range for a collection of %u elements\n", len);
+        clear_param(&copy);
+        return;
+    }
+
+    const Param *param_collection = peek_param(1);
+    Param element;
+    if (param_collection->type == 'A') {
+        Array *array = param_collection->val_array;
+        get_array_element(array, param_index->val_int, &element);
+        if (array->owner) own_element(&element, acquire_array(array), (GDestroyNotify) release_array);
+    }
+    else {
+        Object *object = param_collection->val_object;
+        object->type->get_element(object->data, param_index->val_int, &element);
+        own_element(&element, acquire_object(object), (GDestroyNotify) release_object);
+    }
+
+    drop_values(2);
+    push_value(&element);
+    clear_param(&element);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (collection -- collection n)
+*/
+// -----------------------------------------------------------------------------
+static void EC_len(gpointer gp_entry) {
+    guint len;
+    if (!stack_collection_length(0, &len)) return;
+
+    push_int(len);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (collection -- array)
+
+An array is left as is. The elements of an Object are borrowed, not copied
+(see new_object_array).
+*/
+// -----------------------------------------------------------------------------
+static void EC_to_array(gpointer gp_entry) {
+    guint len;
+    if (!stack_collection_length(0, &len)) return;
+
+    const Param *param = top();
+    if (param->type == 'A') return;
+
+    Array *array = new_object_array(param->val_object);
+    drop_values(1);
+    push_array(array);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (array -- n)
+*/
+// -----------------------------------------------------------------------------
+static void EC_sum(gpointer gp_entry) {
+    Array *array = stack_array(0);
+    if (!array) return;
+
+    Param result;
+    if (!sum_array(array, &result)) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> 'sum' needs an array of numbers\n");
+        return;
+    }
+    drop_values(1);
+    push_value(&result);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (array word -- array)
+*/
+// -----------------------------------------------------------------------------
+static void EC_map(gpointer gp_entry) {
+    if (!stack_array(1)) return;
+    Entry *entry = word_param_entry(top());
+    if (!entry) return;
+
+    Param param_array;
+    drop_values(1);
+    pop_value(&param_array);
+    Array *array = param_array.val_array;
+
+    guint depth = stack_depth();
+    Param *results = g_new(Param, array->len);
+    for (guint i=0; i < array->len; i++) {
+        Param element;
+        get_array_element(array, i, &element);
+        push_value(&element);
+        clear_param(&element);
+
+        if (!run_element_word(entry, depth, results + i)) {
+            free_values(results, i);
+            clear_param(&param_array);
+            return;
+        }
+    }
+
+    Array *result = new_array_from_values(results, array->len);
+    g_free(results);
+    share_owner(result, array);
+    clear_param(&param_array);
+    push_array(result);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (array word -- array)
+*/
+// -----------------------------------------------------------------------------
+static void EC_filter(gpointer gp_entry) {
+    if (!stack_array(1)) return;
+    Entry *entry = word_param_entry(top());
+    if (!entry) return;
+
+    Param param_array;
+    drop_values(1);
+    pop_value(&param_array);
+    Array *array = param_array.val_array;
+
+    guint depth = stack_depth();
+    Param *kept = g_new(Param, array->len);
+    guint num_kept = 0;
+    for (guint i=0; i < array->len; i++) {
+        Param element;
+        get_array_element(array, i, &element);
+        push_value(&element);
+
+        Param flag;
+        if (!run_element_word(entry, depth, &flag)) {
+            clear_param(&element);
+            free_values(kept, num_kept);
+            clear_param(&param_array);
+            return;
+        }
+
+        gboolean is_kept = flag.type == 'I' ? flag.val_int != 0 :
+                           flag.type == 'D' ? flag.val_double != 0 : 1;
+        clear_param(&flag);
+
+        if (is_kept) kept[num_kept++] = element;
+        else clear_param(&element);
+    }
+
+    Array *result = new_array_from_values(kept, num_kept);
+    g_free(kept);
+    share_owner(result, array);
+    clear_param(&param_array);
+    push_array(result);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (array init word -- result)
+
+If the result is a custom element of the array (e.g., a Task), it's pushed as
+an element object that keeps the array alive (see own_element).
+*/
+// -----------------------------------------------------------------------------
+static void EC_reduce(gpointer gp_entry) {
+    if (!stack_array(2)) return;
+    Entry *entry = word_param_entry(top());
+    if (!entry) return;
+
+    Param accumulator;
+    Param param_array;
+    drop_values(1);
+    pop_value(&accumulator);
+    pop_value(&param_array);
+    Array *array = param_array.val_array;
+
+    guint depth = stack_depth();
+    for (guint i=0; i < array->len; i++) {
+        Param element;
+        get_array_element(array, i, &element);
+        push_value(&accumulator);
+        push_value(&element);
+        clear_param(&accumulator);
+        clear_param(&element);
+
+        if (!run_element_word(entry, depth, &accumulator)) {
+            clear_param(&param_array);
+            return;
+        }
+    }
+
+    if (array->owner) own_element(&accumulator, acquire_array(array), (GDestroyNotify) release_array);
+    clear_param(&param_array);
+    push_value(&accumulator);
+    clear_param(&accumulator);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Adds the array words to the dictionary.
+
+### Arrays
+- [ ( -- ) Starts an array literal
+- ] ( ... -- array) Moves the values pushed since "[" into an array
+- nth (collection n -- elem) Gets the nth element (starting from 0)
+- len (collection -- collection n) Number of elements
+- >array (collection -- array) Converts a collection (e.g., a seq of tasks) into an array
+- sum (array -- n) Sum of an array of numbers
+
+nth, len, and >array work on arrays and on collection objects (see object.c).
+
+Arrays of numbers also work with +, -, *, and / (see add_math_words).
+
+### Higher-order words
+The word is a word name (e.g., "double") or an entry address.
+- map (array word -- array) Runs word on each element (elem -- value)
+- filter (array word -- array) Keeps the elements for which word (elem -- flag) is true
+- reduce (array init word -- result) Folds the elements with word (acc elem -- acc)
+
+For instance:
+    : double   2 * ;
+    [ 1 2 3 4 ] "double" map .
+*/
+// -----------------------------------------------------------------------------
+void add_array_words() {
+    add_entry("[")->routine = EC_open_array;
+    add_entry("]")->routine = EC_close_array;
+    add_entry("nth")->routine = EC_nth;
+    add_entry("len")->routine = EC_len;
+    add_entry(">array")->routine = EC_to_array;
+    add_entry("sum")->routine = EC_sum;
+
+    add_entry("map")->routine = EC_map;
+    add_entry("filter")->routine = EC_filter;
+    add_entry("reduce")->routine = EC_reduce;
+}
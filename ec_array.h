@@ -0,0 +1,6 @@
+/** \file ec_array.h
+*/
+
+#pragma once
+
+void add_array_words();
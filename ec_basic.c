@@ -7,10 +7,6 @@ routines used when defining entries dynamically.
 
 */
 
-static void EC_execute(gpointer gp_entry);
-static void EC_jmp(gpointer gp_entry);
-static void EC_jmp_if_false(gpointer gp_entry);
-static void EC_push_entry_address(gpointer gp_entry);
 
 
 // -----------------------------------------------------------------------------
@@ -21,9 +17,53 @@ void add_variable(const gchar *word) {
     Entry *entry_new = add_entry(word);
     entry_new->routine = EC_push_entry_address;
 
-    // Adds an empty param to the variable entry for storing values
+    // Adds an empty param to the variable entry for storing values. It's
+    // also addressed directly so "@" and "!" don't have to look it up.
     Param *value = new_param();
     add_entry_param(entry_new, value);
+    entry_new->value = value;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Sets up a handle for a variable and looks it up.
+
+\param ref: Handle to set up (usually a global)
+\param word: Word of the variable (e.g., "tasks-db")
+*/
+// -----------------------------------------------------------------------------
+void init_variable_ref(VariableRef *ref, const gchar *word) {
+    g_strlcpy(ref->word, word, MAX_WORD_LEN);
+    ref->entry = NULL;
+    ref->version = _dictionary_version - 1;
+    variable_value(ref);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the value slot of the variable a handle refers to.
+
+\returns The variable's value (owned by the variable) or NULL if the word isn't
+          a variable
+
+The variable is only looked up again if a word has been redefined since the
+last lookup, so this follows the variable if the user redefines it.
+*/
+// -----------------------------------------------------------------------------
+Param *variable_value(VariableRef *ref) {
+    if (ref->version != _dictionary_version) {
+        ref->entry = find_entry(ref->word);
+        ref->version = _dictionary_version;
+
+        if (ref->entry && !ref->entry->value) {
+            ref->entry = NULL;
+        }
+    }
+
+    if (!ref->entry) return NULL;
+    return ref->entry->value;
 }
 
 
@@ -101,35 +141,33 @@ static void EC_variable(gpointer gp_entry) {
 \param gp_entry: unused
 */
 // -----------------------------------------------------------------------------
-static void EC_store_variable_value(gpointer gp_entry) {
-    Param *p_var = pop_param();    // Variable to store value in
-    if (!p_var) {
+void EC_store_variable_value(gpointer gp_entry) {
+    Param p_var;    // Variable to store value in
+    if (!pop_value(&p_var)) {
         handle_error(ERR_STACK_UNDERFLOW);
         return;
     }
 
-    Param *p_value = pop_param();  // Value to store
-    if (!p_value) {
+    Param p_value;  // Value to store
+    if (!pop_value(&p_value)) {
+        clear_param(&p_var);
         handle_error(ERR_STACK_UNDERFLOW);
         return;
     }
 
-    if (p_var->type != 'E') {
+    if (p_var.type != 'E' || !((Entry *) p_var.val_entry)->value) {
         handle_error(ERR_INVALID_PARAM);
-        print_param(p_var, stderr, "----> ");
+        print_param(&p_var, stderr, "----> ");
+        clear_param(&p_var);
+        clear_param(&p_value);
         return;
     }
 
 
-    // Store value in variable
-    Entry *entry_var = p_var->val_entry;
-    GSequenceIter *iter = g_sequence_get_iter_at_pos(entry_var->params, 0);
-    Param *var_value = g_sequence_get(iter);
-    copy_param(var_value, p_value);
-
-    // Cleanup
-    free_param(p_value);
-    free_param(p_var);
+    // Store value in variable, moving the popped value into it
+    Entry *entry_var = p_var.val_entry;
+    clear_param(entry_var->value);
+    *entry_var->value = p_value;
 }
 
 
@@ -140,19 +178,25 @@ static void EC_store_variable_value(gpointer gp_entry) {
 \param gp_entry: unused
 */
 // -----------------------------------------------------------------------------
-static void EC_fetch_variable_value(gpointer gp_entry) {
-    Param *p_var = pop_param();
+void EC_fetch_variable_value(gpointer gp_entry) {
+    Param p_var;
+    if (!pop_value(&p_var)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
 
-    Entry *entry_var = p_var->val_entry;
-    GSequenceIter *iter = g_sequence_get_iter_at_pos(entry_var->params, 0);
-    Param *var_value = g_sequence_get(iter);
+    if (p_var.type != 'E' || !((Entry *) p_var.val_entry)->value) {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&p_var, stderr, "----> ");
+        clear_param(&p_var);
+        return;
+    }
 
-    Param *param_new = new_param();
-    copy_param(param_new, var_value);
-    push_param(param_new);
+    Entry *entry_var = p_var.val_entry;
+    push_value(entry_var->value);
 
     // Cleanup
-    free_param(p_var);
+    clear_param(&p_var);
 }
 
 
@@ -167,10 +211,7 @@ void EC_push_param0(gpointer gp_entry) {
     Entry *entry = gp_entry;
     GSequenceIter *begin = g_sequence_get_begin_iter(entry->params);
     Param *param0 = g_sequence_get(begin);
-
-    Param *param_new = new_param();
-    copy_param(param_new, param0);
-    push_param(param_new);
+    push_value(param0);
 }
 
 
@@ -181,17 +222,9 @@ void EC_push_param0(gpointer gp_entry) {
 \param gp_entry: The entry with the parameter to be pushed.
 */
 // -----------------------------------------------------------------------------
-static void EC_push_entry_address(gpointer gp_entry) {
+void EC_push_entry_address(gpointer gp_entry) {
     Entry *entry = gp_entry;
-    Param *param = new_entry_param(entry);
-    push_param(param);
-}
-
-
-
-static void gfunc_print_param(gpointer gp_param, gpointer user_data) {
-    Param *param = gp_param;
-    print_param(param, stdout, "");
+    push_entry(entry);
 }
 
 
@@ -202,8 +235,9 @@ static void gfunc_print_param(gpointer gp_param, gpointer user_data) {
 */
 // -----------------------------------------------------------------------------
 static void EC_print_stack(gpointer gp_entry) {
-    // NOTE: We're assuming that this goes from the first element to the last
-    g_queue_foreach(_stack, gfunc_print_param, NULL);
+    for (guint depth = stack_depth(); depth > 0; depth--) {
+        print_param(peek_param(depth - 1), stdout, "");
+    }
     printf("\n");
 }
 
@@ -241,6 +275,7 @@ static void EC_define(gpointer gp_entry) {
     Entry *entry_new = add_entry(token.word);
     entry_new->complete = 0;
     entry_new->routine = EC_execute;
+    clear_compile_locals();
 
     _mode = 'C';
 }
@@ -248,26 +283,68 @@ static void EC_define(gpointer gp_entry) {
 
 
 // -----------------------------------------------------------------------------
-/** Pops return stack and stores in _ip.
+/** Pops a Frame off the return stack and stores its return Instruction in _ip.
+
+This is the routine of the ";" pseudo entry that ends every definition. It is
+compiled into IC_exit by compile_definition.
 */
 // -----------------------------------------------------------------------------
-static void EC_pop_return_stack(gpointer gp_entry) {
-    _ip = pop_param_r();
+void EC_pop_return_stack(gpointer gp_entry) {
+    _ip = pop_frame_r();
 }
 
 
 
 // -----------------------------------------------------------------------------
 /** Marks the end of the definition and returns interpreter to 'E'xecute mode.
+
+The definition's params are then compiled into threaded code (see
+compile_definition).
 */
 // -----------------------------------------------------------------------------
 static void EC_end_define(gpointer gp_entry) {
     Entry *entry_latest = latest_entry();
-    entry_latest->complete = 1;
     Param *pseudo_param = new_pseudo_entry_param(";", EC_pop_return_stack);
     add_entry_param(entry_latest, pseudo_param);
 
     _mode = 'E';
+    clear_compile_locals();
+
+    // Once complete, the definition hides any entry it shadows
+    if (entry_latest->shadowed) {
+        _dictionary_version++;
+        drop_lines_calling(entry_latest->word);
+    }
+
+    compile_definition(entry_latest);
+    if (entry_latest->code) {
+        entry_latest->complete = 1;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops the jmp pseudo entry pushed by an "if" or "else".
+
+\returns The pseudo entry or NULL (after handling the error) if the top of the
+         stack isn't one (e.g., "do ... then")
+*/
+// -----------------------------------------------------------------------------
+static Entry *pop_branch(const gchar *word) {
+    Param *param = pop_param();
+    Entry *result = NULL;
+    if (param && param->type == 'E' && param->val_entry) {
+        Entry *entry = param->val_entry;
+        if (entry->routine == EC_jmp || entry->routine == EC_jmp_if_false) result = entry;
+    }
+    if (param) free_param(param);
+
+    if (!result) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> '%s' without 'if'\n", word);
+    }
+    return result;
 }
 
 
@@ -284,13 +361,13 @@ know, at this time of the compilation, where to jump to, we push the pseudo entr
 onto the stack to be filled out later by an "else" or a "then" word.
 */
 // -----------------------------------------------------------------------------
-static void EC_if(gpointer gp_entry) {
-    Entry *entry_latest = latest_entry();
+void EC_if(gpointer gp_entry) {
+    Entry *entry_target = compile_target();
     Param *pseudo_param = new_pseudo_entry_param("jmp-if-false", EC_jmp_if_false);
-    add_entry_param(entry_latest, pseudo_param);
+    add_entry_param(entry_target, pseudo_param);
 
     // Push pseudo_param Entry onto stack so we can fill it out later
-    Param *param_pseudo_entry = new_entry_param(&pseudo_param->val_pseudo_entry);
+    Param *param_pseudo_entry = new_entry_param(pseudo_param->val_pseudo_entry);
     push_param(param_pseudo_entry);
 }
 
@@ -309,24 +386,22 @@ jmp must be added to the definition first. Similar to the "if" jmp, we
 will need to fill out the jmp target later, so we push it onto the stack.
 */
 // -----------------------------------------------------------------------------
-static void EC_else(gpointer gp_entry) {
-    Entry *entry_latest = latest_entry();
+void EC_else(gpointer gp_entry) {
+    Entry *entry_target = compile_target();
 
     // Pop param so we can fill out the target for the jmp
-    Param *param_jmp_entry = pop_param();
-    Entry *entry_jmp = param_jmp_entry->val_entry;
-    Param *param_jmp_target = new_int_param(g_sequence_get_length(entry_latest->params) + 1);
+    Entry *entry_jmp = pop_branch("else");
+    if (!entry_jmp) return;
+    Param *param_jmp_target = new_int_param(g_sequence_get_length(entry_target->params) + 1);
     add_entry_param(entry_jmp, param_jmp_target);
 
     // Add the jmp param
     Param *pseudo_param = new_pseudo_entry_param("jmp", EC_jmp);
-    add_entry_param(entry_latest, pseudo_param);
+    add_entry_param(entry_target, pseudo_param);
 
     // Push pseudo_param Entry onto stack so we can fill it out later
-    Param *param_pseudo_entry = new_entry_param(&pseudo_param->val_pseudo_entry);
+    Param *param_pseudo_entry = new_entry_param(pseudo_param->val_pseudo_entry);
     push_param(param_pseudo_entry);
-
-    free_param(param_jmp_entry);
 }
 
 
@@ -337,65 +412,82 @@ static void EC_else(gpointer gp_entry) {
 This pops a "pseudo entry" and sets its jmp target to be the next instruction.
 */
 // -----------------------------------------------------------------------------
-static void EC_then(gpointer gp_entry) {
-    Entry *entry_latest = latest_entry();
+void EC_then(gpointer gp_entry) {
+    Entry *entry_target = compile_target();
 
     // Pop param so we can fill out the target for the jmp
-    Param *param_jmp_entry = pop_param();
-    Entry *entry_jmp = param_jmp_entry->val_entry;
-    Param *param_jmp_target = new_int_param(g_sequence_get_length(entry_latest->params));
+    Entry *entry_jmp = pop_branch("then");
+    if (!entry_jmp) return;
+    Param *param_jmp_target = new_int_param(g_sequence_get_length(entry_target->params));
     add_entry_param(entry_jmp, param_jmp_target);
-
-    free_param(param_jmp_entry);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Implements a conditional jmp by updating the instruction pointer.
-
-This pops a param off the stack. If its val_int is 0, then it does a jmp to
-the instruction at the offset specified in its first param.
+/** Compiles a call to the definition being compiled.
 
+The definition can't be found by its word until it's complete, so this adds
+the latest entry directly.
 */
 // -----------------------------------------------------------------------------
-static void EC_jmp_if_false(gpointer gp_entry) {
-    Entry *entry = gp_entry;
+static void EC_recurse(gpointer gp_entry) {
+    if (_mode != 'C' || _compile_target) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> 'recurse' can only be used in a definition\n");
+        return;
+    }
+
+    Entry *entry_latest = latest_entry();
+    add_entry_param(entry_latest, new_entry_param(entry_latest));
+}
 
-    Param *param_bool = pop_param();
-    // If false, move the instruction pointer according to the entry's first param
-    if (param_bool->val_int == 0) {
-        // Get first param of entry
-        GSequenceIter *iter = g_sequence_get_iter_at_pos(entry->params, 0);
-        Param *param0 = g_sequence_get(iter);
 
-        // Update the instruction pointer
-        GSequence *instructions = g_sequence_iter_get_sequence(_ip);
-        _ip = g_sequence_get_iter_at_pos(instructions, param0->val_int);
-    }
 
-    free_param(param_bool);
+// -----------------------------------------------------------------------------
+/** Routine of the conditional jmp pseudo entry.
+
+The pseudo entry's first param is the offset of the instruction to jump to if
+the popped param is false. The jump itself is done by IC_jmp_if_false, which
+this pseudo entry is compiled into, so there's nothing to do here.
+*/
+// -----------------------------------------------------------------------------
+void EC_jmp_if_false(gpointer gp_entry) {
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Implements an unconditional jmp by updating the instruction pointer.
+/** Routine of the unconditional jmp pseudo entry.
 
-This sets the instruction pointer to the offset specified in the entry's
-first param.
+The pseudo entry's first param is the offset of the instruction to jump to.
+The jump itself is done by IC_jmp, which this pseudo entry is compiled into, so
+there's nothing to do here.
 */
 // -----------------------------------------------------------------------------
-static void EC_jmp(gpointer gp_entry) {
-    Entry *entry = gp_entry;
+void EC_jmp(gpointer gp_entry) {
+}
+
 
-    // Get first param of entry
-    GSequenceIter *iter = g_sequence_get_iter_at_pos(entry->params, 0);
-    Param *param0 = g_sequence_get(iter);
 
-    // Update the instruction pointer
-    GSequence *instructions = g_sequence_iter_get_sequence(_ip);
-    _ip = g_sequence_get_iter_at_pos(instructions, param0->val_int);
+// -----------------------------------------------------------------------------
+/** Turns on optimization of definitions as they are completed (see optimize_code).
+*/
+// -----------------------------------------------------------------------------
+static void EC_optimize_on(gpointer gp_entry) {
+    _optimize = 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Turns off optimization so definitions compile exactly as written.
+
+Definitions that were already compiled are not changed.
+*/
+// -----------------------------------------------------------------------------
+static void EC_optimize_off(gpointer gp_entry) {
+    _optimize = 0;
 }
 
 
@@ -414,6 +506,13 @@ static void EC_print_definition(gpointer gp_entry) {
         goto done;
     }
 
+    // Definitions are printed from their threaded code...
+    if (entry->code) {
+        print_code(entry, stdout, "");
+        goto done;
+    }
+
+    // ...everything else from its params
     for (GSequenceIter *iter = g_sequence_get_begin_iter(entry->params);
          !g_sequence_iter_is_end(iter);
          iter = g_sequence_iter_next(iter)) {
@@ -432,42 +531,30 @@ done:
 // -----------------------------------------------------------------------------
 /** Executes a definition
 
-This starts by pushing the current _ip onto the return stack and then setting
-the _ip to the first parameter of the entry's definition (stored in its params
-field). From there, each parameter of the definition is executed sequentially. If
-one of these parameters is a Dictionary entry, it will be executed by this same
-function, which will result in the return stack noting the place to return
-once that execution is complete.
+This starts by pushing a Frame with the current _ip onto the return stack and
+then setting the _ip to the first Instruction of the entry's threaded code (see
+compile_definition). From there, each Instruction is dispatched sequentially
+until that Frame has been popped. Nested definitions are run by this same loop
+(see IC_call), so the C stack doesn't grow with the depth of the calls.
+
+Because the loop only runs until its own Frame is popped, this is re-entrant:
+a routine called from a definition can use execute to run another definition
+and get control back once it returns. If an error occurs, _ip is set to NULL
+and the return stack is cleared, which stops every active loop.
 */
 // -----------------------------------------------------------------------------
-static void EC_execute(gpointer gp_entry) {
+void EC_execute(gpointer gp_entry) {
     Entry *entry = gp_entry;
-    Param *cur_param;
-    Entry *pseudo_entry;
-
-    push_param_r(_ip);
+    guint depth = _return_stack_depth;
 
-    _ip = g_sequence_get_begin_iter(entry->params);
+    if (!push_frame_r(_ip, entry)) return;
 
-    while (_ip) {
-        cur_param = g_sequence_get(_ip);
-        _ip = g_sequence_iter_next(_ip);
+    _ip = entry->code;
 
-        switch(cur_param->type) {
-            case 'E':
-                execute(cur_param->val_entry);
-                break;
-
-            case 'P':
-                pseudo_entry = &cur_param->val_pseudo_entry;
-                pseudo_entry->routine(pseudo_entry);
-                break;
-
-            default:
-                handle_error(ERR_UNKNOWN_WORD);
-                print_param(cur_param, stderr, "----->");
-                return;
-        }
+    while (_ip && _return_stack_depth > depth) {
+        Instruction *instruction = _ip++;
+        if (_profile_dispatch) profile_dispatch(instruction);
+        instruction->code(instruction);
     }
 }
 
@@ -479,88 +566,54 @@ static void EC_execute(gpointer gp_entry) {
 */
 // -----------------------------------------------------------------------------
 static void EC_pop_and_print(gpointer gp_entry) {
-    Param *param = pop_param();
-    print_param(param, stdout, "");
-    free_param(param);
-}
-
-
-
-// -----------------------------------------------------------------------------
-/** Pops a parameter from the stack
+    Param param;
+    if (!pop_value(&param)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
 
-*/
-// -----------------------------------------------------------------------------
-static void EC_pop(gpointer gp_entry) {
-    Param *param = pop_param();
-    free_param(param);
+    print_param(&param, stdout, "");
+    clear_param(&param);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Callback used with sqlite3 to store a retrieved value.
+/** Prints the counts of live, peak, and recycled objects in each Pool.
 
-This is used with the EC_DB_DOUBLE_GETTER and EC_DB_INT_GETTER macros.
 */
 // -----------------------------------------------------------------------------
-int set_double_cb(gpointer gp_double_ref, int num_cols, char **values, char **cols) {
-    if (num_cols != 1) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Unexpected num cols in set_double_cb\n");
-        return 1;
-    }
-
-    double *double_ref = gp_double_ref;
-    *double_ref = values[0] ? g_ascii_strtod(values[0], NULL) : 0.0;
-    return 0;
+static void EC_print_pools(gpointer gp_entry) {
+    print_pool(&_param_pool, stdout);
+    print_pool(&_entry_pool, stdout);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Callback used with sqlite3 to store a retrieved value.
+/** Pops a parameter from the stack
 
 */
 // -----------------------------------------------------------------------------
-int set_int_cb(gpointer gp_int_ref, int num_cols, char **values, char **cols) {
-    if (num_cols != 1) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Unexpected num cols in set_int_cb\n");
-        return 1;
+static void EC_pop(gpointer gp_entry) {
+    Param param;
+    if (!pop_value(&param)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
     }
 
-    gint64 *int_ref = gp_int_ref;
-    *int_ref = values[0] ? g_ascii_strtoll(values[0], NULL, 10) : 0.0;
-    return 0;
+    clear_param(&param);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** This stores a string value from a query.
-
-This is used with the EC_DB_STR_GETTER macro.
-
-\note Since this allocates a new string, the caller is responsible for freeing it
+/** Scans a string and runs (or compiles) it a token at a time.
 */
 // -----------------------------------------------------------------------------
-int set_string_cb(gpointer gp_char_p_ref, int num_cols, char **values, char **cols) {
-    if (num_cols != 1) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Unexpected num cols in set_double_cb\n");
-        return 1;
-    }
-
-    gchar **char_p_ref = gp_char_p_ref;
-
-    *char_p_ref = g_strdup(values[0]);
-    return 0;
-}
-
-
-void execute_string(const gchar *str) {
+void interpret_tokens(const gchar *str) {
     Entry *entry;
+
     scan_string(str);
 
     while(1) {
@@ -589,97 +642,125 @@ void execute_string(const gchar *str) {
 }
 
 
+
+void execute_string(const gchar *str) {
+    // Strings that were run before are reused without scanning them (see line.c)
+    if (_mode == 'E' && _line_mode && interpret_string(str, str)) return;
+
+    interpret_tokens(str);
+}
+
+
 // -----------------------------------------------------------------------------
 /** Creates a new string with parameters substituted
-*/
-// -----------------------------------------------------------------------------
-static gchar *macro_substitute(const gchar *const_str) {
-    GSequence *strings = g_sequence_new(g_free);
 
-    gchar *str = g_strdup(const_str);
-    guint index = 0;
-    while(str[index]) {
-        if (str[index] == '\'') str[index] = '"';
-        index++;
-    }
+Each `<digit> is replaced by the string that many places down from the top of
+the stack and each single quote is replaced by a double quote.
 
+\returns The substituted string, allocated from the arena
+*/
+// -----------------------------------------------------------------------------
+static gchar *macro_substitute(const gchar *str) {
     // =================================
-    // Scans string breaking at any `<digit> and performing a macro expansion
+    // Figure out length of result string
     // =================================
-    index = 0;
-    guint start_word = 0;
-    guint stack_length = g_queue_get_length(_stack);
-
-    while(str[index]) {
-        // Split string if we hit a "`"
-        if (str[index] == '`') {
-            if (index > start_word) {
-                g_sequence_append(strings, g_strndup(str+start_word, index - start_word));
-            }
-
-            guint stack_element = str[index+1] - '0';
-            guint stack_index = stack_length - stack_element - 1;
-            const Param *param = g_queue_peek_nth(_stack, stack_index);
-            g_sequence_append(strings, g_strdup(param->val_string));
-            index++;
-            start_word = index + 1;
+    gsize result_len = 0;
+    for (const gchar *c = str; *c; c++) {
+        if (c[0] == '`' && c[1]) {
+            const Param *param = peek_param(c[1] - '0');
+            result_len += strlen(param->val_string);
+            c++;
+        }
+        else {
+            result_len++;
         }
-        index++;
-    }
-    if (index > start_word) {
-        g_sequence_append(strings, g_strndup(str+start_word, index-start_word));
     }
-    g_free(str);
 
 
     // =================================
-    // Figure out length of result string
+    // Copy string into result, performing macro expansions
     // =================================
-    guint result_len = 0;
-    gchar *fragment;
-    for (GSequenceIter *iter=g_sequence_get_begin_iter(strings);
-         !g_sequence_iter_is_end(iter);
-         iter = g_sequence_iter_next(iter)) {
-
-        fragment = g_sequence_get(iter);
-        result_len += strlen(fragment);
+    gchar *result = arena_alloc(result_len + 1);
+    gchar *end = result;
+    for (const gchar *c = str; *c; c++) {
+        if (c[0] == '`' && c[1]) {
+            const Param *param = peek_param(c[1] - '0');
+            end = g_stpcpy(end, param->val_string);
+            c++;
+        }
+        else {
+            *end++ = (*c == '\'') ? '"' : *c;
+        }
     }
-    gchar *result = g_malloc(result_len+1);
+    *end = '\0';
 
+    return result;
+}
 
-    // =================================
-    // Copy strings into a result string
-    // =================================
-    gchar *start = result;
-    for (GSequenceIter *iter=g_sequence_get_begin_iter(strings);
-         !g_sequence_iter_is_end(iter);
-         iter = g_sequence_iter_next(iter)) {
 
-        start = g_stpcpy(start, g_sequence_get(iter));
+// -----------------------------------------------------------------------------
+/** Creates the key of a string with parameters substituted (see
+macro_substitute) in _string_cache.
+
+The key is the template followed by the string substituted for each `<digit>,
+so it's the same whenever the substitution would give the same string.
+
+\returns The key, allocated from the arena
+*/
+// -----------------------------------------------------------------------------
+static gchar *template_key(const gchar *str) {
+    gsize result_len = strlen(str);
+    for (const gchar *c = str; *c; c++) {
+        if (c[0] == '`' && c[1]) {
+            result_len += 1 + strlen(peek_param(c[1] - '0')->val_string);
+            c++;
+        }
     }
 
-    g_sequence_free(strings);
+    gchar *result = arena_alloc(result_len + 1);
+    gchar *end = g_stpcpy(result, str);
+    for (const gchar *c = str; *c; c++) {
+        if (c[0] == '`' && c[1]) {
+            *end++ = '\x1f';
+            end = g_stpcpy(end, peek_param(c[1] - '0')->val_string);
+            c++;
+        }
+    }
+    *end = '\0';
 
     return result;
 }
 
 
+
 // -----------------------------------------------------------------------------
 /** Executes a string with macro substitutions.
 
 (str -- ?)
+
+When the string was run before with the same substitutions, its cached code is
+run without substituting it again (see template_key).
 */
 // -----------------------------------------------------------------------------
 static void EC_execute_string(gpointer gp_entry) {
     Param *param_string = pop_param();
 
-    // Calling scan_string makes a copy of the specified string, so its OK to free it
+    gchar *key = NULL;
+    if (_mode == 'E' && _line_mode) {
+        key = template_key(param_string->val_string);
+        if (interpret_string(key, NULL)) {
+            free_param(param_string);
+            return;
+        }
+    }
+
+    // Calling scan_string makes a copy of the specified string, so its OK for
+    // it to be released with the arena
     gchar *str = macro_substitute(param_string->val_string);
     free_param(param_string);
 
-    //scan_string(str);
-    execute_string(str);
-    g_free(str);
+    if (key && interpret_string(key, str)) return;
+    interpret_tokens(str);
 }
 
 
@@ -690,6 +771,7 @@ static void EC_execute_string(gpointer gp_entry) {
 ### Interpreter control
 - .q ( -- ) Quits the interpreter
 - .i ( -- ) Accepts input from the user
+- .pool ( -- ) Prints allocation counts for Params and Entries
 
 ### Stack words
 - pop: ( -- ) Pops stack
@@ -706,38 +788,98 @@ static void EC_execute_string(gpointer gp_entry) {
 - : ( -- ) Starts a new definition
 - ; ( -- ) Ends a definition
 - .d (str -- ) Prints the words in a definition
+- optimize-on ( -- ) Optimizes definitions when they're completed (the default)
+- optimize-off ( -- ) Compiles definitions exactly as written (e.g., for .d)
 
 ### Branching
 - if (immediate) Used during compile to define branching
 - else (immediate) Used during compile to define branching
 - then (immediate) Used during compile to define branching
+- recurse (immediate) Compiles a call to the definition being compiled
+
+### Loops
+- begin (immediate) Starts an indefinite loop
+- until (immediate) (flag -- ) Ends a loop that repeats until flag is true
+- again (immediate) Ends a loop that repeats forever
+- while (immediate) (flag -- ) Exits a "begin" loop if flag is false
+- repeat (immediate) Ends a "begin ... while" loop
+- do (immediate) (limit start -- ) Starts a counted loop
+- loop (immediate) Ends a counted loop, adding 1 to the index
+- +loop (immediate) (step -- ) Ends a counted loop, adding step to the index
+- leave (immediate) Exits the innermost counted loop
+- i ( -- index) Index of the innermost counted loop
+- j ( -- index) Index of the counted loop around the innermost one
+
+### Locals
+- { (immediate) Declares locals, e.g. "{ a b -- c }", initialized from the stack
+- to (immediate) Compiles a store into the local named by the next word
+
+### Superinstructions
+- profile-on ( -- ) Counts adjacent Instructions as definitions run
+- profile-off ( -- ) Stops counting adjacent Instructions
+- fuse (min-count -- ) Fuses sequences that ran at least min-count times
+- unfuse ( -- ) Restores the original code of fused definitions
+- .fusions ( -- ) Prints the fusions and the dispatches they removed
+
+### Native code
+- .aot ( -- ) Prints how many definitions are running as native code
+
+### Line mode
+- line-mode-on ( -- ) Compiles each line of input before running it (the default)
+- line-mode-off ( -- ) Runs input one token at a time
+
+### Images
+- save-image (str -- ) Saves the dictionary to an image file
+- load-image (str -- ) Replaces the dictionary with the one in an image file
 
 */
 // -----------------------------------------------------------------------------
 void add_basic_words() {
     Entry *entry;
 
-    add_entry(".q")->routine = EC_quit;
-    add_entry(".i")->routine = EC_interactive;
+    entry = add_entry(".q");
+    entry->routine = EC_quit;
+    entry->interpret_only = 1;
+
+    entry = add_entry(".i");
+    entry->routine = EC_interactive;
+    entry->interpret_only = 1;
+
+    add_entry(".pool")->routine = EC_print_pools;
 
     add_entry(".")->routine = EC_pop_and_print;
     add_entry(".s")->routine = EC_print_stack;
     add_entry("pop")->routine = EC_pop;
+    add_pure_word(EC_pop, 1, 0, NULL);
+
+    entry = add_entry("constant");
+    entry->routine = EC_constant;
+    entry->interpret_only = 1;
+
+    entry = add_entry("variable");
+    entry->routine = EC_variable;
+    entry->interpret_only = 1;
 
-    add_entry("constant")->routine = EC_constant;
-    add_entry("variable")->routine = EC_variable;
     add_entry("!")->routine = EC_store_variable_value;
     add_entry("@")->routine = EC_fetch_variable_value;
+    add_quickener(EC_store_variable_value, quicken_store_variable);
+    add_quickener(EC_fetch_variable_value, quicken_fetch_variable);
 
-    add_entry(",")->routine = EC_execute_string;
+    entry = add_entry(",");
+    entry->routine = EC_execute_string;
+    entry->interpret_only = 1;
 
-    add_entry(":")->routine = EC_define;
+    entry = add_entry(":");
+    entry->routine = EC_define;
+    entry->interpret_only = 1;
 
     entry = add_entry(";");
     entry->immediate = 1;
     entry->routine = EC_end_define;
 
     add_entry(".d")->routine = EC_print_definition;
+    add_entry("optimize-on")->routine = EC_optimize_on;
+    add_entry("optimize-off")->routine = EC_optimize_off;
 
     entry = add_entry("if");
     entry->immediate = 1;
@@ -750,4 +892,71 @@ void add_basic_words() {
     entry = add_entry("then");
     entry->immediate = 1;
     entry->routine = EC_then;
+
+    entry = add_entry("recurse");
+    entry->immediate = 1;
+    entry->routine = EC_recurse;
+
+    entry = add_entry("begin");
+    entry->immediate = 1;
+    entry->routine = EC_begin;
+
+    entry = add_entry("until");
+    entry->immediate = 1;
+    entry->routine = EC_until;
+
+    entry = add_entry("again");
+    entry->immediate = 1;
+    entry->routine = EC_again;
+
+    entry = add_entry("while");
+    entry->immediate = 1;
+    entry->routine = EC_while;
+
+    entry = add_entry("repeat");
+    entry->immediate = 1;
+    entry->routine = EC_repeat;
+
+    entry = add_entry("do");
+    entry->immediate = 1;
+    entry->routine = EC_do;
+
+    entry = add_entry("loop");
+    entry->immediate = 1;
+    entry->routine = EC_loop;
+
+    entry = add_entry("+loop");
+    entry->immediate = 1;
+    entry->routine = EC_plus_loop;
+
+    entry = add_entry("leave");
+    entry->immediate = 1;
+    entry->routine = EC_leave;
+
+    add_entry("i")->routine = EC_i;
+    add_entry("j")->routine = EC_j;
+
+    entry = add_entry("{");
+    entry->immediate = 1;
+    entry->routine = EC_begin_locals;
+
+    entry = add_entry("to");
+    entry->immediate = 1;
+    entry->routine = EC_to;
+
+    add_entry("profile-on")->routine = EC_profile_on;
+    add_entry("profile-off")->routine = EC_profile_off;
+    add_entry("fuse")->routine = EC_fuse;
+    add_entry("unfuse")->routine = EC_unfuse;
+    add_entry(".fusions")->routine = EC_print_fusions;
+
+    add_entry(".aot")->routine = EC_print_aot;
+
+    add_entry("line-mode-on")->routine = EC_line_mode_on;
+    add_entry("line-mode-off")->routine = EC_line_mode_off;
+
+    add_entry("save-image")->routine = EC_save_image;
+    entry = add_entry("load-image");
+    entry->routine = EC_load_image;
+    entry->interpret_only = 1;
 }
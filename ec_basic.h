@@ -6,14 +6,24 @@
 void add_basic_words();
 
 void add_variable(const gchar *word);
+void init_variable_ref(VariableRef *ref, const gchar *word);
+Param *variable_value(VariableRef *ref);
 void find_and_execute(const gchar *word);
 
-int set_double_cb(gpointer gp_double_ref, int num_cols, char **values, char **cols);
-int set_int_cb(gpointer gp_int_ref, int num_cols, char **values, char **cols);
-int set_string_cb(gpointer gp_char_p_ref, int num_cols, char **values, char **cols);
 void execute_string(const gchar *str);
+void interpret_tokens(const gchar *str);
 
 void EC_push_param0(gpointer gp_entry);
+void EC_execute(gpointer gp_entry);
+void EC_push_entry_address(gpointer gp_entry);
+void EC_fetch_variable_value(gpointer gp_entry);
+void EC_store_variable_value(gpointer gp_entry);
+void EC_jmp(gpointer gp_entry);
+void EC_jmp_if_false(gpointer gp_entry);
+void EC_pop_return_stack(gpointer gp_entry);
+void EC_if(gpointer gp_entry);
+void EC_else(gpointer gp_entry);
+void EC_then(gpointer gp_entry);
 
 
 #define EC_DB_STR_SETTER(_ec_func_name_, _word_, _db_table_name_, _field_name_) \
@@ -24,23 +34,14 @@ void EC_push_param0(gpointer gp_entry);
         gint64 obj_id = param_obj_id->val_int; \
         free_param(param_obj_id); \
  \
-        gchar id_str[MAX_ID_LEN]; \
-        snprintf(id_str, MAX_ID_LEN, "%ld", obj_id); \
- \
-        sqlite3 *connection = get_db_connection(); \
-        gchar *sql = g_strconcat("update " _db_table_name_ " set " _field_name_ "=\"", param_value->val_string, "\" ", \
-                                 "where id=", id_str, \
-                                 NULL); \
-        free_param(param_value); \
- \
-        char *error_message = NULL; \
-        sqlite3_exec(connection, sql, NULL, NULL, &error_message); \
-        g_free(sql); \
- \
-        if (error_message) { \
-            handle_error(ERR_GENERIC_ERROR); \
-            fprintf(stderr, "-----> Problem executing '" _word_ "'\n----->%s", error_message); \
+        sqlite3_stmt *stmt = prepare_statement(get_db_connection(), \
+                                               "update " _db_table_name_ " set " _field_name_ "=?1 where id=?2"); \
+        if (stmt) { \
+            sqlite3_bind_text(stmt, 1, param_value->val_string, -1, SQLITE_TRANSIENT); \
+            sqlite3_bind_int64(stmt, 2, obj_id); \
+            step_statement(stmt, _word_); \
         } \
+        free_param(param_value); \
     }
 
 
@@ -56,24 +57,13 @@ void EC_push_param0(gpointer gp_entry);
         gint64 obj_id = param_obj_id->val_int; \
         free_param(param_obj_id); \
  \
-        gchar id_str[MAX_ID_LEN]; \
-        gchar value_str[MAX_INT_LEN]; \
-        snprintf(id_str, MAX_ID_LEN, "%ld", obj_id); \
-        snprintf(value_str, MAX_INT_LEN, "%ld", value); \
- \
-        sqlite3 *connection = get_db_connection(); \
-        gchar *sql = g_strconcat("update " _db_table_name_ " set " _field_name_ "=", value_str, " ", \
-                                 "where id=", id_str, \
-                                 NULL); \
+        sqlite3_stmt *stmt = prepare_statement(get_db_connection(), \
+                                               "update " _db_table_name_ " set " _field_name_ "=?1 where id=?2"); \
+        if (!stmt) return; \
  \
-        char *error_message = NULL; \
-        sqlite3_exec(connection, sql, NULL, NULL, &error_message); \
-        g_free(sql); \
- \
-        if (error_message) { \
-            handle_error(ERR_GENERIC_ERROR); \
-            fprintf(stderr, "-----> Problem executing '" _word_ "'\n----->%s", error_message); \
-        } \
+        sqlite3_bind_int64(stmt, 1, value); \
+        sqlite3_bind_int64(stmt, 2, obj_id); \
+        step_statement(stmt, _word_); \
     }
 
 
@@ -95,53 +85,32 @@ void EC_push_param0(gpointer gp_entry);
         gint64 obj_id = param_obj_id->val_int; \
         free_param(param_obj_id); \
  \
-        gchar id_str[MAX_ID_LEN]; \
-        gchar value_str[MAX_DOUBLE_LEN]; \
-        snprintf(id_str, MAX_ID_LEN, "%ld", obj_id); \
-        snprintf(value_str, MAX_DOUBLE_LEN, "%.1lf", value); \
- \
-        sqlite3 *connection = get_db_connection(); \
-        gchar *sql = g_strconcat("update " _db_table_name_ " set " _field_name_ "=", value_str, " ", \
-                                 "where id=", id_str, \
-                                 NULL); \
+        sqlite3_stmt *stmt = prepare_statement(get_db_connection(), \
+                                               "update " _db_table_name_ " set " _field_name_ "=?1 where id=?2"); \
+        if (!stmt) return; \
  \
-        char *error_message = NULL; \
-        sqlite3_exec(connection, sql, NULL, NULL, &error_message); \
-        g_free(sql); \
- \
-        if (error_message) { \
-            handle_error(ERR_GENERIC_ERROR); \
-            fprintf(stderr, "-----> Problem executing '" _word_ "'\n----->%s", error_message); \
-        } \
+        sqlite3_bind_double(stmt, 1, value); \
+        sqlite3_bind_int64(stmt, 2, obj_id); \
+        step_statement(stmt, _word_); \
     }
 
 
 #define EC_DB_DOUBLE_GETTER(_ec_func_name_, _word_, _db_table_name_, _field_name_) \
     static void _ec_func_name_(gpointer gp_entry) { \
-        sqlite3 *connection = get_db_connection(); \
-     \
         Param *param_obj_id = pop_param(); \
         gint64 obj_id = param_obj_id->val_int; \
         free_param(param_obj_id); \
      \
-        gchar id_str[MAX_ID_LEN]; \
-        snprintf(id_str, MAX_ID_LEN, "%ld", obj_id); \
+        sqlite3_stmt *stmt = prepare_statement(get_db_connection(), \
+                                               "select " _field_name_ " from " _db_table_name_ " where id=?1"); \
+        if (!stmt) return; \
      \
-        gchar *query = g_strconcat("select " \
-                                   _field_name_ \
-                                   " from " \
-                                   _db_table_name_ \
-                                   " where id=", id_str, NULL); \
-     \
-        double value_double; \
-        char *error_message = NULL; \
-        sqlite3_exec(connection, query, set_double_cb, &value_double, &error_message); \
-        g_free(query); \
-     \
-        if (error_message) { \
-            handle_error(ERR_GENERIC_ERROR); \
-            fprintf(stderr, "-----> Problem executing '" _word_ "'\n----->%s", error_message); \
-        } \
+        double value_double = 0.0; \
+        sqlite3_bind_int64(stmt, 1, obj_id); \
+        gint status = step_statement(stmt, _word_); \
+        if (status < 0) return; \
+        if (status == 1) value_double = sqlite3_column_double(stmt, 0); \
+        sqlite3_reset(stmt); \
      \
         Param *param_new = new_double_param(value_double); \
         push_param(param_new); \
@@ -151,72 +120,49 @@ void EC_push_param0(gpointer gp_entry);
 
 #define EC_DB_INT_GETTER(_ec_func_name_, _word_, _db_table_name_, _field_name_) \
     static void _ec_func_name_(gpointer gp_entry) { \
-        sqlite3 *connection = get_db_connection(); \
-     \
         Param *param_obj_id = pop_param(); \
         gint64 obj_id = param_obj_id->val_int; \
         free_param(param_obj_id); \
      \
-        gchar id_str[MAX_ID_LEN]; \
-        snprintf(id_str, MAX_ID_LEN, "%ld", obj_id); \
-     \
-        gchar *query = g_strconcat("select " \
-                                   _field_name_ \
-                                   " from " \
-                                   _db_table_name_ \
-                                   " where id=", id_str, NULL); \
+        sqlite3_stmt *stmt = prepare_statement(get_db_connection(), \
+                                               "select " _field_name_ " from " _db_table_name_ " where id=?1"); \
+        if (!stmt) return; \
      \
-        double value_double; \
-        char *error_message = NULL; \
-        sqlite3_exec(connection, query, set_double_cb, &value_double, &error_message); \
-        g_free(query); \
+        gint64 value_int = 0; \
+        sqlite3_bind_int64(stmt, 1, obj_id); \
+        gint status = step_statement(stmt, _word_); \
+        if (status < 0) return; \
+        if (status == 1) value_int = sqlite3_column_int64(stmt, 0); \
+        sqlite3_reset(stmt); \
      \
-        if (error_message) { \
-            handle_error(ERR_GENERIC_ERROR); \
-            fprintf(stderr, "-----> Problem executing '" _word_ "'\n----->%s", error_message); \
-        } \
-     \
-        Param *param_new = new_int_param(value_double); \
+        Param *param_new = new_int_param(value_int); \
         push_param(param_new); \
     }
 
 
 #define EC_DB_STR_GETTER(_ec_func_name_, _word_, _db_table_name_, _field_name_) \
     static void _ec_func_name_(gpointer gp_entry) { \
-        sqlite3 *connection = get_db_connection(); \
-     \
         Param *param_obj_id = pop_param(); \
         gint64 obj_id = param_obj_id->val_int; \
         free_param(param_obj_id); \
      \
-        gchar id_str[MAX_ID_LEN]; \
-        snprintf(id_str, MAX_ID_LEN, "%ld", obj_id); \
-     \
-        gchar *query = g_strconcat("select " \
-                                   _field_name_ \
-                                   " from " \
-                                   _db_table_name_ \
-                                   " where id=", id_str, NULL); \
+        sqlite3_stmt *stmt = prepare_statement(get_db_connection(), \
+                                               "select " _field_name_ " from " _db_table_name_ " where id=?1"); \
+        if (!stmt) return; \
      \
-        gchar *value_string; \
-        char *error_message = NULL; \
-        sqlite3_exec(connection, query, set_string_cb, &value_string, &error_message); \
-        g_free(query); \
-     \
-        if (error_message) { \
-            handle_error(ERR_GENERIC_ERROR); \
-            fprintf(stderr, "-----> Problem executing '" _word_ "'\n----->%s", error_message); \
-        } \
+        sqlite3_bind_int64(stmt, 1, obj_id); \
+        gint status = step_statement(stmt, _word_); \
+        if (status < 0) return; \
      \
-        Param *param_new = new_str_param(value_string); \
-        g_free(value_string); \
+        Param *param_new = new_str_param(status == 1 ? column_text(stmt, 0) : ""); \
+        sqlite3_reset(stmt); \
         push_param(param_new); \
     }
 
 
 #define EC_OBJ_FIELD_GETTER(_ec_func_name_, _Type_, _new_param_func_call_) \
     static void _ec_func_name_(gpointer gp_entry) { \
-        const _Type_ *obj = top()->val_custom; \
+        const _Type_ *obj = custom_data(top(), NULL); \
         Param *param_new = _new_param_func_call_; \
         push_param(param_new); \
     }
@@ -0,0 +1,493 @@
+/** \file ec_math.c
+
+\brief Defines the arithmetic, comparison, and stack words.
+
+The arithmetic and comparison words work on ints and doubles in place: a binary
+word like "+" stores its result into the param below the top of the stack and
+drops the top, so none of these words allocate. Each binary word has these
+fast paths:
+
+- int and int: The result is an int
+- double and double, int and double: The result is a double
+
+Comparisons always push an int (1 or 0). The arithmetic words "+", "-", "*",
+and "/" also work elementwise on numeric arrays (see array_arithmetic). Any
+other param is an error.
+
+A binary word whose second operand is a numeric literal (e.g., "2 *") is
+compiled into a single Instruction that works on the top of the stack with the
+literal as its operand (see add_literal_word). The words that can't fail on
+numbers are also pure (see add_pure_word), so "2 3 +" is folded into 5.
+*/
+
+
+/** \brief Computes a binary word in place: a = a op b
+
+Both params are ints or doubles. Returns 0 (after handling the error) if the
+operation fails.
+*/
+typedef gboolean (*binary_op_ptr)(Param *a, const Param *b);
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if a param is an int or a double.
+*/
+// -----------------------------------------------------------------------------
+static gboolean is_number(const Param *param) {
+    return param->type == 'I' || param->type == 'D';
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the value of an int or double param as a double.
+*/
+// -----------------------------------------------------------------------------
+static gdouble to_double(const Param *param) {
+    return param->type == 'I' ? (gdouble) param->val_int : param->val_double;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Handles the error for a param that isn't a number.
+
+\returns 0 if the param isn't a number; 1 otherwise
+*/
+// -----------------------------------------------------------------------------
+static gboolean check_number(const Param *param) {
+    if (is_number(param)) return 1;
+
+    Param copy;
+    copy_param(&copy, param);
+    handle_error(ERR_INVALID_PARAM);
+    print_param(&copy, stderr, "----> ");
+    clear_param(&copy);
+    return 0;
+}
+
+
+
+/** \brief Defines a binary_op_ptr for an arithmetic operator.
+
+Ints wrap around on overflow instead of being undefined.
+*/
+#define ARITHMETIC_OP(_name_, _operator_) \
+static gboolean _name_(Param *a, const Param *b) { \
+    if (a->type == 'I' && b->type == 'I') { \
+        a->val_int = (gint64) ((guint64) a->val_int _operator_ (guint64) b->val_int); \
+    } \
+    else { \
+        a->val_double = to_double(a) _operator_ to_double(b); \
+        a->type = 'D'; \
+    } \
+    return 1; \
+}
+
+ARITHMETIC_OP(op_add, +)
+ARITHMETIC_OP(op_subtract, -)
+ARITHMETIC_OP(op_multiply, *)
+
+
+/** \brief Defines a binary_op_ptr for a comparison operator.
+*/
+#define COMPARISON_OP(_name_, _operator_) \
+static gboolean _name_(Param *a, const Param *b) { \
+    gboolean result = (a->type == 'I' && b->type == 'I') ? a->val_int _operator_ b->val_int : \
+                                                           to_double(a) _operator_ to_double(b); \
+    a->type = 'I'; \
+    a->val_int = result; \
+    return 1; \
+}
+
+COMPARISON_OP(op_equal, ==)
+COMPARISON_OP(op_not_equal, !=)
+COMPARISON_OP(op_less, <)
+COMPARISON_OP(op_greater, >)
+COMPARISON_OP(op_less_equal, <=)
+COMPARISON_OP(op_greater_equal, >=)
+
+
+
+// -----------------------------------------------------------------------------
+/** Handles the error for an int division by zero.
+
+\returns 0 if the divisor is an int 0; 1 otherwise
+*/
+// -----------------------------------------------------------------------------
+static gboolean check_divisor(const Param *a, const Param *b) {
+    if (a->type != 'I' || b->type != 'I' || b->val_int != 0) return 1;
+
+    handle_error(ERR_GENERIC_ERROR);
+    fprintf(stderr, "-----> Division by zero\n");
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Divides a by b (ints are truncated toward zero).
+*/
+// -----------------------------------------------------------------------------
+static gboolean op_divide(Param *a, const Param *b) {
+    if (!check_divisor(a, b)) return 0;
+
+    if (a->type == 'I' && b->type == 'I') {
+        // G_MININT64 / -1 overflows, so negate instead
+        a->val_int = b->val_int == -1 ? (gint64) (0 - (guint64) a->val_int) : a->val_int / b->val_int;
+    }
+    else {
+        a->val_double = to_double(a) / to_double(b);
+        a->type = 'D';
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Computes the remainder of a divided by b (it has the sign of a).
+*/
+// -----------------------------------------------------------------------------
+static gboolean op_mod(Param *a, const Param *b) {
+    if (!check_divisor(a, b)) return 0;
+
+    if (a->type == 'I' && b->type == 'I') {
+        a->val_int = b->val_int == -1 ? 0 : a->val_int % b->val_int;
+    }
+    else {
+        a->val_double = fmod(to_double(a), to_double(b));
+        a->type = 'D';
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Keeps the smaller of a and b (as whichever type it has).
+*/
+// -----------------------------------------------------------------------------
+static gboolean op_min(Param *a, const Param *b) {
+    gboolean is_less = (a->type == 'I' && b->type == 'I') ? b->val_int < a->val_int : to_double(b) < to_double(a);
+    if (is_less) *a = *b;
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Keeps the larger of a and b (as whichever type it has).
+*/
+// -----------------------------------------------------------------------------
+static gboolean op_max(Param *a, const Param *b) {
+    gboolean is_greater = (a->type == 'I' && b->type == 'I') ? b->val_int > a->val_int : to_double(b) > to_double(a);
+    if (is_greater) *a = *b;
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a binary word on the top two params of the stack.
+
+The result replaces the second param and the top is dropped. If either param
+is an array and the word has an array_op, the word is computed elementwise by
+array_arithmetic.
+*/
+// -----------------------------------------------------------------------------
+static void run_binary_op(binary_op_ptr op, gchar array_op) {
+    Param *b = stack_param(0);
+    Param *a = stack_param(1);
+    if (!a) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+    if (array_op && (a->type == 'A' || b->type == 'A')) {
+        if (array_arithmetic(a, b, array_op)) drop_values(1);
+        return;
+    }
+    if (!check_number(a) || !check_number(b)) return;
+
+    if (op(a, b)) drop_values(1);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a binary word on the top of the stack and the literal operand of an
+Instruction (see add_literal_word).
+*/
+// -----------------------------------------------------------------------------
+static void run_literal_op(Instruction *instruction, binary_op_ptr op, gchar array_op) {
+    Param *a = stack_param(0);
+    if (!a) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+    if (array_op && a->type == 'A') {
+        array_arithmetic(a, instruction->operand.param, array_op);
+        return;
+    }
+    if (!check_number(a)) return;
+
+    op(a, instruction->operand.param);
+}
+
+
+
+/** \brief Defines the routine of a binary word and the code of its literal form.
+
+_array_op_ is the operator passed to array_arithmetic (0 if the word doesn't
+work on arrays).
+*/
+#define BINARY_WORD(_name_, _op_, _array_op_) \
+static void EC_##_name_(gpointer gp_entry) { \
+    run_binary_op(_op_, _array_op_); \
+} \
+static void IC_##_name_##_literal(Instruction *instruction) { \
+    run_literal_op(instruction, _op_, _array_op_); \
+}
+
+BINARY_WORD(add, op_add, '+')
+BINARY_WORD(subtract, op_subtract, '-')
+BINARY_WORD(multiply, op_multiply, '*')
+BINARY_WORD(divide, op_divide, '/')
+BINARY_WORD(mod, op_mod, 0)
+BINARY_WORD(min, op_min, 0)
+BINARY_WORD(max, op_max, 0)
+BINARY_WORD(equal, op_equal, 0)
+BINARY_WORD(not_equal, op_not_equal, 0)
+BINARY_WORD(less, op_less, 0)
+BINARY_WORD(greater, op_greater, 0)
+BINARY_WORD(less_equal, op_less_equal, 0)
+BINARY_WORD(greater_equal, op_greater_equal, 0)
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the number on top of the stack so it can be changed in place.
+
+\returns The Param or NULL (after handling the error) if there isn't a number
+*/
+// -----------------------------------------------------------------------------
+static Param *top_number() {
+    Param *result = stack_param(0);
+    if (!result) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return NULL;
+    }
+    return check_number(result) ? result : NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Negates the number on top of the stack.
+*/
+// -----------------------------------------------------------------------------
+static void EC_negate(gpointer gp_entry) {
+    Param *param = top_number();
+    if (!param) return;
+
+    if (param->type == 'I') param->val_int = (gint64) (0 - (guint64) param->val_int);
+    else param->val_double = -param->val_double;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Replaces the number on top of the stack with its absolute value.
+*/
+// -----------------------------------------------------------------------------
+static void EC_abs(gpointer gp_entry) {
+    Param *param = top_number();
+    if (!param) return;
+
+    if (param->type == 'I') {
+        if (param->val_int < 0) param->val_int = (gint64) (0 - (guint64) param->val_int);
+    }
+    else {
+        param->val_double = fabs(param->val_double);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if the stack has at least num_params params; otherwise handles
+the error and returns 0.
+*/
+// -----------------------------------------------------------------------------
+static gboolean check_depth(guint num_params) {
+    if (stack_depth() >= num_params) return 1;
+
+    handle_error(ERR_STACK_UNDERFLOW);
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (a -- a a)
+
+The param is copied before it's pushed because pushing may move the stack.
+*/
+// -----------------------------------------------------------------------------
+static void EC_dup(gpointer gp_entry) {
+    if (!check_depth(1)) return;
+
+    Param param = *stack_param(0);
+    push_value(&param);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (a b -- a b a)
+*/
+// -----------------------------------------------------------------------------
+static void EC_over(gpointer gp_entry) {
+    if (!check_depth(2)) return;
+
+    Param param = *stack_param(1);
+    push_value(&param);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (a b -- b a)
+*/
+// -----------------------------------------------------------------------------
+static void EC_swap(gpointer gp_entry) {
+    if (!check_depth(2)) return;
+
+    Param *b = stack_param(0);
+    Param *a = stack_param(1);
+    Param tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (a b c -- b c a)
+*/
+// -----------------------------------------------------------------------------
+static void EC_rot(gpointer gp_entry) {
+    if (!check_depth(3)) return;
+
+    Param *c = stack_param(0);
+    Param *b = stack_param(1);
+    Param *a = stack_param(2);
+    Param tmp = *a;
+    *a = *b;
+    *b = *c;
+    *c = tmp;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (a b -- b)
+*/
+// -----------------------------------------------------------------------------
+static void EC_nip(gpointer gp_entry) {
+    if (!check_depth(2)) return;
+
+    EC_swap(gp_entry);
+    drop_values(1);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** (a b -- b a b)
+*/
+// -----------------------------------------------------------------------------
+static void EC_tuck(gpointer gp_entry) {
+    if (!check_depth(2)) return;
+
+    EC_swap(gp_entry);
+    EC_over(gp_entry);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Adds a binary word that can also be compiled with a literal operand.
+*/
+// -----------------------------------------------------------------------------
+static void add_binary_word(const gchar *word, routine_ptr routine, instruction_ptr literal_code, gboolean is_pure) {
+    add_entry(word)->routine = routine;
+    add_literal_word(routine, literal_code, word);
+    if (is_pure) add_pure_word(routine, 2, 1, "ID");
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Adds the arithmetic, comparison, and stack words to the dictionary.
+
+### Arithmetic
+- + (a b -- a+b) Adds two numbers (shadowed by the tasks lexicon's "+"; use
+  "forth:+" once it's loaded)
+- - (a b -- a-b) Subtracts two numbers
+- * (a b -- a*b) Multiplies two numbers
+- / (a b -- a/b) Divides two numbers (ints are truncated)
+- mod (a b -- rem) Remainder of a divided by b
+- min (a b -- min) Smaller of two numbers
+- max (a b -- max) Larger of two numbers
+- negate (a -- -a) Negates a number
+- abs (a -- |a|) Absolute value of a number
+
++, -, *, and / also work on numeric arrays: two arrays of the same length are
+combined element by element, and a number is combined with every element.
+
+### Comparisons
+- = (a b -- flag) 1 if a equals b; 0 otherwise
+- <> (a b -- flag) 1 if a doesn't equal b; 0 otherwise
+- < (a b -- flag) 1 if a is less than b; 0 otherwise
+- > (a b -- flag) 1 if a is greater than b; 0 otherwise
+- <= (a b -- flag) 1 if a is less than or equal to b; 0 otherwise
+- >= (a b -- flag) 1 if a is greater than or equal to b; 0 otherwise
+
+### Stack shuffling
+- dup (a -- a a) Duplicates the top of the stack
+- over (a b -- a b a) Copies the second param to the top
+- swap (a b -- b a) Swaps the top two params
+- rot (a b c -- b c a) Rotates the third param to the top
+- nip (a b -- b) Drops the second param
+- tuck (a b -- b a b) Copies the top below the second param
+*/
+// -----------------------------------------------------------------------------
+void add_math_words() {
+    add_binary_word("+", EC_add, IC_add_literal, 1);
+    add_binary_word("-", EC_subtract, IC_subtract_literal, 1);
+    add_binary_word("*", EC_multiply, IC_multiply_literal, 1);
+    add_binary_word("/", EC_divide, IC_divide_literal, 0);
+    add_binary_word("mod", EC_mod, IC_mod_literal, 0);
+    add_binary_word("min", EC_min, IC_min_literal, 1);
+    add_binary_word("max", EC_max, IC_max_literal, 1);
+
+    add_entry("negate")->routine = EC_negate;
+    add_pure_word(EC_negate, 1, 1, "ID");
+    add_entry("abs")->routine = EC_abs;
+    add_pure_word(EC_abs, 1, 1, "ID");
+
+    add_binary_word("=", EC_equal, IC_equal_literal, 1);
+    add_binary_word("<>", EC_not_equal, IC_not_equal_literal, 1);
+    add_binary_word("<", EC_less, IC_less_literal, 1);
+    add_binary_word(">", EC_greater, IC_greater_literal, 1);
+    add_binary_word("<=", EC_less_equal, IC_less_equal_literal, 1);
+    add_binary_word(">=", EC_greater_equal, IC_greater_equal_literal, 1);
+
+    add_entry("dup")->routine = EC_dup;
+    add_entry("over")->routine = EC_over;
+    add_entry("swap")->routine = EC_swap;
+    add_entry("rot")->routine = EC_rot;
+    add_entry("nip")->routine = EC_nip;
+    add_entry("tuck")->routine = EC_tuck;
+}
@@ -0,0 +1,6 @@
+/** \file ec_math.h
+*/
+
+#pragma once
+
+void add_math_words();
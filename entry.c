@@ -22,74 +22,107 @@ void execute(gpointer gp_entry) {
 
 
 // -----------------------------------------------------------------------------
-/** Compiles a token into the latest Entry's definition.
+/** Compiles a literal into an Entry's definition.
+
+\param entry: Entry being compiled
+\param type: Token type of the literal ('I', 'D', or 'S')
+\param text: Text of the literal (strings include their quotes)
 */
 // -----------------------------------------------------------------------------
-void compile(Token token) {
-    Entry *entry;
-    Entry *entry_latest = latest_entry();
+void compile_literal(Entry *entry, gchar type, const gchar *text) {
     Param *param;
     Entry *pseudo_entry;
     Param *param_literal;
     gchar *val_string = NULL;
 
-    switch(token.type) {
-        case 'W':
-            entry = find_entry(token.word);
-            if (!entry) {
-                handle_error(ERR_UNKNOWN_WORD);
-                fprintf(stderr, "-----> %s\n", token.word);
-                return;
-            }
-            else if(entry->immediate) {
-                execute(entry);
-            }
-            else {
-                param = new_entry_param(entry);
-                add_entry_param(entry_latest, param);
-            }
-            break;
-
+    switch(type) {
         case 'I':
             // Create pseudo entry that pushes an int onto the stack
             param = new_pseudo_entry_param("push-literal-I", EC_push_param0);
-            pseudo_entry = &param->val_pseudo_entry;
-            param_literal = new_int_param(g_ascii_strtoll(token.word, NULL, 10));
+            pseudo_entry = param->val_pseudo_entry;
+            param_literal = new_int_param(g_ascii_strtoll(text, NULL, 10));
             add_entry_param(pseudo_entry, param_literal);
 
-            add_entry_param(entry_latest, param);
+            add_entry_param(entry, param);
             break;
 
         case 'D':
             // Create pseudo entry that pushes a double onto the stack
             param = new_pseudo_entry_param("push-literal-D", EC_push_param0);
-            pseudo_entry = &param->val_pseudo_entry;
-            param_literal = new_double_param(g_ascii_strtod(token.word, NULL));
+            pseudo_entry = param->val_pseudo_entry;
+            param_literal = new_double_param(g_ascii_strtod(text, NULL));
             add_entry_param(pseudo_entry, param_literal);
 
-            add_entry_param(entry_latest, param);
+            add_entry_param(entry, param);
             break;
 
         case 'S':
             // Create pseudo entry that pushes a string onto the stack
             param = new_pseudo_entry_param("push-literal-S", EC_push_param0);
-            pseudo_entry = &param->val_pseudo_entry;
+            pseudo_entry = param->val_pseudo_entry;
 
-            // Start copying yyext after first '"'...
-            val_string =  g_strdup(yytext+1);
+            // Start copying text after first '"'...
+            val_string =  g_strdup(text+1);
 
             // ...and NUL out second '"'
-            val_string[yyleng-2] = '\0';
+            val_string[strlen(val_string)-1] = '\0';
 
             param_literal = new_str_param(val_string);
             g_free(val_string);
             add_entry_param(pseudo_entry, param_literal);
 
-            add_entry_param(entry_latest, param);
+            add_entry_param(entry, param);
+            break;
+
+        default:
+            printf("TODO: Handle token type: %c\n", type);
+            break;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compiles a token into the Entry being defined (see compile_target).
+*/
+// -----------------------------------------------------------------------------
+void compile(Token token) {
+    Entry *entry;
+    Entry *entry_target = compile_target();
+    Param *param;
+    gint local;
+
+    switch(token.type) {
+        case 'W':
+            // Locals hide words with the same name
+            local = find_local(token.word);
+            if (local >= 0) {
+                compile_local("local@", EC_fetch_local, local);
+                break;
+            }
+
+            entry = find_entry(token.word);
+            if (!entry) {
+                handle_error(ERR_UNKNOWN_WORD);
+                fprintf(stderr, "-----> %s\n", token.word);
+                return;
+            }
+            else if(entry->immediate) {
+                execute(entry);
+            }
+            else {
+                param = new_entry_param(entry);
+                add_entry_param(entry_target, param);
+            }
+            break;
+
+        case 'S':
+            // The token's word may be truncated, so use the full text
+            compile_literal(entry_target, 'S', yytext);
             break;
 
         default:
-            printf("TODO: Handle token type: %c\n", token.type);
+            compile_literal(entry_target, token.type, token.word);
             break;
     }
 }
@@ -107,10 +140,16 @@ can be considered managed by that entry.
 */
 // -----------------------------------------------------------------------------
 Entry *new_entry() {
-    Entry *result = g_new(Entry, 1);
+    Entry *result = pool_alloc(&_entry_pool);
     result->immediate = 0;
     result->complete = 1;
+    result->interpret_only = 0;
     result->params = g_sequence_new(free_param);
+    result->wordlist = NULL;
+    result->shadowed = NULL;
+    result->code = NULL;
+    result->code_params = NULL;
+    result->value = NULL;
     return result;
 }
 
@@ -122,10 +161,13 @@ Entry *new_entry() {
 \param entry: Entry to add parameter to
 \param param: Param to add
 
-\note The param should be dynamically allocated because the Entry will free it.
+\note The param should be allocated with new_param (or one of the new_*_param
+      functions) because the Entry will free it. The param is adopted so that
+      it isn't released along with transient Params after an error.
 */
 // -----------------------------------------------------------------------------
 void add_entry_param(Entry *entry, Param *param) {
+    pool_adopt(param);
     g_sequence_append(entry->params, param);
 }
 
@@ -140,5 +182,7 @@ void add_entry_param(Entry *entry, Param *param) {
 void free_entry(gpointer gp_entry) {
     Entry *entry = gp_entry;
     g_sequence_free(entry->params);
-    g_free(gp_entry);
+    g_free(entry->code);
+    if (entry->code_params) g_ptr_array_free(entry->code_params, TRUE);
+    pool_free(&_entry_pool, entry);
 }
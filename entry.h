@@ -8,5 +8,6 @@
 Entry *new_entry();
 void add_entry_param(Entry *entry, Param *param);
 void execute(gpointer entry);
+void compile_literal(Entry *entry, gchar type, const gchar *text);
 void compile(Token token);
 void free_entry(gpointer entry);
@@ -74,75 +74,112 @@ static void free_note(gpointer gp_note) {
 
 
 // -----------------------------------------------------------------------------
-/** Gets a database connection from the "notes-db" variable.
+/** Copies a GSequence of Notes (see note_sequence_type).
 */
 // -----------------------------------------------------------------------------
-static sqlite3 *get_db_connection() {
-    execute_string("notes-db @");
-    Param *param_connection = pop_param();
+static gpointer clone_note_sequence(gconstpointer data) {
+    GSequence *seq = (GSequence *) data;
+    GSequence *result = g_sequence_new(free_note);
 
-    sqlite3 *result = param_connection->val_custom;
+    for (GSequenceIter *iter = g_sequence_get_begin_iter(seq);
+         !g_sequence_iter_is_end(iter);
+         iter = g_sequence_iter_next(iter)) {
 
-    free_param(param_connection);
+        g_sequence_append(result, copy_note(g_sequence_get(iter)));
+    }
     return result;
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Callback used to write note records from an SQL query into a sequence of records.
+/** Gets a Note in a GSequence of Notes as a 'C' param (see note_sequence_type).
 */
 // -----------------------------------------------------------------------------
-static int append_note_cb(gpointer gp_records, int num_cols, char **values, char **cols) {
-    GSequence *records = gp_records;
-    if (num_cols != 5) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Unexpected num cols from note query\n");
-        return 1;
-    }
-    gint64 id = g_ascii_strtoll(values[0], NULL, 10);
-    const gchar *type_text = values[1];
-    const gchar *note_text = values[2];
-    const gchar *timestamp_text = values[3];
-    const gchar *date_text = values[4];
+static void get_note_element(gconstpointer data, guint index, Param *dst) {
+    GSequence *seq = (GSequence *) data;
+
+    dst->type = 'C';
+    dst->val_custom = g_sequence_get(g_sequence_get_iter_at_pos(seq, index));
+    dst->val_custom_comment = g_intern_string("Note");
+}
+
 
-    Note *note_new = new_note(id, type_text[0], note_text, timestamp_text, date_text);
 
-    g_sequence_append(records, note_new);
-    return 0;
+/** \brief Type of the objects holding a GSequence of Notes
+*/
+static const ObjectType note_sequence_type = {
+    .name = "[notes]",
+    .free = (GDestroyNotify) g_sequence_free,
+    .clone = clone_note_sequence,
+    .length = sequence_length,
+    .get_element = get_note_element,
+    .is_sequence = 1
+};
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets a database connection from the "notes-db" variable.
+*/
+// -----------------------------------------------------------------------------
+static sqlite3 *get_db_connection() {
+    const Param *value = variable_value(&_notes_db_ref);
+    if (!value) return NULL;
+    return value->val_custom;
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Returns a GSequence of notes matching the conditions.
+/** Appends the Notes from the rows of a statement to a sequence.
 
-\note The caller is responsible for freeing the returned GSequence.
+The statement must select id, type, note, timestamp, and date (in that order).
+
+\returns 1 on success; 0 if the error has been handled
 */
 // -----------------------------------------------------------------------------
-static GSequence *select_notes(const gchar *sql_conditions) {
-    sqlite3 *connection = get_db_connection();
+static gboolean append_notes(sqlite3_stmt *stmt, GSequence *records) {
+    gint status;
+    while ((status = step_statement(stmt, "select_notes")) == 1) {
+        gint64 id = sqlite3_column_int64(stmt, 0);
+        const gchar *type_text = column_text(stmt, 1);
+        const gchar *note_text = column_text(stmt, 2);
+        const gchar *timestamp_text = column_text(stmt, 3);
+        const gchar *date_text = column_text(stmt, 4);
 
-    gchar *select = "select id, type, note, timestamp, date from notes ";
-    gchar *query = g_strconcat(select, sql_conditions, NULL);
+        Note *note_new = new_note(id, type_text[0], note_text, timestamp_text, date_text);
 
+        g_sequence_append(records, note_new);
+    }
+    return status == 0;
+}
 
-    GSequence *result = g_sequence_new(free_note);
 
-    char *error_message = NULL;
-    sqlite3_exec(connection, query, append_note_cb, result, &error_message);
 
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem executing 'select_notes'\n----->%s", error_message);
+// -----------------------------------------------------------------------------
+/** Returns a GSequence of notes matching the conditions.
 
-        g_free(result);
+\param sql_conditions: Conditions (and ordering) of the query, which may refer to "?1"
+\param arg: Value bound to ?1 (NULL if the conditions don't have one)
+
+\note The caller is responsible for freeing the returned GSequence.
+*/
+// -----------------------------------------------------------------------------
+static GSequence *select_notes(const gchar *sql_conditions, const Param *arg) {
+    gchar *select = "select id, type, note, timestamp, date from notes ";
+    gchar *query = arena_strconcat(select, sql_conditions, NULL);
+
+    sqlite3_stmt *stmt = prepare_statement(get_db_connection(), query);
+    if (!stmt) return NULL;
+    if (arg && !bind_param(stmt, 1, arg)) return NULL;
+
+    GSequence *result = g_sequence_new(free_note);
+    if (!append_notes(stmt, result)) {
+        g_sequence_free(result);
         result = NULL;
     }
 
-    // Cleanup
-    g_free(query);
-
     return result;
 }
 
@@ -153,26 +190,21 @@ static GSequence *select_notes(const gchar *sql_conditions) {
 */
 // -----------------------------------------------------------------------------
 static void store_note(const gchar *type) {
-    Param *param_note = pop_param();
-
-    sqlite3 *connection = get_db_connection();
-
-    char* error_message = NULL;
-    gchar *sql = g_strconcat("insert into notes(note, type, timestamp, date)",
-                             "values(\"", param_note->val_string, "\", ",
-                             "'", type, "', ",
-                             "datetime('now', 'localtime'), date('now', 'localtime'))",
-                             NULL);
-
-    sqlite3_exec(connection, sql, NULL, NULL, &error_message);
+    Param param_note;
+    if (!pop_value(&param_note)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
 
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem storing '%s' note ==> %s\n", type, error_message);
+    sqlite3_stmt *stmt = prepare_statement(get_db_connection(),
+                                           "insert into notes(note, type, timestamp, date) "
+                                           "values(?1, ?2, datetime('now', 'localtime'), date('now', 'localtime'))");
+    if (stmt && bind_param(stmt, 1, &param_note)) {
+        sqlite3_bind_text(stmt, 2, type, -1, SQLITE_STATIC);
+        step_statement(stmt, "store_note");
     }
 
-    free_param(param_note);
-    g_free(sql);
+    clear_param(&param_note);
 }
 
 
@@ -262,9 +294,8 @@ static void write_elapsed_minutes(gchar *dst, gint64 len, Note *note_l, Note *no
 */
 // -----------------------------------------------------------------------------
 static void EC_today_notes(gpointer gp_entry) {
-    GSequence *records = select_notes("where date = date('now', 'localtime')");
-    Param *param_new = new_custom_param(records, "GSequence of Note");
-    push_param(param_new);
+    GSequence *records = select_notes("where date = date('now', 'localtime')", NULL);
+    if (records) push_object(&note_sequence_type, records);
 }
 
 
@@ -274,7 +305,7 @@ static void EC_today_notes(gpointer gp_entry) {
 */
 // -----------------------------------------------------------------------------
 static Note *get_latest_S_note() {
-    GSequence *records = select_notes("where type = 'S' order by id desc limit 1");
+    GSequence *records = select_notes("where type = 'S' order by id desc limit 1", NULL);
 
     Note *result = NULL;
     if (g_sequence_get_length(records) == 1) {
@@ -294,7 +325,7 @@ static Note *get_latest_S_note() {
 */
 // -----------------------------------------------------------------------------
 static Note *get_latest_SE_note() {
-    GSequence *records = select_notes("where type = 'S' or type = 'E' order by id desc limit 1");
+    GSequence *records = select_notes("where type = 'S' or type = 'E' order by id desc limit 1", NULL);
 
     Note *result = NULL;
     if (g_sequence_get_length(records) == 1) {
@@ -337,8 +368,6 @@ static void EC_time(gpointer gp_entry) {
 // -----------------------------------------------------------------------------
 static void EC_chunk_notes(gpointer gp_entry) {
     GSequence *records = NULL;
-    const int CONDITION_LEN = 128;
-    gchar sql_condition[CONDITION_LEN];
 
     Note *note = get_latest_S_note();
 
@@ -347,12 +376,11 @@ static void EC_chunk_notes(gpointer gp_entry) {
         records = g_sequence_new(free_note);
     }
     else {
-        snprintf(sql_condition, CONDITION_LEN, "where id >= %ld", note->id);
-        records = select_notes(sql_condition);
+        Param arg = {.type = 'I', .val_int = note->id};
+        records = select_notes("where id >= ?1", &arg);
         free_note(note);
     }
-    Param *param_new = new_custom_param(records, "GSequence of Notes");
-    push_param(param_new);
+    if (records) push_object(&note_sequence_type, records);
 }
 
 
@@ -363,8 +391,9 @@ static void EC_chunk_notes(gpointer gp_entry) {
 // -----------------------------------------------------------------------------
 static void EC_print(gpointer gp_entry) {
     // Pop Note sequence
-    Param *param_note_sequence = pop_param();
-    GSequence *records = param_note_sequence->val_custom;
+    Param param_note_sequence;
+    GSequence *records = pop_object(&param_note_sequence, &note_sequence_type);
+    if (!records) return;
 
     // Print each note
     Note *current_start_note = NULL;
@@ -404,8 +433,7 @@ static void EC_print(gpointer gp_entry) {
     }
 
     // Cleanup
-    g_sequence_free(records);
-    free_param(param_note_sequence);
+    clear_param(&param_note_sequence);
 }
 
 
@@ -413,62 +441,48 @@ static void EC_print(gpointer gp_entry) {
 // -----------------------------------------------------------------------------
 /** Pops an Array of int note IDs from the stack and converts them into Notes.
 
-We want to convert the Array of gint64 into a string like this: "(1,2,3,4)". If
-we assume the maximum number of digits for each ID is MAX_ID_LEN, then the size of this
-string should be:
-
-    MAX_ID_LEN*n +   # digits
-    (n-1) +  # commas
-    2        # parens
-    1        # NUL
-
-We'll allocate a string, start at the beginning, and snprintf the numbers into
-it as we go along. We'll put parens and commas as needed and then end with the NUL.
-When this works, we should move it into the sqlite lexicon.
+The IDs are bound to the query as one JSON array (e.g., "[3,5,8]") and
+expanded with json_each, so the SQL doesn't change with the IDs and the same
+prepared statement is used for any number of them. Each Note is selected once
+(even if its ID is repeated), in order of ID.
 */
 // -----------------------------------------------------------------------------
 static void EC_note_ids_to_notes(gpointer gp_entry) {
-    Param *param_note_ids = pop_param();
-    GArray *note_ids = param_note_ids->val_custom;
+    Param param_note_ids;
+    if (!pop_value(&param_note_ids)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+    if (param_note_ids.type != 'A' || param_note_ids.val_array->type != 'I') {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&param_note_ids, stderr, "----> ");
+        clear_param(&param_note_ids);
+        return;
+    }
+    const Array *note_ids = param_note_ids.val_array;
 
     GSequence *notes = NULL;
     if (note_ids->len == 0) {
         notes = g_sequence_new(free_note);
-        goto done;
     }
+    else {
+        GString *id_list = g_string_sized_new(MAX_ID_LEN*note_ids->len + 2);
+        g_string_append_c(id_list, '[');
+        for (guint i=0; i < note_ids->len; i++) {
+            if (i > 0) g_string_append_c(id_list, ',');
+            g_string_append_printf(id_list, "%ld", note_ids->ints[i]);
+        }
+        g_string_append_c(id_list, ']');
 
-    guint num_bytes = MAX_ID_LEN*note_ids->len + (note_ids->len - 1) + 2 + 1;
-    gchar *id_list = g_malloc0(num_bytes);
-    guint cur_pos = 0;
-
-    // Build up list
-    id_list[cur_pos++] = '(';
-    for (guint i=0; i < note_ids->len; i++) {
-       gint64 note_id = g_array_index(note_ids, gint64, i);
-       guint num_digits = snprintf(id_list + cur_pos, MAX_ID_LEN, "%ld", note_id);
-       cur_pos += num_digits;
-       id_list[cur_pos++] = ',';
+        // Only bound, never released, so this doesn't need to be a GRefString
+        Param arg = {.type = 'S', .val_string = id_list->str};
+        notes = select_notes("where id in (select value from json_each(?1)) order by id", &arg);
+        g_string_free(id_list, TRUE);
     }
 
-    // Change the last ',' to a closing paren
-    id_list[cur_pos-1] = ')';
-    id_list[cur_pos++] = 0;
-
-
-    // Select notes
-    gchar *sql_condition = g_strconcat("where id in ", id_list, NULL);
-    notes = select_notes(sql_condition);
-    g_free(sql_condition);
-    g_free(id_list);
-
-    Param *param_new = NULL;
+    if (notes) push_object(&note_sequence_type, notes);
 
-done:
-    param_new = new_custom_param(notes, "[notes]");
-    push_param(param_new);
-
-    g_array_free(note_ids, TRUE);
-    free_param(param_note_ids);
+    clear_param(&param_note_ids);
 }
 
 
@@ -476,7 +490,7 @@ done:
 // -----------------------------------------------------------------------------
 /** Defines the notes lexicon
 
-The following words are defined for manipulating notes:
+The following words are defined for manipulating notes (in the "notes" wordlist):
 
 - notes-db: This holds the sqlite database connection for notes
 
@@ -490,7 +504,7 @@ The following words are defined for manipulating notes:
 - today-notes ( -- [notes from today])
 - chunk-notes ( -- [notes from current chunk])
 - print-notes ([notes] -- ) Prints notes
-- note_ids-to-notes (Array[note ids] -- [notes])
+- note_ids-to-notes (array[note ids] -- [notes])
 
 */
 // -----------------------------------------------------------------------------
@@ -498,7 +512,10 @@ void EC_add_notes_lexicon(gpointer gp_entry) {
     // Add the lexicons that this depends on
     execute_string("lex-sqlite");
 
+    Wordlist *previous = set_current_wordlist(add_wordlist("notes"));
+
     add_variable("notes-db");
+    init_variable_ref(&_notes_db_ref, "notes-db");
 
     add_entry("S")->routine = EC_start_chunk;
     add_entry("M")->routine = EC_middle_chunk;
@@ -509,4 +526,6 @@ void EC_add_notes_lexicon(gpointer gp_entry) {
     add_entry("chunk-notes")->routine = EC_chunk_notes;
     add_entry("print-notes")->routine = EC_print;
     add_entry("note_ids-to-notes")->routine = EC_note_ids_to_notes;
+
+    set_current_wordlist(previous);
 }
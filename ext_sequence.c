@@ -2,102 +2,487 @@
 
 \brief Defines words for operating on sequences
 
+A sequence is an object whose data is a GSequence (see ObjectType.is_sequence),
+like the sequences of Tasks and Notes pushed by the tasks and notes lexicons.
+
+Sorting gets the key of each item once, sorts the keys, and then reorders the
+items (see sort_sequence). top-n and bottom-n get the keys the same way but only
+select the first N with a bounded heap (see select_from_sequence).
 */
 
 
 // -----------------------------------------------------------------------------
-/** Helper function to get the value of an object given a word that can extract it.
+/** Returns the number of items in a GSequence (for the length of an ObjectType).
+*/
+// -----------------------------------------------------------------------------
+guint sequence_length(gconstpointer data) {
+    return g_sequence_get_length((GSequence *) data);
+}
+
 
-This pushes the object onto the stack and then executes the word. It then
-pops the value and the object and returns the value.
 
-TODO: Fix 'execute' so it manages the return stack
+/** \brief The sort key of an item of a sequence (see extract_sort_keys)
 */
+typedef struct {
+    GSequenceIter *iter;        /**< \brief Item of the sequence */
+    guint index;                /**< \brief Position of the item before sorting (keeps sorts stable) */
+    guint64 radix;              /**< \brief Numeric key as an unsigned int that sorts the same way */
+    Param key;                  /**< \brief Value of the sort word for the item ('I', 'D', or 'S') */
+} SortKey;
+
+
+
 // -----------------------------------------------------------------------------
-static Param *get_sort_value(gconstpointer const_obj, Entry *sort_entry) {
-    gpointer obj = (gpointer) const_obj;
+/** Gets the sort key of an item of a sequence.
+
+\param element: The item (as returned by the get_element of its ObjectType)
+\param sort_entry: Word that pushes the key (obj -- obj key)
+\param dst: Receives the key
+\returns 1 on success; 0 if the error has been handled
 
-    push_param(new_custom_param(obj, "?"));    // (obj)
-    execute(sort_entry);                       // (obj val)
-    Param *result = pop_param();               // (obj)
-    free_param(pop_param());                   // ()
-    return result;
+If the sort word is a native field getter for the item (see add_field_getter),
+the field is read directly. Otherwise, the word is run on the item. Since
+execute runs a definition to completion before returning, the sort word may be
+a definition.
+*/
+// -----------------------------------------------------------------------------
+static gboolean get_sort_key(const Param *element, Entry *sort_entry, Param *dst) {
+    if (get_field(sort_entry->routine, element, dst)) return 1;
+
+    guint depth = stack_depth();
+    push_value(element);                       // (obj)
+    execute(sort_entry);                       // (obj key)
+    if (_release_transients) return 0;
+
+    if (stack_depth() != depth + 2) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> '%s' must push a key and leave the object\n", sort_entry->word);
+        return 0;
+    }
+    pop_value(dst);                            // (obj)
+    drop_values(1);                            // ()
+    return 1;
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Comparator for generic objects using a sort word (ascending order)
+/** Releases the keys made by extract_sort_keys.
 */
 // -----------------------------------------------------------------------------
-static gint sort_sequence_asc_cmp(gconstpointer l, gconstpointer r, gpointer gp_sort_entry) {
-    Entry *sort_entry = gp_sort_entry;
-    Param *param_l_val = get_sort_value(l, sort_entry);
-    Param *param_r_val = get_sort_value(r, sort_entry);
+static void free_sort_keys(SortKey *keys, guint len) {
+    for (guint i=0; i < len; i++) clear_param(&keys[i].key);
+    g_free(keys);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets the sort key of each item of a sequence object once.
 
-    gint result = 0;
+\param object: Object whose data is a GSequence
+\param sort_entry: Word that pushes the key of an item (obj -- obj key)
+\param keys: Receives the keys in sequence order (free with free_sort_keys)
+\param len: Receives the number of keys
+\returns 1 on success; 0 if the error has been handled
 
-    if (param_l_val->type == 'I') {
-        result = param_l_val->val_int - param_r_val->val_int;
+The keys must all be numbers or all be strings. Numeric keys also get a radix
+key (if any key is a double, they're all compared as doubles).
+*/
+// -----------------------------------------------------------------------------
+static gboolean extract_sort_keys(const Object *object, Entry *sort_entry, SortKey **keys, guint *len) {
+    GSequence *seq = object->data;
+    *len = g_sequence_get_length(seq);
+    SortKey *result = g_new(SortKey, *len);
+    *keys = NULL;
+
+    GSequenceIter *iter = g_sequence_get_begin_iter(seq);
+    for (guint i=0; i < *len; i++, iter = g_sequence_iter_next(iter)) {
+        Param element;
+        object->type->get_element(seq, i, &element);
+        gboolean is_ok = get_sort_key(&element, sort_entry, &result[i].key);
+        clear_param(&element);
+
+        if (!is_ok) {
+            free_sort_keys(result, i);
+            return 0;
+        }
+        result[i].iter = iter;
+        result[i].index = i;
     }
-    else if (param_l_val->type == 'D') {
-        result = param_l_val->val_double - param_r_val->val_double;
+
+    // The keys must all be strings or all be numbers
+    gboolean is_string = *len > 0 && result[0].key.type == 'S';
+    gboolean has_doubles = 0;
+    for (guint i=0; i < *len; i++) {
+        gchar type = result[i].key.type;
+        if (is_string ? type != 'S' : type != 'I' && type != 'D') {
+            Param copy;
+            copy_param(&copy, &result[i].key);
+            free_sort_keys(result, *len);
+            handle_error(ERR_INVALID_PARAM);
+            print_param(&copy, stderr, "----> ");
+            fprintf(stderr, "-----> Sort keys must all be numbers or all be strings\n");
+            clear_param(&copy);
+            return 0;
+        }
+        if (type == 'D') has_doubles = 1;
     }
-    else if (param_l_val->type == 'S') {
-        result = g_strcmp0(param_l_val->val_string, param_r_val->val_string);    
+
+    *keys = result;
+    if (is_string) return 1;
+
+    for (guint i=0; i < *len; i++) {
+        const Param *key = &result[i].key;
+        if (!has_doubles) {
+            result[i].radix = (guint64) key->val_int ^ G_GUINT64_CONSTANT(0x8000000000000000);
+            continue;
+        }
+
+        // Flip all the bits of a negative double and just the sign bit of a positive one
+        gdouble value = key->type == 'I' ? (gdouble) key->val_int : key->val_double;
+        guint64 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        result[i].radix = (bits >> 63) ? ~bits : bits ^ G_GUINT64_CONSTANT(0x8000000000000000);
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Sorts keys by their radix keys with a stable LSD radix sort (a byte at a time).
+
+\param is_descending: 1 to sort largest first (equal keys keep their order)
+*/
+// -----------------------------------------------------------------------------
+static void radix_sort_keys(SortKey *keys, guint len, gboolean is_descending) {
+    if (is_descending) {
+        for (guint i=0; i < len; i++) keys[i].radix = ~keys[i].radix;
+    }
+
+    SortKey *buffer = g_new(SortKey, len);
+    SortKey *src = keys;
+    SortKey *dst = buffer;
+
+    for (guint shift=0; shift < 64; shift += 8) {
+        guint counts[256] = {0};
+        for (guint i=0; i < len; i++) counts[(src[i].radix >> shift) & 0xff]++;
+
+        // Skip bytes that are the same for every key
+        if (len == 0 || counts[(src[0].radix >> shift) & 0xff] == len) continue;
+
+        guint offset = 0;
+        for (guint b=0; b < 256; b++) {
+            guint count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+        for (guint i=0; i < len; i++) dst[counts[(src[i].radix >> shift) & 0xff]++] = src[i];
+
+        SortKey *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != keys) memcpy(keys, src, sizeof(SortKey) * len);
+    g_free(buffer);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compares string sort keys in ascending order (see sort_keys)
+*/
+// -----------------------------------------------------------------------------
+static int compare_string_keys_asc(const void *l, const void *r) {
+    const SortKey *l_key = l;
+    const SortKey *r_key = r;
+    int result = g_strcmp0(l_key->key.val_string, r_key->key.val_string);
+    if (result) return result;
+    return l_key->index < r_key->index ? -1 : l_key->index > r_key->index;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compares string sort keys in descending order (see sort_keys)
+*/
+// -----------------------------------------------------------------------------
+static int compare_string_keys_desc(const void *l, const void *r) {
+    const SortKey *l_key = l;
+    const SortKey *r_key = r;
+    int result = g_strcmp0(r_key->key.val_string, l_key->key.val_string);
+    if (result) return result;
+    return l_key->index < r_key->index ? -1 : l_key->index > r_key->index;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Sorts keys made by extract_sort_keys (stably).
+
+Numeric keys are radix sorted. String keys are sorted with qsort, using the
+original positions to break ties.
+*/
+// -----------------------------------------------------------------------------
+static void sort_keys(SortKey *keys, guint len, gboolean is_descending) {
+    if (len > 0 && keys[0].key.type == 'S') {
+        qsort(keys, len, sizeof(SortKey), is_descending ? compare_string_keys_desc : compare_string_keys_asc);
     }
     else {
-        fprintf(stderr, "Don't know how to compare '%c'\n", param_l_val->type);
+        radix_sort_keys(keys, len, is_descending);
     }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if key l comes before key r in the order of a sort.
 
-    free_param(param_l_val);
-    free_param(param_r_val);
-    return result;
+Equal keys keep their original order, as they do in sort_keys.
+*/
+// -----------------------------------------------------------------------------
+static gboolean key_precedes(const SortKey *l, const SortKey *r, gboolean is_descending) {
+    gint result = l->key.type == 'S' ? g_strcmp0(l->key.val_string, r->key.val_string) :
+                                       (l->radix > r->radix) - (l->radix < r->radix);
+    if (is_descending) result = -result;
+    if (result) return result < 0;
+    return l->index < r->index;
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Comparator for generic objects using a sort word (descending order)
+/** Moves heap[i] down until neither of its children comes after it.
+
+The root of the heap is the key that comes last in the sort order.
 */
 // -----------------------------------------------------------------------------
-static gint sort_sequence_desc_cmp(gconstpointer l, gconstpointer r, gpointer gp_sort_entry) {
-    return -sort_sequence_asc_cmp(l, r, gp_sort_entry);
+static void sift_down(SortKey **heap, guint len, guint i, gboolean is_descending) {
+    while (1) {
+        guint last = i;
+        guint left = 2*i + 1;
+        guint right = left + 1;
+        if (left < len && key_precedes(heap[last], heap[left], is_descending)) last = left;
+        if (right < len && key_precedes(heap[last], heap[right], is_descending)) last = right;
+        if (last == i) return;
+
+        SortKey *tmp = heap[i];
+        heap[i] = heap[last];
+        heap[last] = tmp;
+        i = last;
+    }
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Sorts a sequence using a word that gets the value from an object
+/** Selects the first n keys in sort order with a bounded heap.
 
-(seq sort-word -- seq)
+\param heap: Receives pointers to the selected keys, in sort order (room for n)
+
+\returns The number of keys selected (the smaller of n and len)
+
+This is O(len log n): each key is compared against the last of the keys
+selected so far and only replaces it if it comes earlier.
 */
-// ----------------------------------------------------------------------------
-static void sort_sequence(GCompareDataFunc cmp_func) {
-    // Pop the sort word
-    Param *param_word = pop_param();
+// -----------------------------------------------------------------------------
+static guint select_keys(SortKey *keys, guint len, guint n, gboolean is_descending, SortKey **heap) {
+    guint size = MIN(n, len);
+    if (size == 0) return 0;
+
+    for (guint i=0; i < size; i++) heap[i] = &keys[i];
+    for (guint i=size/2; i > 0; i--) sift_down(heap, size, i-1, is_descending);
+
+    for (guint i=size; i < len; i++) {
+        if (!key_precedes(&keys[i], heap[0], is_descending)) continue;
+        heap[0] = &keys[i];
+        sift_down(heap, size, 0, is_descending);
+    }
+
+    // Put the selected keys in order by repeatedly moving the last one to the end
+    for (guint end=size; end > 1; end--) {
+        SortKey *tmp = heap[0];
+        heap[0] = heap[end-1];
+        heap[end-1] = tmp;
+        sift_down(heap, end-1, 0, is_descending);
+    }
+    return size;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a sequence and looks up the word to sort it by.
 
+(seq -- )
+
+\param param_word: Name of the sort word (already popped)
+\param param_seq: Receives the sequence (an 'O' param)
+\param entry: Receives the sort word's Entry
+
+\returns 1 on success; 0 if the error has been handled
+*/
+// -----------------------------------------------------------------------------
+static gboolean pop_sort_args(const Param *param_word, Param *param_seq, Entry **entry) {
     // Pop the sequence
-    Param *param_seq = pop_param();
-    GSequence *sequence = param_seq->val_custom;
+    if (!pop_object(param_seq, NULL)) return 0;
+
+    if (!param_seq->val_object->type->is_sequence) {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(param_seq, stderr, "----> ");
+        fprintf(stderr, "----> Unable to sort this\n");
+        clear_param(param_seq);
+        return 0;
+    }
 
     // Get the word to sort by
-    Entry *entry = find_entry(param_word->val_string); 
+    *entry = param_word->type == 'S' ? find_entry(param_word->val_string) : NULL;
 
-    if (!entry) {
+    if (!*entry) {
         handle_error(ERR_UNKNOWN_WORD);
-        fprintf(stderr, "----> %s\n", param_word->val_string);
+        print_param(param_word, stderr, "----> ");
         fprintf(stderr, "----> Unable to sort by this\n");
-        free_param(param_seq);
-        goto done;
+        clear_param(param_seq);
+        return 0;
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Sorts a sequence using a word that gets the value from an object
+
+(seq -- seq)
+
+\param param_word: Name of the sort word (e.g., the literal of
+                   "task_value" descending; see add_operand_form)
+
+This decorates each item with its key (see extract_sort_keys), sorts the keys,
+and then moves the items into the sorted order. The sort word is run at most
+once per item rather than twice per comparison.
+
+If other params share the sequence, it's copied before it's sorted (see
+unshare_object).
+*/
+// ----------------------------------------------------------------------------
+static void sort_sequence_by(const Param *param_word, gboolean is_descending) {
+    Param param_seq;
+    Entry *entry;
+    if (!pop_sort_args(param_word, &param_seq, &entry)) return;
+
+    GSequence *sequence = unshare_object(&param_seq);
+    SortKey *keys;
+    guint len;
+    if (!sequence || !extract_sort_keys(param_seq.val_object, entry, &keys, &len)) {
+        clear_param(&param_seq);
+        return;
     }
 
-    g_sequence_sort(sequence, cmp_func, entry);
-    push_param(param_seq);
+    // Move the items into sorted order
+    sort_keys(keys, len, is_descending);
+    GSequenceIter *end = g_sequence_get_end_iter(sequence);
+    for (guint i=0; i < len; i++) {
+        g_sequence_move(keys[i].iter, end);
+    }
+    free_sort_keys(keys, len);
 
-done:
-    free_param(param_word);
-    return;
+    push_value(&param_seq);
+    clear_param(&param_seq);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a sort word and sorts a sequence by it (see sort_sequence_by)
+
+(seq sort-word -- seq)
+*/
+// -----------------------------------------------------------------------------
+static void sort_sequence(gboolean is_descending) {
+    Param param_word;
+    if (!pop_value(&param_word)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    sort_sequence_by(&param_word, is_descending);
+    clear_param(&param_word);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Keeps the first N items of a sequence in sort order.
+
+(seq sort-word N -- seq)
+
+Like sort_sequence, the key of each item is gotten once, but only the first N
+keys are selected (see select_keys) instead of sorting all of them. The other
+items are removed, and the selected ones are moved into sorted order.
+
+If other params share the sequence, it's copied first (see unshare_object).
+*/
+// ----------------------------------------------------------------------------
+static void select_from_sequence(gboolean is_descending) {
+    // Pop N
+    Param param_n;
+    if (!pop_value(&param_n)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+    if (param_n.type != 'I' || param_n.val_int < 0 || param_n.val_int > G_MAXUINT) {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&param_n, stderr, "----> ");
+        fprintf(stderr, "----> N must be a non-negative int\n");
+        clear_param(&param_n);
+        return;
+    }
+    guint n = param_n.val_int;
+
+    Param param_word;
+    if (!pop_value(&param_word)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    Param param_seq;
+    Entry *entry;
+    gboolean is_ok = pop_sort_args(&param_word, &param_seq, &entry);
+    clear_param(&param_word);
+    if (!is_ok) return;
+
+    GSequence *sequence = unshare_object(&param_seq);
+    SortKey *keys;
+    guint len;
+    if (!sequence || !extract_sort_keys(param_seq.val_object, entry, &keys, &len)) {
+        clear_param(&param_seq);
+        return;
+    }
+
+    SortKey **selected = g_new(SortKey *, MIN(n, len) + 1);
+    guint num_selected = select_keys(keys, len, n, is_descending, selected);
+
+    // Remove the items that weren't selected and move the rest into order
+    gboolean *is_selected = g_new0(gboolean, len + 1);
+    for (guint i=0; i < num_selected; i++) is_selected[selected[i]->index] = 1;
+    for (guint i=0; i < len; i++) {
+        if (!is_selected[i]) g_sequence_remove(keys[i].iter);
+    }
+
+    GSequenceIter *end = g_sequence_get_end_iter(sequence);
+    for (guint i=0; i < num_selected; i++) {
+        g_sequence_move(selected[i]->iter, end);
+    }
+
+    g_free(is_selected);
+    g_free(selected);
+    free_sort_keys(keys, len);
+
+    push_value(&param_seq);
+    clear_param(&param_seq);
 }
 
 
@@ -107,7 +492,7 @@ done:
 */
 // -----------------------------------------------------------------------------
 static void EC_ascending(gpointer gp_entry) {
-    sort_sequence(sort_sequence_asc_cmp);
+    sort_sequence(0);
 }
 
 
@@ -117,43 +502,99 @@ static void EC_ascending(gpointer gp_entry) {
 */
 // -----------------------------------------------------------------------------
 static void EC_descending(gpointer gp_entry) {
-    sort_sequence(sort_sequence_desc_cmp);
+    sort_sequence(1);
 }
 
 
+
 // -----------------------------------------------------------------------------
-/** Gets length of sequence
+/** Sorts sequence in ascending order by a given word (the operand form of
+"ascending"; see add_operand_form)
+*/
+// -----------------------------------------------------------------------------
+static void sort_ascending_by(const Param *param_word) {
+    sort_sequence_by(param_word, 0);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Sorts sequence in descending order by a given word (the operand form of
+"descending"; see add_operand_form)
+*/
+// -----------------------------------------------------------------------------
+static void sort_descending_by(const Param *param_word) {
+    sort_sequence_by(param_word, 1);
+}
 
-(seq -- seq int)
+
+
+// -----------------------------------------------------------------------------
+/** Keeps the N largest items of a sequence, largest first (see select_from_sequence)
 */
 // -----------------------------------------------------------------------------
-static void EC_len(gpointer gp_entry) {
-    const Param *param_seq = top();
+static void EC_top_n(gpointer gp_entry) {
+    select_from_sequence(1);
+}
+
+
 
-    GSequence *seq = param_seq->val_custom;
-    push_param(new_int_param(g_sequence_get_length(seq)));
+// -----------------------------------------------------------------------------
+/** Keeps the N smallest items of a sequence, smallest first (see select_from_sequence)
+*/
+// -----------------------------------------------------------------------------
+static void EC_bottom_n(gpointer gp_entry) {
+    select_from_sequence(0);
 }
 
 
+
+// -----------------------------------------------------------------------------
+/** Pops a sequence (or any other collection) and releases it.
+
+The sequence is only freed once no other params (e.g., a variable) share it.
+*/
+// -----------------------------------------------------------------------------
 static void EC_pop_seq(gpointer gp_entry) {
-    Param *param_seq = pop_param();
-    g_sequence_free(param_seq->val_custom);
-    free_param(param_seq);
+    Param param_seq;
+    if (!pop_value(&param_seq)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    if (param_seq.type != 'A' && (param_seq.type != 'O' || !param_seq.val_object->type->length)) {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&param_seq, stderr, "----> ");
+    }
+    clear_param(&param_seq);
 }
 
 
+
 // -----------------------------------------------------------------------------
-/** Defines the sequence lexicon
+/** Defines the sequence lexicon (in the "sequence" wordlist)
 
 - ascending (seq sort-word -- seq-sorted) Sorts seq in ascending order
 - descending (seq sort-word -- seq-sorted) Sorts seq in descending order
+- top-n (seq sort-word N -- seq-top) Keeps the N largest items, largest first
+- bottom-n (seq sort-word N -- seq-bottom) Keeps the N smallest items, smallest first
+- pop-seq (seq -- ) Releases a sequence
+
+"len" and "nth" work on sequences too (see add_array_words).
 
 */
 // -----------------------------------------------------------------------------
 void EC_add_sequence_lexicon(gpointer gp_entry) {
+    Wordlist *previous = set_current_wordlist(add_wordlist("sequence"));
+
     add_entry("ascending")->routine = EC_ascending;
     add_entry("descending")->routine = EC_descending;
+    add_operand_form(EC_ascending, sort_ascending_by);
+    add_operand_form(EC_descending, sort_descending_by);
+    add_entry("top-n")->routine = EC_top_n;
+    add_entry("bottom-n")->routine = EC_bottom_n;
 
-    add_entry("len")->routine = EC_len;
     add_entry("pop-seq")->routine = EC_pop_seq;
+
+    set_current_wordlist(previous);
 }
@@ -3,4 +3,5 @@
 
 #pragma once
 
+guint sequence_length(gconstpointer data);
 void EC_add_sequence_lexicon(gpointer gp_entry);
@@ -2,7 +2,182 @@
 
 \brief Lexicon for interacting with sqlite3
 
+Lexicons that use a database (e.g., tasks and notes) run their SQL through
+prepared statements that are cached per connection (see prepare_statement).
+Values are bound as parameters rather than pasted into the SQL, and columns are
+read with their types (e.g., sqlite3_column_int64) rather than parsed from text.
+Changes that span several statements are wrapped in "begin" and
+end_transaction.
+
+*/
+
+// -----------------------------------------------------------------------------
+/** Finalizes a cached statement (see prepare_statement).
+*/
+// -----------------------------------------------------------------------------
+static void finalize_statement(gpointer gp_stmt) {
+    sqlite3_finalize(gp_stmt);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns a prepared statement for some SQL, preparing it the first time it's
+used with a connection.
+
+\param connection: Database connection (may be NULL if a db variable isn't set)
+\param sql: SQL with "?1", "?2", ... for the values to bind
+\returns The statement (reset, with no bindings) or NULL if the error has been handled
+
+The statement belongs to the cache and is finalized when the connection is
+closed by sqlite3-close, so it shouldn't be finalized by the caller. Run it
+with step_statement.
+*/
+// -----------------------------------------------------------------------------
+sqlite3_stmt *prepare_statement(sqlite3 *connection, const gchar *sql) {
+    if (!connection) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> No database connection for '%s'\n", sql);
+        return NULL;
+    }
+
+    if (!_statement_caches) {
+        _statement_caches = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                  (GDestroyNotify) g_hash_table_destroy);
+    }
+    GHashTable *cache = g_hash_table_lookup(_statement_caches, connection);
+    if (!cache) {
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, finalize_statement);
+        g_hash_table_insert(_statement_caches, connection, cache);
+    }
+
+    sqlite3_stmt *result = g_hash_table_lookup(cache, sql);
+    if (result) {
+        sqlite3_reset(result);
+        sqlite3_clear_bindings(result);
+        return result;
+    }
+
+    if (sqlite3_prepare_v3(connection, sql, -1, SQLITE_PREPARE_PERSISTENT, &result, NULL) != SQLITE_OK) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Problem preparing '%s'\n----->%s\n", sql, sqlite3_errmsg(connection));
+        sqlite3_finalize(result);
+        return NULL;
+    }
+    g_hash_table_insert(cache, g_strdup(sql), result);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Steps a statement from prepare_statement.
+
+\param what: Describes the statement in error messages (e.g., a word)
+\returns 1 if there's a row to read; 0 when it's done; -1 if the error has been handled
+
+A statement is reset once it's done (or fails) so that it doesn't keep the
+database locked. If only the first row is read, reset it with sqlite3_reset.
+*/
+// -----------------------------------------------------------------------------
+gint step_statement(sqlite3_stmt *stmt, const gchar *what) {
+    int status = sqlite3_step(stmt);
+    if (status == SQLITE_ROW) return 1;
+
+    gint result = 0;
+    if (status != SQLITE_DONE) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Problem executing '%s'\n----->%s\n", what, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+        result = -1;
+    }
+    sqlite3_reset(stmt);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Binds an 'I', 'D', or 'S' param to a parameter of a statement.
+
+\param index: Index of the parameter ("?1" is 1)
+\returns 1 on success; 0 if the error has been handled
+*/
+// -----------------------------------------------------------------------------
+gboolean bind_param(sqlite3_stmt *stmt, int index, const Param *param) {
+    switch(param->type) {
+        case 'I':
+            sqlite3_bind_int64(stmt, index, param->val_int);
+            return 1;
+
+        case 'D':
+            sqlite3_bind_double(stmt, index, param->val_double);
+            return 1;
+
+        case 'S':
+            sqlite3_bind_text(stmt, index, param->val_string, -1, SQLITE_TRANSIENT);
+            return 1;
+
+        default:
+            break;
+    }
+
+    Param copy;
+    copy_param(&copy, param);
+    handle_error(ERR_INVALID_PARAM);
+    print_param(&copy, stderr, "----> ");
+    fprintf(stderr, "-----> Unable to bind this to an SQL parameter\n");
+    clear_param(&copy);
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the text of a column, or "" if it's NULL.
+
+\note The text is only valid until the statement is stepped or reset.
 */
+// -----------------------------------------------------------------------------
+const gchar *column_text(sqlite3_stmt *stmt, int col) {
+    const gchar *result = (const gchar *) sqlite3_column_text(stmt, col);
+    return result ? result : "";
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs SQL that doesn't return rows (e.g., "begin") with a cached statement.
+
+\returns 1 on success; 0 if the error has been handled
+*/
+// -----------------------------------------------------------------------------
+gboolean run_sql(sqlite3 *connection, const gchar *sql) {
+    sqlite3_stmt *stmt = prepare_statement(connection, sql);
+    if (!stmt) return 0;
+
+    gint status = step_statement(stmt, sql);
+    if (status == 1) sqlite3_reset(stmt);
+    return status >= 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Commits the transaction of a connection, or rolls it back if a step failed.
+
+\param is_ok: 1 to commit; 0 to roll back
+\returns 1 if the transaction was committed
+*/
+// -----------------------------------------------------------------------------
+gboolean end_transaction(sqlite3 *connection, gboolean is_ok) {
+    if (is_ok) return run_sql(connection, "commit");
+
+    // A failed step may have rolled back the transaction already
+    if (!sqlite3_get_autocommit(connection)) run_sql(connection, "rollback");
+    return 0;
+}
+
+
 
 // -----------------------------------------------------------------------------
 /** Pops a db filename, opens an sqlite3 connection to it, and pushes the
@@ -28,8 +203,27 @@ static void EC_sqlite3_open(gpointer gp_entry) {
 
 
 
+// -----------------------------------------------------------------------------
+/** Registers a function to run when a connection is closed by sqlite3-close.
+
+\param hook: Function that forgets anything a lexicon keeps about the connection
+
+Registering the same function again has no effect.
+*/
+// -----------------------------------------------------------------------------
+void add_close_hook(close_hook_ptr hook) {
+    if (!_close_hooks) {
+        _close_hooks = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    g_hash_table_replace(_close_hooks, (gpointer) hook, NULL);
+}
+
+
+
 // -----------------------------------------------------------------------------
 /** Pops a database connection and closes it.
+
+The close hooks run first (see add_close_hook).
 */
 // -----------------------------------------------------------------------------
 static void EC_sqlite3_close(gpointer gp_entry) {
@@ -37,6 +231,15 @@ static void EC_sqlite3_close(gpointer gp_entry) {
 
     sqlite3 *connection = param_connection->val_custom;
 
+    // Cached statements have to be finalized before the connection can be closed
+    if (_statement_caches) g_hash_table_remove(_statement_caches, connection);
+    if (_close_hooks) {
+        GHashTableIter iter;
+        gpointer hook;
+        g_hash_table_iter_init(&iter, _close_hooks);
+        while (g_hash_table_iter_next(&iter, &hook, NULL)) ((close_hook_ptr) hook)(connection);
+    }
+
     int sqlite_status = sqlite3_close(connection);
     if (sqlite_status != SQLITE_OK) {
         handle_error(ERR_GENERIC_ERROR);
@@ -67,11 +270,22 @@ static void EC_sqlite3_last_id(gpointer gp_entry) {
 
 
 
+// -----------------------------------------------------------------------------
+/** Pushes the last inserted row ID of a connection (the operand form of
+sqlite3-last-id; see add_operand_form)
+*/
+// -----------------------------------------------------------------------------
+static void last_id_of(const Param *param_connection) {
+    push_int(sqlite3_last_insert_rowid(param_connection->val_custom));
+}
+
+
+
 // -----------------------------------------------------------------------------
 /** Defines sqlite3 lexicon and adds it to the dictionary.
 
 
-The following words are defined:
+The following words are defined (in the "sqlite" wordlist):
 
 - sqlite3-open (db-name -- db-connection) Opens a connection to a database
 - sqlite3-close (db-connection -- ) Closes a connection to a database
@@ -80,7 +294,12 @@ The following words are defined:
 */
 // -----------------------------------------------------------------------------
 void EC_add_sqlite_lexicon(gpointer gp_entry) {
+    Wordlist *previous = set_current_wordlist(add_wordlist("sqlite"));
+
     add_entry("sqlite3-open")->routine = EC_sqlite3_open;
     add_entry("sqlite3-close")->routine = EC_sqlite3_close;
     add_entry("sqlite3-last-id")->routine = EC_sqlite3_last_id;
+    add_operand_form(EC_sqlite3_last_id, last_id_of);
+
+    set_current_wordlist(previous);
 }
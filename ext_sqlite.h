@@ -3,4 +3,14 @@
 
 #pragma once
 
+typedef void (*close_hook_ptr)(sqlite3 *connection);  /**< \brief Function pointer type for close hooks (see add_close_hook) */
+
+void add_close_hook(close_hook_ptr hook);
+sqlite3_stmt *prepare_statement(sqlite3 *connection, const gchar *sql);
+gint step_statement(sqlite3_stmt *stmt, const gchar *what);
+gboolean bind_param(sqlite3_stmt *stmt, int index, const Param *param);
+const gchar *column_text(sqlite3_stmt *stmt, int col);
+gboolean run_sql(sqlite3 *connection, const gchar *sql);
+gboolean end_transaction(sqlite3 *connection, gboolean is_ok);
+
 void EC_add_sqlite_lexicon(gpointer gp_entry);
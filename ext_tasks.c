@@ -7,6 +7,15 @@ The schema of the tasks.db is:
 - CREATE TABLE tasks(is_done INTEGER, id INTEGER PRIMARY KEY, name TEXT, value REAL);
 - CREATE TABLE parent_child(parent INTEGER, child INTEGER);
 - CREATE TABLE task_notes(task INTEGER, note INTEGER);
+- CREATE TABLE task_closure(ancestor INTEGER, descendant INTEGER, depth INTEGER,
+                            PRIMARY KEY(ancestor, descendant)) WITHOUT ROWID;
+
+task_closure has a row for every task and each of its ancestors (including the
+task itself at depth 0 and the root task, 0, as an ancestor of every task). It's
+created the first time it's needed (see get_closure_connection) and kept up to
+date by +, ++, m, and delete, so subtrees, ancestors, and depths are indexed
+lookups rather than walks. If parent_child is changed outside of this lexicon,
+rebuild-closure makes it again.
 
 
 The *cur-task variable refers to the current task. This is an implicit
@@ -17,12 +26,15 @@ current task is the root task.
       by the lexicon (via set_cur_task). Also, the only function that should
       free memory involving *cur-task is set_cur_task.
 
-A convention throughout is that if a word pushes a sequence or array onto the
-stack, it is the responsibility of the caller to free that memory.
+Sequences of Tasks are pushed as objects (see task_sequence_type), so they're
+freed when the last param sharing them is released (e.g., by print-tasks or
+pop). Words that change a sequence in place (e.g., incomplete) copy it first if
+it's shared.
 
 */
 
 #define MAX_NAME_LEN   256  /**< \brief Length of string to hold task names */
+#define MAX_TASK_DEPTH   "1000"  /**< \brief Deepest level followed when making task_closure (see CLOSURE_PATHS_CTE) */
 
 #define TREE_TEE     "├"
 #define TREE_VERT    "│"
@@ -58,6 +70,66 @@ static Task *copy_task(Task *src) {
 
 
 
+// -----------------------------------------------------------------------------
+/** Copies a GSequence of Tasks (see task_sequence_type).
+*/
+// -----------------------------------------------------------------------------
+static gpointer clone_task_sequence(gconstpointer data) {
+    GSequence *seq = (GSequence *) data;
+    GSequence *result = g_sequence_new(g_free);
+
+    for (GSequenceIter *iter = g_sequence_get_begin_iter(seq);
+         !g_sequence_iter_is_end(iter);
+         iter = g_sequence_iter_next(iter)) {
+
+        g_sequence_append(result, copy_task(g_sequence_get(iter)));
+    }
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets a Task in a GSequence of Tasks as a 'C' param (see task_sequence_type).
+*/
+// -----------------------------------------------------------------------------
+static void get_task_element(gconstpointer data, guint index, Param *dst) {
+    GSequence *seq = (GSequence *) data;
+
+    dst->type = 'C';
+    dst->val_custom = g_sequence_get(g_sequence_get_iter_at_pos(seq, index));
+    dst->val_custom_comment = g_intern_string("Task");
+}
+
+
+
+/** \brief Type of the objects holding a GSequence of Tasks
+*/
+static const ObjectType task_sequence_type = {
+    .name = "[tasks]",
+    .free = (GDestroyNotify) g_sequence_free,
+    .clone = clone_task_sequence,
+    .length = sequence_length,
+    .get_element = get_task_element,
+    .is_sequence = 1
+};
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a GSequence of Tasks onto the stack as an object.
+
+\param seq: Sequence to take over (nothing is pushed if it's NULL because of an
+            error)
+*/
+// -----------------------------------------------------------------------------
+static void push_tasks(GSequence *seq) {
+    if (!seq) return;
+    push_object(&task_sequence_type, seq);
+}
+
+
+
 // -----------------------------------------------------------------------------
 /** Returns a pointer to cur-task
 
@@ -66,12 +138,9 @@ static Task *copy_task(Task *src) {
 */
 // -----------------------------------------------------------------------------
 static Task *get_cur_task() {
-    execute_string("*cur-task @");
-    Param *param_task = pop_param();
-    Task *result = param_task->val_custom;
-
-    free_param(param_task);
-    return result;
+    const Param *value = variable_value(&_cur_task_ref);
+    if (!value || value->type != 'C') return NULL;
+    return value->val_custom;
 }
 
 
@@ -85,12 +154,21 @@ where the cur-task gets freed).
 */
 // -----------------------------------------------------------------------------
 static void set_cur_task(Task *task) {
+    Param *value = variable_value(&_cur_task_ref);
+    if (!value) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> *cur-task isn't a variable\n");
+        g_free(task);
+        return;
+    }
+
     Task *cur_task = get_cur_task();
     g_free(cur_task);
 
-    Param *param_new = new_custom_param(task, "Task");
-    push_param(param_new);
-    execute_string("*cur-task !");
+    clear_param(value);
+    value->type = 'C';
+    value->val_custom = task;
+    value->val_custom_comment = g_intern_string("Task");
 }
 
 
@@ -115,77 +193,210 @@ static gint64 get_cur_task_id() {
 */
 // -----------------------------------------------------------------------------
 static sqlite3 *get_db_connection() {
-      execute_string("tasks-db @");
-    Param *param_connection = pop_param();
+    const Param *value = variable_value(&_tasks_db_ref);
+    if (!value) return NULL;
+    return value->val_custom;
+}
 
-    sqlite3 *result = param_connection->val_custom;
 
-    free_param(param_connection);
-    return result;
+
+// -----------------------------------------------------------------------------
+/** Appends the Tasks from the rows of a statement to a sequence.
+
+The statement must select id, parent, name, is_done, and value (in that order).
+
+\returns 1 on success; 0 if the error has been handled
+*/
+// -----------------------------------------------------------------------------
+static gboolean append_tasks(sqlite3_stmt *stmt, GSequence *records) {
+    gint status;
+    while ((status = step_statement(stmt, "select_tasks")) == 1) {
+        Task *task = g_new(Task, 1);
+        task->id = sqlite3_column_int64(stmt, 0);
+        task->parent_id = sqlite3_column_int64(stmt, 1);
+        g_strlcpy(task->name, column_text(stmt, 2), MAX_NAME_LEN);
+        task->is_done = sqlite3_column_int(stmt, 3);
+        task->value = sqlite3_column_double(stmt, 4);
+
+        g_sequence_append(records, task);
+    }
+    return status == 0;
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Callback used to write note records from an SQL query into a sequence of records.
+/** Returns a GSequence of tasks matching the conditions.
+
+\param sql_conditions: Conditions (and ordering) of the query, which may refer to
+                        "?1" (e.g., "where pc.parent=?1")
+\param arg: Value bound to ?1 (NULL if the conditions don't have one)
+
+\note The caller is responsible for freeing the returned GSequence.
 */
 // -----------------------------------------------------------------------------
-static int append_task_cb(gpointer gp_records, int num_cols, char **values, char **cols) {
-    GSequence *records = gp_records;
-    if (num_cols != 5) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Unexpected num cols from task query\n");
-        return 1;
+static GSequence *select_tasks(const gchar *sql_conditions, const Param *arg) {
+    gchar *select = "select id, pc.parent, name, is_done, value "
+                    "from tasks inner join parent_child as pc on pc.child=id ";
+
+    gchar *query = arena_strconcat(select, sql_conditions, NULL);
+    sqlite3_stmt *stmt = prepare_statement(get_db_connection(), query);
+    if (!stmt) return NULL;
+    if (arg && !bind_param(stmt, 1, arg)) return NULL;
+
+    GSequence *result = g_sequence_new(g_free);
+    if (!append_tasks(stmt, result)) {
+        g_sequence_free(result);
+        result = NULL;
     }
 
-    // TODO: Read value and store
+    return result;
+}
 
-    Task task = {.id = g_ascii_strtoll(values[0], NULL, 10),
-                 .parent_id = g_ascii_strtoll(values[1], NULL, 10),
-                 .is_done = g_ascii_strtoll(values[3], NULL, 10),
-                 .value = values[4] ? g_ascii_strtod(values[4], NULL) : 0.0
-                };
-    g_strlcpy(task.name, values[2], MAX_NAME_LEN);
 
-    Task *task_new = copy_task(&task);
 
-    g_sequence_append(records, task_new);
-    return 0;
+// -----------------------------------------------------------------------------
+/** Returns a GSequence of tasks matching conditions on an id (see select_tasks).
+*/
+// -----------------------------------------------------------------------------
+static GSequence *select_tasks_by_id(const gchar *sql_conditions, gint64 id) {
+    Param arg = {.type = 'I', .val_int = id};
+    return select_tasks(sql_conditions, &arg);
 }
 
 
 
+/** \brief Every (ancestor, descendant, depth) path in parent_child as the "paths" CTE
+
+This is used to make and check task_closure (see EC_rebuild_closure). Since a
+move from outside of this lexicon could make a cycle, the depth is limited to
+MAX_TASK_DEPTH.
+*/
+#define CLOSURE_PATHS_CTE \
+    "with recursive paths(ancestor, descendant, depth) as (" \
+    "    values(0, 0, 0) " \
+    "    union all select child, child, 0 from parent_child " \
+    "    union all " \
+    "    select paths.ancestor, pc.child, paths.depth + 1 from paths " \
+    "    inner join parent_child as pc on pc.parent=paths.descendant " \
+    "    where paths.depth < " MAX_TASK_DEPTH \
+    "), " \
+    "expected as (select ancestor, descendant, min(depth) as depth from paths group by ancestor, descendant) "
+
+
+
 // -----------------------------------------------------------------------------
-/** Returns a GSequence of tasks matching the conditions.
+/** Makes task_closure again from parent_child.
 
-\note The caller is responsible for freeing the returned GSequence.
+\returns 1 on success; 0 if the error has been handled
+*/
+// -----------------------------------------------------------------------------
+static gboolean rebuild_closure(sqlite3 *connection) {
+    if (!run_sql(connection, "begin immediate")) return 0;
+
+    gboolean is_ok = run_sql(connection, "delete from task_closure") &&
+                     run_sql(connection, "insert into task_closure(ancestor, descendant, depth) "
+                                         CLOSURE_PATHS_CTE "select * from expected");
+    return end_transaction(connection, is_ok);
+}
+
+
+
+/** \brief Connection whose task_closure table has been checked (see get_closure_connection)
+*/
+static sqlite3 *closure_checked_db = NULL;
+
+
+
+// -----------------------------------------------------------------------------
+/** Forgets that a connection's task_closure table was checked when it's closed.
+
+This is a close hook (see add_close_hook), so a new connection that happens to
+get the same address is checked again.
 */
 // -----------------------------------------------------------------------------
-static GSequence *select_tasks(const gchar *sql_conditions) {
+static void forget_closure_connection(sqlite3 *connection) {
+    if (connection == closure_checked_db) closure_checked_db = NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets the tasks-db connection, making sure it has a task_closure table.
+
+\returns The connection or NULL if the error has been handled
+
+The first time a connection is used, task_closure (and its index by descendant)
+are created if needed. If the table is empty, it's built from parent_child.
+*/
+// -----------------------------------------------------------------------------
+static sqlite3 *get_closure_connection() {
     sqlite3 *connection = get_db_connection();
+    if (connection && connection == closure_checked_db) return connection;
 
-    gchar *select = "select id, pc.parent, name, is_done, value "
-                    "from tasks inner join parent_child as pc on pc.child=id ";
+    if (!run_sql(connection, "create table if not exists "
+                             "task_closure(ancestor INTEGER, descendant INTEGER, depth INTEGER, "
+                             "primary key(ancestor, descendant)) without rowid")) return NULL;
+    if (!run_sql(connection, "create index if not exists task_closure_descendant "
+                             "on task_closure(descendant, ancestor)")) return NULL;
 
-    gchar *query = g_strconcat(select, sql_conditions, NULL);
+    sqlite3_stmt *stmt = prepare_statement(connection, "select exists(select 1 from task_closure)");
+    if (!stmt) return NULL;
+    gint status = step_statement(stmt, "task_closure");
+    if (status < 0) return NULL;
+    gboolean is_empty = sqlite3_column_int(stmt, 0) == 0;
+    sqlite3_reset(stmt);
 
+    if (is_empty && !rebuild_closure(connection)) return NULL;
 
-    GSequence *result = g_sequence_new(g_free);
+    closure_checked_db = connection;
+    return connection;
+}
 
-    char *error_message = NULL;
-    sqlite3_exec(connection, query, append_task_cb, result, &error_message);
 
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem executing 'select_tasks'\n----->%s", error_message);
 
-        g_free(result);
-        result = NULL;
-    }
+// -----------------------------------------------------------------------------
+/** Checks if one task is an ancestor of another (or the same task) with task_closure.
+
+\param result: Receives 1 if ancestor_id is an ancestor of task_id; 0 otherwise
+\returns 1 on success; 0 if the error has been handled
+*/
+// -----------------------------------------------------------------------------
+static gboolean is_ancestor(gint64 ancestor_id, gint64 task_id, gboolean *result) {
+    sqlite3_stmt *stmt = prepare_statement(get_closure_connection(),
+                                           "select exists(select 1 from task_closure "
+                                           "where ancestor=?1 and descendant=?2)");
+    if (!stmt) return 0;
+
+    sqlite3_bind_int64(stmt, 1, ancestor_id);
+    sqlite3_bind_int64(stmt, 2, task_id);
+    if (step_statement(stmt, "is-ancestor") < 0) return 0;
+    *result = sqlite3_column_int(stmt, 0);
+    sqlite3_reset(stmt);
+    return 1;
+}
+
 
-    // Cleanup
-    g_free(query);
 
+// -----------------------------------------------------------------------------
+/** Returns a GSequence of tasks selected through task_closure for a task id.
+
+\param sql: Query that selects id, parent, name, is_done, and value, with the
+            task id as ?1
+
+\note The caller is responsible for freeing the returned GSequence.
+*/
+// -----------------------------------------------------------------------------
+static GSequence *select_task_tree(const gchar *sql, gint64 id) {
+    sqlite3_stmt *stmt = prepare_statement(get_closure_connection(), sql);
+    if (!stmt) return NULL;
+    sqlite3_bind_int64(stmt, 1, id);
+
+    GSequence *result = g_sequence_new(g_free);
+    if (!append_tasks(stmt, result)) {
+        g_sequence_free(result);
+        result = NULL;
+    }
     return result;
 }
 
@@ -194,48 +405,76 @@ static GSequence *select_tasks(const gchar *sql_conditions) {
 // -----------------------------------------------------------------------------
 /** Adds a task to the tasks-db
 
+The task, its parent_child record, and its task_closure rows are inserted in one
+transaction.
 */
 // -----------------------------------------------------------------------------
 static void add_task(const gchar *name, gint64 parent_id) {
-    gchar parent_id_str[MAX_ID_LEN];
-    gchar child_id_str[MAX_ID_LEN];
-
-    char* error_message = NULL;
-    sqlite3 *connection = get_db_connection();
+    sqlite3 *connection = get_closure_connection();
+    if (!connection || !run_sql(connection, "begin immediate")) return;
 
     // Insert new task
-    gchar *sql = g_strconcat("insert into tasks(name, is_done) ",
-                             "values(\"", name, "\", 0)", NULL);
-    sqlite3_exec(connection, sql, NULL, NULL, &error_message);
-    g_free(sql);
+    sqlite3_stmt *stmt = prepare_statement(connection, "insert into tasks(name, is_done) values(?1, 0)");
+    if (!stmt) goto done;
 
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem inserting task ==> %s\n", error_message);
-        goto done;
-    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_TRANSIENT);
+    if (step_statement(stmt, "add task") < 0) goto done;
 
     // Get ID of task
     gint64 task_id = sqlite3_last_insert_rowid(connection);
 
     // Insert parent/child record
-    snprintf(parent_id_str, MAX_ID_LEN, "%ld", parent_id);
-    snprintf(child_id_str, MAX_ID_LEN, "%ld", task_id);
-    sql = g_strconcat("insert into parent_child(parent, child) ",
-                             "values(", parent_id_str, ", ", child_id_str, ")", NULL);
-    sqlite3_exec(connection, sql, NULL, NULL, &error_message);
-    g_free(sql);
-
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem inserting parent/child ==> %s\n", error_message);
-    }
+    stmt = prepare_statement(connection, "insert into parent_child(parent, child) values(?1, ?2)");
+    if (!stmt) goto done;
 
-done:
+    sqlite3_bind_int64(stmt, 1, parent_id);
+    sqlite3_bind_int64(stmt, 2, task_id);
+    if (step_statement(stmt, "add parent/child") < 0) goto done;
+
+    // The task is one level below each of its parent's ancestors
+    stmt = prepare_statement(connection, "insert into task_closure(ancestor, descendant, depth) "
+                                         "select ancestor, ?2, depth + 1 from task_closure where descendant=?1 "
+                                         "union all select ?2, ?2, 0");
+    if (!stmt) goto done;
+
+    sqlite3_bind_int64(stmt, 1, parent_id);
+    sqlite3_bind_int64(stmt, 2, task_id);
+    if (step_statement(stmt, "add task_closure") < 0) goto done;
+
+    end_transaction(connection, 1);
     return;
+
+done:
+    end_transaction(connection, 0);
+}
+
+
+// -----------------------------------------------------------------------------
+/** Pops the name of a new task.
+
+\returns 1 on success; 0 if the error has been handled (e.g., a number was
+          passed to "+", which shadows the arithmetic "+" once this lexicon is
+          loaded)
+*/
+// -----------------------------------------------------------------------------
+static gboolean pop_task_name(Param *dst) {
+    if (!pop_value(dst)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return 0;
+    }
+
+    if (dst->type != 'S') {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(dst, stderr, "----> ");
+        fprintf(stderr, "-----> Task names are strings (use forth:+ to add numbers)\n");
+        clear_param(dst);
+        return 0;
+    }
+    return 1;
 }
 
 
+
 // -----------------------------------------------------------------------------
 /** Adds a new task as a sibling of cur-task.
 
@@ -251,10 +490,11 @@ static void EC_add_task(gpointer gp_entry) {
     }
 
     // Get the task name and create a new task
-    Param *param_task_name = pop_param();
-    add_task(param_task_name->val_string, parent_id);
+    Param param_task_name;
+    if (!pop_task_name(&param_task_name)) return;
+    add_task(param_task_name.val_string, parent_id);
 
-    free_param(param_task_name);
+    clear_param(&param_task_name);
 }
 
 
@@ -265,10 +505,11 @@ static void EC_add_task(gpointer gp_entry) {
 // -----------------------------------------------------------------------------
 static void EC_add_subtask(gpointer gp_entry) {
     gint64 parent_id = get_cur_task_id();
-    Param *param_task_name = pop_param();
-    add_task(param_task_name->val_string, parent_id);
+    Param param_task_name;
+    if (!pop_task_name(&param_task_name)) return;
+    add_task(param_task_name.val_string, parent_id);
 
-    free_param(param_task_name);
+    clear_param(&param_task_name);
 }
 
 
@@ -280,12 +521,7 @@ static void EC_add_subtask(gpointer gp_entry) {
 // -----------------------------------------------------------------------------
 static void EC_down(gpointer gp_entry) {
     gint64 parent_id = get_cur_task_id();
-    gchar parent_id_str[MAX_ID_LEN];
-    snprintf(parent_id_str, MAX_ID_LEN, "%ld", parent_id);
-
-    gchar *sql_condition = g_strconcat("where pc.parent=", parent_id_str, " order by id asc limit 1", NULL);
-    GSequence *records = select_tasks(sql_condition);
-    g_free(sql_condition);
+    GSequence *records = select_tasks_by_id("where pc.parent=?1 order by id asc limit 1", parent_id);
     if (g_sequence_get_length(records) != 1) {
         goto done;
     }
@@ -319,7 +555,6 @@ static void EC_up(gpointer gp_entry) {
 // -----------------------------------------------------------------------------
 static void EC_go(gpointer gp_entry) {
     Param *param_id = pop_param();
-    gchar id_str[MAX_ID_LEN];
 
     // Handle the root task
     if (param_id->val_int == 0) {
@@ -327,10 +562,7 @@ static void EC_go(gpointer gp_entry) {
         goto done;
     }
 
-    snprintf(id_str, MAX_ID_LEN, "%ld", param_id->val_int);
-    gchar *sql_condition = g_strconcat("where id=", id_str, NULL);
-    GSequence *records = select_tasks(sql_condition);
-    g_free(sql_condition);
+    GSequence *records = select_tasks_by_id("where id=?1", param_id->val_int);
     if (g_sequence_get_length(records) != 1) {
         fprintf(stderr, "Unknown task id: %ld\n", param_id->val_int);
         goto done;
@@ -410,19 +642,19 @@ static void print_task(gpointer gp_task, gpointer gp_cur_task) {
 // -----------------------------------------------------------------------------
 /** Prints a GSequence of Task
 
-This also frees the memory associated with the GSequence.
+This also releases the sequence.
 */
 // -----------------------------------------------------------------------------
 static void EC_print(gpointer gp_entry) {
     Task *cur_task = get_cur_task();
-    Param *param_seq = pop_param();
-    GSequence *seq = param_seq->val_custom;
+    Param param_seq;
+    GSequence *seq = pop_object(&param_seq, &task_sequence_type);
+    if (!seq) return;
 
     g_sequence_foreach(seq, print_task, cur_task);
     printf("\n");
 
-    g_sequence_free(seq);
-    free_param(param_seq);
+    clear_param(&param_seq);
 }
 
 
@@ -440,8 +672,7 @@ static void EC_seq_cur_task(gpointer gp_entry) {
 
     g_sequence_append(seq, cur_task);
 
-    Param *param_new = new_custom_param(seq, "[cur-task]");
-    push_param(param_new);
+    push_tasks(seq);
 }
 
 
@@ -461,16 +692,10 @@ static void EC_siblings(gpointer gp_entry) {
         g_sequence_append(seq, cur_task);
     }
     else {
-        gchar parent_id_str[MAX_ID_LEN];
-        snprintf(parent_id_str, MAX_ID_LEN, "%ld", cur_task->parent_id);
-
-        gchar *sql_condition = g_strconcat("where pc.parent=", parent_id_str, " order by id asc", NULL);
-        seq = select_tasks(sql_condition);
-        g_free(sql_condition);
+        seq = select_tasks_by_id("where pc.parent=?1 order by id asc", cur_task->parent_id);
     }
 
-    Param *param_new = new_custom_param(seq, "[siblings]");
-    push_param(param_new);
+    push_tasks(seq);
 }
 
 
@@ -480,79 +705,70 @@ static void EC_siblings(gpointer gp_entry) {
 */
 // -----------------------------------------------------------------------------
 static void EC_all(gpointer gp_entry) {
-    GSequence *records = select_tasks("");
-    Param *param_new = new_custom_param(records, "[all]");
-    push_param(param_new);
+    GSequence *records = select_tasks("", NULL);
+    push_tasks(records);
 }
 
 
 
 // -----------------------------------------------------------------------------
 /** Pops a GSequence of Task and selects only those tasks that are incomplete
-    and pushes this new sequence back onto the stack
+    and pushes this sequence back onto the stack
 
 This is essentially applies a filter to a sequence of tasks to return only
-those which are incomplete.
+those which are incomplete. The complete tasks are removed in place, so the
+sequence is only copied if something else shares it.
 */
 // -----------------------------------------------------------------------------
 static void EC_incomplete(gpointer gp_entry) {
     // Pop sequence
-    Param *param_seq = pop_param();
-    GSequence *seq = param_seq->val_custom;
+    Param param_seq;
+    if (!pop_object(&param_seq, &task_sequence_type)) return;
+    GSequence *seq = unshare_object(&param_seq);
 
-    // Gather incomplete tasks
-    GSequence *incomplete = g_sequence_new(g_free);
+    // Remove complete tasks
     GSequenceIter *iter = g_sequence_get_begin_iter(seq);
     while (!g_sequence_iter_is_end(iter)) {
         Task *task = g_sequence_get(iter);
+        GSequenceIter *next = g_sequence_iter_next(iter);
 
-        if (task && !task->is_done) {
-            g_sequence_append(incomplete, copy_task(task));
+        if (!task || task->is_done) {
+            g_sequence_remove(iter);
         }
-        iter = g_sequence_iter_next(iter);
+        iter = next;
     }
-    g_sequence_free(seq);
-    free_param(param_seq);
 
     // Push incomplete Tasks
-    Param *param_new = new_custom_param(incomplete, "[incomplete]");
-    push_param(param_new);
+    push_value(&param_seq);
+    clear_param(&param_seq);
 }
 
 
 
 // -----------------------------------------------------------------------------
 /** Pushes a sequence of all ancestors of *cur-task onto the stack.
+
+The ancestors are looked up in task_closure, from the top level task down to
+*cur-task. The sequence starts with the root task (NULL).
 */
 // -----------------------------------------------------------------------------
 static void EC_ancestors(gpointer gp_entry) {
-    GSequence *seq = g_sequence_new(g_free);
-    gchar parent_id_str[MAX_ID_LEN];
-
-    Task *cur_task = copy_task(get_cur_task());
-    while (cur_task) {
-        g_sequence_prepend(seq, cur_task);
-
-        // If parent is root...
-        if (!cur_task->parent_id) {
-            cur_task = NULL;
-            continue;
-        }
-
-        //...otherwise, look up parent
-        snprintf(parent_id_str, MAX_ID_LEN, "%ld", cur_task->parent_id);
-        gchar *sql_condition = g_strconcat("where id=", parent_id_str, NULL);
-        GSequence *records = select_tasks(sql_condition);
-        g_free(sql_condition);
-        cur_task = copy_task(g_sequence_get(g_sequence_get_begin_iter(records)));
+    GSequence *seq = NULL;
 
-        g_sequence_free(records);
+    gint64 cur_task_id = get_cur_task_id();
+    if (!cur_task_id) {
+        seq = g_sequence_new(g_free);
+    }
+    else {
+        seq = select_task_tree("select id, pc.parent, name, is_done, value from task_closure as c "
+                               "inner join tasks on id=c.ancestor "
+                               "inner join parent_child as pc on pc.child=id "
+                               "where c.descendant=?1 order by c.depth desc",
+                               cur_task_id);
     }
 
-    g_sequence_prepend(seq, cur_task);
-
-    Param *param_new = new_custom_param(seq, "[ancestors]");
-    push_param(param_new);
+    if (seq) g_sequence_prepend(seq, NULL);
+    push_tasks(seq);
 }
 
 
@@ -562,17 +778,10 @@ static void EC_ancestors(gpointer gp_entry) {
 */
 // -----------------------------------------------------------------------------
 static void EC_children(gpointer gp_entry) {
-    gchar parent_id_str[MAX_ID_LEN];
-
     gint64 parent_id = get_cur_task_id();
-    snprintf(parent_id_str, MAX_ID_LEN, "%ld", parent_id);
-
-    gchar *sql_condition = g_strconcat("where pc.parent=", parent_id_str, " order by id asc", NULL);
-    GSequence *seq = select_tasks(sql_condition);
-    g_free(sql_condition);
+    GSequence *seq = select_tasks_by_id("where pc.parent=?1 order by id asc", parent_id);
 
-    Param *param_new = new_custom_param(seq, "[children]");
-    push_param(param_new);
+    push_tasks(seq);
 }
 
 
@@ -582,9 +791,8 @@ static void EC_children(gpointer gp_entry) {
 */
 // -----------------------------------------------------------------------------
 static void EC_level_1(gpointer gp_entry) {
-    GSequence *seq = select_tasks("where pc.parent=0 order by id asc");
-    Param *param_new = new_custom_param(seq, "[level-1]");
-    push_param(param_new);
+    GSequence *seq = select_tasks("where pc.parent=0 order by id asc", NULL);
+    push_tasks(seq);
 }
 
 
@@ -596,13 +804,10 @@ static void EC_level_1(gpointer gp_entry) {
 static void EC_search(gpointer gp_entry) {
     Param *param_search = pop_param();
 
-    gchar *sql_condition = g_strconcat("where name like \"%", param_search->val_string, "%\"", NULL);
-    GSequence *seq = select_tasks(sql_condition);
-    g_free(sql_condition);
+    GSequence *seq = select_tasks("where name like '%' || ?1 || '%'", param_search);
     free_param(param_search);
 
-    Param *param_new = new_custom_param(seq, "[search:tasks]");
-    push_param(param_new);
+    push_tasks(seq);
 }
 
 
@@ -620,116 +825,264 @@ static void EC_link_note(gpointer gp_entry) {
     gint64 note_id = param_id->val_int;
     free_param(param_id);
 
-    gchar task_id_str[MAX_ID_LEN];
-    gchar note_id_str[MAX_ID_LEN];
+    sqlite3_stmt *stmt = prepare_statement(get_db_connection(), "insert into task_notes(task, note) values(?1, ?2)");
+    if (!stmt) return;
 
-    snprintf(task_id_str, MAX_ID_LEN, "%ld", task_id);
-    snprintf(note_id_str, MAX_ID_LEN, "%ld", note_id);
-    gchar *sql = g_strconcat("insert into task_notes(task, note) ",
-                             "values(", task_id_str, ", ", note_id_str, ")", NULL);
+    sqlite3_bind_int64(stmt, 1, task_id);
+    sqlite3_bind_int64(stmt, 2, note_id);
+    step_statement(stmt, "link-note");
+}
 
-    char *error_message = NULL;
-    sqlite3 *connection = get_db_connection();
-    sqlite3_exec(connection, sql, NULL, NULL, &error_message);
-    g_free(sql);
 
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem executing 'link-note'\n----->%s", error_message);
+
+// -----------------------------------------------------------------------------
+/** Looks up all the notes associated with a task and pushes an array of their
+    ids onto the stack.
+
+TODO: Make this take an task ID
+*/
+// -----------------------------------------------------------------------------
+static void EC_task_note_ids(gpointer gp_entry) {
+    gint64 task_id = get_cur_task_id();
+    sqlite3_stmt *stmt = prepare_statement(get_db_connection(),
+                                           "select note from task_notes where task=?1 order by note asc");
+    if (!stmt) return;
+    sqlite3_bind_int64(stmt, 1, task_id);
+
+    GArray *note_ids = g_array_new(FALSE, TRUE, sizeof(gint64));
+    gint status;
+    while ((status = step_statement(stmt, "task-note_ids")) == 1) {
+        gint64 id = sqlite3_column_int64(stmt, 0);
+        g_array_append_val(note_ids, id);
+    }
+    if (status < 0) {
+        g_array_free(note_ids, TRUE);
+        return;
     }
+
+    // Push the IDs as an array of ints
+    Array *array = new_array('I', note_ids->len);
+    memcpy(array->ints, note_ids->data, sizeof(gint64) * note_ids->len);
+    g_array_free(note_ids, TRUE);
+    push_array(array);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Callback to append a note ID onto an array.
+/** Sets *cur-task to NULL, effectively freeing its memory.
+*/
+// -----------------------------------------------------------------------------
+static void EC_reset(gpointer gp_entry) {
+    set_cur_task(NULL);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Moves a task to a new parent.
+
+(child parent -- )
+
+The parent_child record and the task_closure rows of the child's subtree are
+updated in one transaction. A task can't be moved under itself or one of its
+descendants.
 */
 // -----------------------------------------------------------------------------
-static int append_note_id_cb(gpointer gp_note_ids, int num_cols, char **values, char **cols) {
-    GArray *note_ids = gp_note_ids;
+static void EC_move(gpointer gp_entry) {
+    Param *param_parent = pop_param();
+    Param *param_child = pop_param();
+    gint64 parent_id = param_parent->val_int;
+    gint64 child_id = param_child->val_int;
+    free_param(param_parent);
+    free_param(param_child);
 
-    if (num_cols != 1) {
+    gboolean is_cycle;
+    if (!is_ancestor(child_id, parent_id, &is_cycle)) return;
+    if (is_cycle || child_id == 0) {
         handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Unexpected num cols from task_notes query\n");
-        return 1;
+        fprintf(stderr, "-----> Can't move task %ld under task %ld\n", child_id, parent_id);
+        return;
     }
 
-    gint64 id = g_ascii_strtoll(values[0], NULL, 10);
+    sqlite3 *connection = get_closure_connection();
+    if (!run_sql(connection, "begin immediate")) return;
+
+    // Detach the subtree from its old ancestors...
+    sqlite3_stmt *stmt = prepare_statement(connection,
+                                           "delete from task_closure "
+                                           "where descendant in (select descendant from task_closure where ancestor=?1) "
+                                           "and ancestor not in (select descendant from task_closure where ancestor=?1)");
+    if (!stmt) goto done;
+    sqlite3_bind_int64(stmt, 1, child_id);
+    if (step_statement(stmt, "m") < 0) goto done;
+
+    // ...and attach it under each of the new parent's ancestors
+    stmt = prepare_statement(connection,
+                             "insert into task_closure(ancestor, descendant, depth) "
+                             "select super.ancestor, sub.descendant, super.depth + sub.depth + 1 "
+                             "from task_closure as super cross join task_closure as sub "
+                             "where super.descendant=?2 and sub.ancestor=?1");
+    if (!stmt) goto done;
+    sqlite3_bind_int64(stmt, 1, child_id);
+    sqlite3_bind_int64(stmt, 2, parent_id);
+    if (step_statement(stmt, "m") < 0) goto done;
+
+    stmt = prepare_statement(connection, "update parent_child set parent=?1 where child=?2");
+    if (!stmt) goto done;
+    sqlite3_bind_int64(stmt, 1, parent_id);
+    sqlite3_bind_int64(stmt, 2, child_id);
+    if (step_statement(stmt, "m") < 0) goto done;
+
+    end_transaction(connection, 1);
+    return;
 
-    g_array_append_val(note_ids, id);
-    return 0;
+done:
+    end_transaction(connection, 0);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Looks up all the notes associated with a task and pushes a GArray of their
-    ids onto the stack.
+/** Deletes a task along with all of its descendants.
 
-TODO: Make this take an task ID
+(id -- )
+
+The tasks, their parent_child, task_notes, and task_closure records are deleted
+in one transaction. If *cur-task was deleted, the root becomes the current task.
 */
 // -----------------------------------------------------------------------------
-static void EC_task_note_ids(gpointer gp_entry) {
-    gint64 task_id = get_cur_task_id();
-    gchar id_str[MAX_ID_LEN];
-    snprintf(id_str, MAX_ID_LEN, "%ld", task_id);
-    gchar *sql = g_strconcat("select note from task_notes where task=", id_str, " order by note asc ", NULL);
-
-    char *error_message = NULL;
-    GArray *note_ids = g_array_new(FALSE, TRUE, sizeof(gint64));
-    sqlite3 *connection = get_db_connection();
-    sqlite3_exec(connection, sql, append_note_id_cb, note_ids, &error_message);
-    g_free(sql);
+static void EC_delete(gpointer gp_entry) {
+    Param *param_id = pop_param();
+    gint64 task_id = param_id->val_int;
+    free_param(param_id);
 
-    if (error_message) {
+    if (task_id <= 0) {
         handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem executing 'task_note_ids'\n----->%s", error_message);
+        fprintf(stderr, "-----> Can't delete task %ld\n", task_id);
+        return;
+    }
+
+    gboolean is_cur_task_deleted;
+    if (!is_ancestor(task_id, get_cur_task_id(), &is_cur_task_deleted)) return;
+
+    // task_closure is used to find the subtree, so its rows are deleted last
+    static const gchar *sqls[] = {
+        "delete from task_notes where task in (select descendant from task_closure where ancestor=?1)",
+        "delete from tasks where id in (select descendant from task_closure where ancestor=?1)",
+        "delete from parent_child where child in (select descendant from task_closure where ancestor=?1)",
+        "delete from task_closure where descendant in (select descendant from task_closure where ancestor=?1)",
+    };
+
+    sqlite3 *connection = get_closure_connection();
+    if (!run_sql(connection, "begin immediate")) return;
+
+    gboolean is_ok = 1;
+    for (guint i=0; is_ok && i < G_N_ELEMENTS(sqls); i++) {
+        sqlite3_stmt *stmt = prepare_statement(connection, sqls[i]);
+        is_ok = stmt != NULL;
+        if (!is_ok) break;
+
+        sqlite3_bind_int64(stmt, 1, task_id);
+        is_ok = step_statement(stmt, "delete") >= 0;
     }
 
-    Param *param_new = new_custom_param(note_ids, "Array[note_ids]");
-    push_param(param_new);
+    if (end_transaction(connection, is_ok) && is_cur_task_deleted) set_cur_task(NULL);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Sets *cur-task to NULL, effectively freeing its memory.
+/** Pops a task ID and pushes its depth (1 for a top level task)
+
+(id -- depth)
+
+The root task is at depth 0. An unknown task is at depth -1.
 */
 // -----------------------------------------------------------------------------
-static void EC_reset(gpointer gp_entry) {
-    set_cur_task(NULL);
+static void EC_task_depth(gpointer gp_entry) {
+    Param *param_id = pop_param();
+    gint64 task_id = param_id->val_int;
+    free_param(param_id);
+
+    sqlite3_stmt *stmt = prepare_statement(get_closure_connection(),
+                                           "select depth from task_closure where ancestor=0 and descendant=?1");
+    if (!stmt) return;
+
+    sqlite3_bind_int64(stmt, 1, task_id);
+    gint status = step_statement(stmt, "task-depth");
+    if (status < 0) return;
+
+    gint64 depth = status == 1 ? sqlite3_column_int64(stmt, 0) : -1;
+    sqlite3_reset(stmt);
+    push_param(new_int_param(depth));
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Moves a task to a new parent.
+/** Checks if a task is an ancestor of another (see is_ancestor)
 
-(child parent -- )
+(ancestor-id id -- flag)
+
+A task counts as its own ancestor, and the root task (0) is an ancestor of
+every task.
 */
 // -----------------------------------------------------------------------------
-static void EC_move(gpointer gp_entry) {
-    Param *param_parent = pop_param();
-    Param *param_child = pop_param();
+static void EC_is_ancestor(gpointer gp_entry) {
+    Param *param_id = pop_param();
+    Param *param_ancestor_id = pop_param();
+    gint64 task_id = param_id->val_int;
+    gint64 ancestor_id = param_ancestor_id->val_int;
+    free_param(param_id);
+    free_param(param_ancestor_id);
 
-    gchar parent_id_str[MAX_ID_LEN];
-    gchar child_id_str[MAX_ID_LEN];
-    snprintf(parent_id_str, MAX_ID_LEN, "%ld", param_parent->val_int);
-    snprintf(child_id_str, MAX_ID_LEN, "%ld", param_child->val_int);
-    gchar *sql = g_strconcat("update parent_child set parent=", parent_id_str, " where child=", child_id_str, NULL);
+    gboolean result;
+    if (!is_ancestor(ancestor_id, task_id, &result)) return;
+    push_param(new_int_param(result));
+}
 
-    sqlite3 *connection = get_db_connection();
-    char *error_message = NULL;
-    sqlite3_exec(connection, sql, NULL, NULL, &error_message);
-    g_free(sql);
 
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem executing 'move'\n----->%s", error_message);
-    }
 
-    free_param(param_parent);
-    free_param(param_child);
+// -----------------------------------------------------------------------------
+/** Makes task_closure again from parent_child (e.g., after it was edited outside
+    of this lexicon).
+*/
+// -----------------------------------------------------------------------------
+static void EC_rebuild_closure(gpointer gp_entry) {
+    sqlite3 *connection = get_closure_connection();
+    if (connection) rebuild_closure(connection);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Checks task_closure against parent_child and pushes 1 if they agree.
+
+( -- flag)
+
+If they don't, the number of missing and extra rows is printed.
+*/
+// -----------------------------------------------------------------------------
+static void EC_verify_closure(gpointer gp_entry) {
+    sqlite3_stmt *stmt = prepare_statement(get_closure_connection(),
+                                           CLOSURE_PATHS_CTE
+                                           "select "
+                                           "(select count(*) from (select * from expected "
+                                           "                       except select * from task_closure)), "
+                                           "(select count(*) from (select * from task_closure "
+                                           "                       except select * from expected))");
+    if (!stmt) return;
+    if (step_statement(stmt, "verify-closure") < 0) return;
+
+    gint64 num_missing = sqlite3_column_int64(stmt, 0);
+    gint64 num_extra = sqlite3_column_int64(stmt, 1);
+    sqlite3_reset(stmt);
+
+    if (num_missing || num_extra) {
+        printf("task_closure has %ld missing and %ld extra rows (see rebuild-closure)\n", num_missing, num_extra);
+    }
+    push_param(new_int_param(num_missing == 0 && num_extra == 0));
 }
 
 
@@ -755,16 +1108,15 @@ EC_DB_STR_GETTER(EC_get_name, "name", "tasks", "name")
 */
 // -----------------------------------------------------------------------------
 static void EC_last_active_id(gpointer gp_entry) {
-    gint64 task_id;
+    sqlite3_stmt *stmt = prepare_statement(get_db_connection(), "select task from task_notes order by note desc limit 1");
+    if (!stmt) return;
 
-    char *error_message = NULL;
-    sqlite3 *connection = get_db_connection();
-    sqlite3_exec(connection, "select task from task_notes order by note desc limit 1", set_int_cb, &task_id, &error_message);
+    gint64 task_id = 0;
+    gint status = step_statement(stmt, "last-active-id");
+    if (status < 0) return;
+    if (status == 1) task_id = sqlite3_column_int64(stmt, 0);
+    sqlite3_reset(stmt);
 
-    if (error_message) {
-        handle_error(ERR_GENERIC_ERROR);
-        fprintf(stderr, "-----> Problem executing 'last-active-id'\n----->%s", error_message);
-    }
     push_param(new_int_param(task_id));
 }
 
@@ -839,9 +1191,9 @@ gint compare_task_order(gconstpointer l, gconstpointer r, gpointer gp_task_order
 */
 // -----------------------------------------------------------------------------
 static void EC_print_task_hierarchy(gpointer gp_entry) {
-    Param *param_seq = pop_param();
-
-    GSequence *seq = param_seq->val_custom;
+    Param param_seq;
+    GSequence *seq = pop_object(&param_seq, &task_sequence_type);
+    if (!seq) return;
 
     GHashTable *task_hash = g_hash_table_new(g_direct_hash, g_direct_equal);
     GHashTable *parent_children = g_hash_table_new(g_direct_hash, g_direct_equal);
@@ -915,12 +1267,11 @@ static void EC_print_task_hierarchy(gpointer gp_entry) {
     // Clean up
     // ---------------------------------
     g_hash_table_foreach(parent_children, free_hash_sequence_value, NULL);
-    g_sequence_free(seq);
 
     g_sequence_free(root_tasks);
     g_sequence_free(non_root_tasks);
 
-    free_param(param_seq);
+    clear_param(&param_seq);
     g_hash_table_destroy(parent_children);
     g_hash_table_destroy(task_hash);
     g_hash_table_destroy(task_order);
@@ -932,49 +1283,44 @@ static void EC_print_task_hierarchy(gpointer gp_entry) {
 /** Pops a task ID and pushes a sequence of tasks in its hierarchy
 
 (task-id -- seq)
+
+The task and everything under it are looked up in task_closure, level by level.
 */
 // -----------------------------------------------------------------------------
 static void EC_hierarchy(gpointer gp_entry) {
     Param *param_task_id = pop_param();
 
-    gchar id_str[MAX_ID_LEN];
-    snprintf(id_str, MAX_ID_LEN, "%ld", param_task_id->val_int);
-    gchar *condition = g_strconcat("where id=", id_str, NULL);
-
-    GQueue *queue = g_queue_new();
-    GSequence *tasks = select_tasks(condition);
-    g_free(condition);
+    GSequence *tasks = select_task_tree("select id, pc.parent, name, is_done, value from task_closure as c "
+                                        "inner join tasks on id=c.descendant "
+                                        "inner join parent_child as pc on pc.child=id "
+                                        "where c.ancestor=?1 and ?1 != 0 order by c.depth asc, id asc",
+                                        param_task_id->val_int);
+    push_tasks(tasks);
 
-    if (g_sequence_get_length(tasks) == 0) goto done;
+    free_param(param_task_id);
+}
 
-    // Add first task to queue and then do BFS
-    g_queue_push_tail(queue, g_sequence_get(g_sequence_get_begin_iter(tasks)));
 
-    while (!g_queue_is_empty(queue)) {
-        Task *task = g_queue_pop_tail(queue);
 
-        // Select all children of this task
-        snprintf(id_str, MAX_ID_LEN, "%ld", task->id);
-        condition = g_strconcat("where pc.parent=", id_str, NULL);
-        GSequence *subtasks = select_tasks(condition);
-        g_free(condition);
+// -----------------------------------------------------------------------------
+/** Pops a task ID and pushes a sequence of all tasks under it (not including it)
 
-        for (GSequenceIter *iter=g_sequence_get_begin_iter(subtasks);
-             !g_sequence_iter_is_end(iter);
-             iter = g_sequence_iter_next(iter)) {
+(task-id -- seq)
 
-             Task *subtask = copy_task(g_sequence_get(iter));
-             g_sequence_append(tasks, subtask);  // The 'tasks' sequence is responsible for freeing 'subtask'
-             g_queue_push_tail(queue, subtask);
-        }
-        g_sequence_free(subtasks);
-    }
+Like hierarchy, this is one lookup in task_closure. The ID may be 0 (the root)
+to get every task.
+*/
+// -----------------------------------------------------------------------------
+static void EC_descendants_of(gpointer gp_entry) {
+    Param *param_task_id = pop_param();
 
-    push_param(new_custom_param(tasks, "[tasks]"));
+    GSequence *tasks = select_task_tree("select id, pc.parent, name, is_done, value from task_closure as c "
+                                        "inner join tasks on id=c.descendant "
+                                        "inner join parent_child as pc on pc.child=id "
+                                        "where c.ancestor=?1 and c.depth > 0 order by c.depth asc, id asc",
+                                        param_task_id->val_int);
+    push_tasks(tasks);
 
-done:
-    // Cleanup
-    g_queue_free(queue);
     free_param(param_task_id);
 }
 
@@ -983,12 +1329,16 @@ done:
 // -----------------------------------------------------------------------------
 /** Defines the tasks lexicon.
 
-The following words are defined for manipulating Tasks:
+The following words are defined for manipulating Tasks (in the "tasks" wordlist):
 
 ### Add tasks
 - + (string -- ) Creates a task that's the sibling of *cur-task (or a child if *cur-task is root)
 - ++ (string -- ) Creates a subtask of *cur-task
 
+"+" shadows the arithmetic "+" of the forth wordlist, so once this lexicon is
+loaded, numbers are added with "forth:+". Passing "+" anything but a string is
+reported as an invalid param.
+
 ### Set cur-task
 - d ( -- ) Makes the first child of *cur-task the new *cur-task
 - u ( -- ) Makes the parent of *cur-task the new *cur-task
@@ -1009,6 +1359,7 @@ The following words are defined for manipulating Tasks:
 - name (id -- value) Pops task id and pushes name of task
 - name! (id str -- value) Sets name of task with ID
 - m (id parent-id -- ) Updates parent of task
+- delete (id -- ) Deletes a task and all tasks descended from it
 
 ### Selecting seq of Tasks
 - [cur-task] ( -- seq) Pushes current task as a task sequence
@@ -1017,11 +1368,18 @@ The following words are defined for manipulating Tasks:
 - ancestors ( -- seq) Pushes ancestors of cur-task
 - children ( -- seq) Pushes children of cur-task
 - level-1 ( -- seq) Pushes all top level tasks
-- hierarchy (task-id -- seq) Pops task ID and pushes a seq of all tasks descended from it
+- hierarchy (task-id -- seq) Pops task ID and pushes a seq of the task and all tasks descended from it
+- descendants-of (task-id -- seq) Pops task ID and pushes a seq of all tasks descended from it
 - search (str -- seq) Pushes all tasks whose name matches the string
 
+### Task hierarchy (see task_closure)
+- task-depth (id -- depth) Pushes the depth of a task (1 for a top level task)
+- is-ancestor (ancestor-id id -- flag) Pushes 1 if a task is (or is under) another
+- rebuild-closure ( -- ) Makes task_closure again from parent_child
+- verify-closure ( -- flag) Pushes 1 if task_closure agrees with parent_child
+
 ### Task/Note integration
-- task-note-ids ( -- seq) Pushes all IDs of notes associated with current task
+- task-note-ids ( -- array) Pushes all IDs of notes associated with current task
 - link-note (note-id -- ) Connects the current task with the specified note
 
 ### Task sequence filters
@@ -1043,10 +1401,15 @@ void EC_add_tasks_lexicon(gpointer gp_entry) {
     execute_string("lex-sequence");
     execute_string("lex-sqlite");
 
+    Wordlist *previous = set_current_wordlist(add_wordlist("tasks"));
+
     add_variable("tasks-db");
+    init_variable_ref(&_tasks_db_ref, "tasks-db");
+    add_close_hook(forget_closure_connection);
 
     // Holds the current task
     add_variable("*cur-task");
+    init_variable_ref(&_cur_task_ref, "*cur-task");
     set_cur_task(NULL);
 
     add_entry("+")->routine = EC_add_task;
@@ -1062,6 +1425,10 @@ void EC_add_tasks_lexicon(gpointer gp_entry) {
     add_entry("task_value")->routine = EC_get_task_value;
     add_entry("task_is-done")->routine = EC_get_task_is_done;
     add_entry("task_name")->routine = EC_get_task_name;
+    add_field_getter(EC_get_task_id, "Task", G_STRUCT_OFFSET(Task, id), FIELD_INT64);
+    add_field_getter(EC_get_task_value, "Task", G_STRUCT_OFFSET(Task, value), FIELD_DOUBLE);
+    add_field_getter(EC_get_task_is_done, "Task", G_STRUCT_OFFSET(Task, is_done), FIELD_INT);
+    add_field_getter(EC_get_task_name, "Task", G_STRUCT_OFFSET(Task, name), FIELD_CHARS);
 
     add_entry("value")->routine = EC_get_value;
     add_entry("value!")->routine = EC_set_value;
@@ -1070,6 +1437,7 @@ void EC_add_tasks_lexicon(gpointer gp_entry) {
     add_entry("name")->routine = EC_get_name;
     add_entry("name!")->routine = EC_set_name;
     add_entry("m")->routine = EC_move;
+    add_entry("delete")->routine = EC_delete;
 
     add_entry("[cur-task]")->routine = EC_seq_cur_task;
 
@@ -1091,6 +1459,13 @@ void EC_add_tasks_lexicon(gpointer gp_entry) {
 
     // TODO: Consider moving this to a "graph" lexicon
     add_entry("hierarchy")->routine = EC_hierarchy;
+    add_entry("descendants-of")->routine = EC_descendants_of;
+    add_entry("task-depth")->routine = EC_task_depth;
+    add_entry("is-ancestor")->routine = EC_is_ancestor;
+    add_entry("rebuild-closure")->routine = EC_rebuild_closure;
+    add_entry("verify-closure")->routine = EC_verify_closure;
 
     add_entry("reset")->routine = EC_reset;
+
+    set_current_wordlist(previous);
 }
@@ -0,0 +1,704 @@
+/** \file fuse.c
+
+\brief Fuses hot sequences of Instructions into superinstructions.
+
+Most of the time spent running a definition like
+
+    : refresh-cur-task  *cur-task @ task_id g ;
+
+goes to dispatching each Instruction separately. Sequences like
+"*cur-task @ task_id" and "notes-db @ sqlite3-last-id" show up over and over.
+
+When "profile-on" is in effect, EC_execute reports each dispatch to
+profile_dispatch, which counts how often each Instruction is immediately
+followed by the next one or two in its definition. "fuse" then takes the
+sequences that ran at least a given number of times and rewrites every
+definition that contains them so that the first Instruction of the sequence
+runs the whole sequence in a single dispatch. The rest of the sequence is left
+in place (and skipped) so branch targets don't move.
+
+A variable push followed by "@" is special cased: the fused Instruction pushes
+the variable's value directly instead of pushing the variable's address and
+popping it again. When a word that uses the value comes right after, that's
+specialized too:
+
+- A field getter (e.g., "*cur-task @ task_id"): the field is read straight
+  from the variable's value (see get_field)
+- A word with an operand form (e.g., "notes-db @ sqlite3-last-id"): the
+  variable's value is passed to the operand form instead of being pushed and
+  popped again (see add_operand_form)
+
+Likewise, a literal followed by a word with an operand form anywhere in a
+sequence (e.g., all "task_value" descending) passes the literal straight to the
+operand form.
+
+Only Instructions that can't change the flow of control are fused: literals
+and calls (including quickened ones) to anything other than a definition. A
+sequence that contains a branch target after its first Instruction is never
+fused. If an Instruction in a fused sequence hits an error, the rest of the
+sequence is skipped.
+
+".fusions" reports each fusion with the number of sites it was applied to and
+the number of dispatches it has removed. "unfuse" restores the original code.
+*/
+
+#define MAX_FUSION_LEN  3   /**< \brief Longest sequence that is fused */
+
+
+/** \brief A fused sequence of Instructions and where it has been applied
+*/
+typedef struct {
+    gchar *name;                /**< \brief Words in the sequence (for reporting) */
+    guint length;               /**< \brief Number of Instructions in the sequence */
+    guint64 num_profiled;       /**< \brief Number of times the sequence ran while profiling */
+    guint64 num_runs;           /**< \brief Number of times the fused sequence has run */
+    GPtrArray *sites;           /**< \brief Superinstructions that run the sequence */
+} Fusion;
+
+
+/** \brief Replaces the first Instruction of a fused sequence
+*/
+struct _Superinstruction {
+    Instruction first;          /**< \brief Original first Instruction */
+    Instruction *site;          /**< \brief Instruction that was replaced */
+    Fusion *fusion;             /**< \brief Sequence this runs */
+    routine_ptr routine;        /**< \brief Routine of the word using a fetched value (NULL if none) */
+    operand_routine_ptr operand_form;  /**< \brief Operand form run instead of pushing a value or literal (NULL if none) */
+    guint literal_step;         /**< \brief Step of the literal passed to operand_form (for IC_fused_literal) */
+};
+
+
+/** \brief How often an Instruction was followed by the next ones while profiling
+*/
+typedef struct {
+    guint64 num_pairs;          /**< \brief Times the next Instruction ran right after this one */
+    guint64 num_triples;        /**< \brief Times the next two Instructions ran right after this one */
+} DispatchCount;
+
+
+// -----------------------------------------------------------------------------
+/** Registers a form of a routine that takes its top input as an argument.
+
+\param routine: Routine of a native word
+\param operand_form: Does what the routine does with the given param as its top
+                     input instead of popping it (the param isn't released)
+
+Fused sequences that push a variable's value or a literal right before calling
+the routine run the operand form instead (see specialize_fusion).
+*/
+// -----------------------------------------------------------------------------
+void add_operand_form(routine_ptr routine, operand_routine_ptr operand_form) {
+    if (!_operand_forms) {
+        _operand_forms = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    g_hash_table_replace(_operand_forms, (gpointer) routine, (gpointer) operand_form);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the operand form of the word an Instruction calls (NULL if none).
+*/
+// -----------------------------------------------------------------------------
+static operand_routine_ptr find_operand_form(const Instruction *instruction) {
+    if (!_operand_forms || instruction->code == IC_push_literal) return NULL;
+    return g_hash_table_lookup(_operand_forms, (gpointer) instruction->operand.entry->routine);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Records the dispatch of an Instruction while profiling.
+
+This is called by EC_execute before each Instruction is run.
+*/
+// -----------------------------------------------------------------------------
+void profile_dispatch(Instruction *instruction) {
+    Instruction *last = _dispatch_history[0];
+    Instruction *before_last = _dispatch_history[1];
+
+    if (last && instruction == last + 1) {
+        if (!_dispatch_counts) {
+            _dispatch_counts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+        }
+
+        DispatchCount *count = g_hash_table_lookup(_dispatch_counts, last);
+        if (!count) {
+            count = g_new0(DispatchCount, 1);
+            g_hash_table_insert(_dispatch_counts, last, count);
+        }
+        count->num_pairs++;
+
+        if (before_last && last == before_last + 1) {
+            DispatchCount *before_count = g_hash_table_lookup(_dispatch_counts, before_last);
+            if (before_count) before_count->num_triples++;
+        }
+    }
+
+    _dispatch_history[1] = last;
+    _dispatch_history[0] = instruction;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the Instruction that a fused Instruction replaced.
+
+Any other Instruction is returned as is.
+*/
+// -----------------------------------------------------------------------------
+const Instruction *unfused_instruction(const Instruction *instruction) {
+    if (instruction->code == IC_fused || instruction->code == IC_fused_fetch ||
+        instruction->code == IC_fused_fetch_field || instruction->code == IC_fused_fetch_operand ||
+        instruction->code == IC_fused_literal) {
+        return &instruction->operand.fused->first;
+    }
+    return instruction;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs the Instructions of a fused sequence starting with the given step.
+
+If a step hits an error (i.e., _ip is NULL), the remaining steps are skipped.
+*/
+// -----------------------------------------------------------------------------
+static void run_fused_steps(Instruction *instruction, guint first_step) {
+    Superinstruction *fused = instruction->operand.fused;
+    guint length = fused->fusion->length;
+
+    fused->fusion->num_runs++;
+
+    for (guint i=first_step; i < length; i++) {
+        Instruction *step = i == 0 ? &fused->first : instruction + i;
+        step->code(step);
+        if (!_ip) return;
+    }
+
+    _ip = instruction + length;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a fused sequence of Instructions in one dispatch.
+*/
+// -----------------------------------------------------------------------------
+void IC_fused(Instruction *instruction) {
+    run_fused_steps(instruction, 0);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a fused sequence that starts with a variable followed by "@".
+
+The variable's value is pushed directly instead of going through its address.
+*/
+// -----------------------------------------------------------------------------
+void IC_fused_fetch(Instruction *instruction) {
+    Entry *entry_var = instruction->operand.fused->first.operand.entry;
+    push_value(entry_var->value);
+    run_fused_steps(instruction, 2);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a fused sequence of a variable, "@", and a field getter.
+
+The field is read from the variable's value directly. If the value isn't an
+object the getter knows, the getter is run as usual.
+*/
+// -----------------------------------------------------------------------------
+void IC_fused_fetch_field(Instruction *instruction) {
+    Superinstruction *fused = instruction->operand.fused;
+    const Param *value = fused->first.operand.entry->value;
+    push_value(value);
+
+    Param field;
+    if (!get_field(fused->routine, value, &field)) {
+        run_fused_steps(instruction, 2);
+        return;
+    }
+
+    push_value(&field);
+    clear_param(&field);
+    run_fused_steps(instruction, 3);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a fused sequence of a variable, "@", and a word with an operand form.
+
+The variable's value is passed to the operand form without being pushed.
+*/
+// -----------------------------------------------------------------------------
+void IC_fused_fetch_operand(Instruction *instruction) {
+    Superinstruction *fused = instruction->operand.fused;
+    fused->operand_form(fused->first.operand.entry->value);
+    if (!_ip) return;
+
+    run_fused_steps(instruction, 3);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a fused sequence containing a literal and a word with an operand form.
+
+The steps before the literal are run as usual. The literal is then passed to
+the operand form without being pushed.
+*/
+// -----------------------------------------------------------------------------
+void IC_fused_literal(Instruction *instruction) {
+    Superinstruction *fused = instruction->operand.fused;
+    guint literal_step = fused->literal_step;
+
+    for (guint i=0; i < literal_step; i++) {
+        Instruction *step = i == 0 ? &fused->first : instruction + i;
+        step->code(step);
+        if (!_ip) return;
+    }
+
+    const Instruction *literal = literal_step == 0 ? &fused->first : instruction + literal_step;
+    fused->operand_form(literal->operand.param);
+    if (!_ip) return;
+
+    run_fused_steps(instruction, literal_step + 2);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if an Instruction can be part of a fused sequence.
+*/
+// -----------------------------------------------------------------------------
+static gboolean is_fusable(const Instruction *instruction) {
+    if (instruction->code == IC_push_literal) return 1;
+    if (instruction->code == IC_call || is_quickened_call(instruction)) {
+        return instruction->operand.entry->routine != EC_execute;
+    }
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if a sequence of Instructions in a definition can be fused.
+
+\param targets: Notes which Instructions of the definition are branched to
+*/
+// -----------------------------------------------------------------------------
+static gboolean can_fuse(Instruction *code, gint index, guint length, gint num_instructions, const gboolean *targets) {
+    if (index + (gint) length > num_instructions) return 0;
+
+    for (guint i=0; i < length; i++) {
+        if (!is_fusable(code + index + i)) return 0;
+        if (i > 0 && targets[index + i]) return 0;
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns a key identifying the sequence of Instructions at the given address.
+
+Calls are identified by their Entry and literals by their type, so the same
+fusion applies to a sequence no matter what its literals are.
+*/
+// -----------------------------------------------------------------------------
+static gchar *sequence_key(const Instruction *instruction, guint length) {
+    GString *result = g_string_new(NULL);
+    for (guint i=0; i < length; i++) {
+        if (instruction[i].code == IC_push_literal) {
+            g_string_append_printf(result, "L%c ", instruction[i].operand.param->type);
+        }
+        else {
+            g_string_append_printf(result, "E%p ", (gpointer) instruction[i].operand.entry);
+        }
+    }
+    return g_string_free(result, FALSE);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the words in the sequence of Instructions at the given address.
+*/
+// -----------------------------------------------------------------------------
+static gchar *sequence_name(const Instruction *instruction, guint length) {
+    GString *result = g_string_new(NULL);
+    for (guint i=0; i < length; i++) {
+        if (i > 0) g_string_append_c(result, ' ');
+
+        if (instruction[i].code != IC_push_literal) {
+            g_string_append(result, instruction[i].operand.entry->word);
+            continue;
+        }
+
+        const Param *literal = instruction[i].operand.param;
+        switch (literal->type) {
+            case 'I':
+                g_string_append_printf(result, "%ld", literal->val_int);
+                break;
+
+            case 'D':
+                g_string_append_printf(result, "%lf", literal->val_double);
+                break;
+
+            case 'S':
+                g_string_append_printf(result, "\"%s\"", literal->val_string);
+                break;
+
+            default:
+                g_string_append_printf(result, "<%c>", literal->type);
+                break;
+        }
+    }
+    return g_string_free(result, FALSE);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns an array noting which Instructions of a definition are branched to.
+*/
+// -----------------------------------------------------------------------------
+static gboolean *find_branch_targets(Instruction *code, gint num_instructions) {
+    gboolean *result = g_new0(gboolean, num_instructions + 1);
+    for (gint i=0; i < num_instructions; i++) {
+        if (is_branch(code + i)) {
+            result[code[i].operand.target - code] = 1;
+        }
+    }
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees a Fusion and its Superinstructions.
+*/
+// -----------------------------------------------------------------------------
+static void free_fusion(gpointer gp_fusion) {
+    Fusion *fusion = gp_fusion;
+    g_free(fusion->name);
+    g_ptr_array_free(fusion->sites, TRUE);
+    g_free(fusion);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Notes the profiled sequences in a definition that ran at least min_count times.
+
+Sequences are chosen from left to right, preferring triples to pairs.
+*/
+// -----------------------------------------------------------------------------
+static void select_fusions(Entry *entry, guint64 min_count) {
+    gint num_instructions = 0;
+    while (entry->code[num_instructions].code) num_instructions++;
+    gboolean *targets = find_branch_targets(entry->code, num_instructions);
+
+    for (gint i=0; i < num_instructions; i++) {
+        DispatchCount *count = g_hash_table_lookup(_dispatch_counts, entry->code + i);
+        if (!count) continue;
+
+        guint length = 0;
+        guint64 num_profiled = 0;
+        if (count->num_triples >= min_count && can_fuse(entry->code, i, 3, num_instructions, targets)) {
+            length = 3;
+            num_profiled = count->num_triples;
+        }
+        else if (count->num_pairs >= min_count && can_fuse(entry->code, i, 2, num_instructions, targets)) {
+            length = 2;
+            num_profiled = count->num_pairs;
+        }
+        if (!length) continue;
+
+        gchar *key = sequence_key(entry->code + i, length);
+        Fusion *fusion = g_hash_table_lookup(_fusions, key);
+        if (!fusion) {
+            fusion = g_new0(Fusion, 1);
+            fusion->name = sequence_name(entry->code + i, length);
+            fusion->length = length;
+            fusion->sites = g_ptr_array_new_with_free_func(g_free);
+            g_hash_table_insert(_fusions, key, fusion);
+        }
+        else {
+            g_free(key);
+        }
+        fusion->num_profiled += num_profiled;
+
+        // Overlapping sequences can't both be fused
+        i += length - 1;
+    }
+
+    g_free(targets);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Picks the code of a fused Instruction.
+
+Sequences that hand a variable's value or a literal to the next word are
+specialized (see the top of this file); anything else runs its steps in turn.
+*/
+// -----------------------------------------------------------------------------
+static instruction_ptr specialize_fusion(Superinstruction *fused, guint length) {
+    const Instruction *instruction = fused->site;
+    fused->routine = NULL;
+    fused->operand_form = NULL;
+    fused->literal_step = 0;
+
+    gboolean is_fetch = instruction[0].code == IC_call &&
+                        instruction[0].operand.entry->value &&
+                        instruction[1].code != IC_push_literal &&
+                        instruction[1].operand.entry->routine == EC_fetch_variable_value;
+
+    if (!is_fetch) {
+        for (guint i=0; i + 1 < length; i++) {
+            if (instruction[i].code != IC_push_literal) continue;
+
+            fused->operand_form = find_operand_form(instruction + i + 1);
+            if (fused->operand_form) {
+                fused->literal_step = i;
+                return IC_fused_literal;
+            }
+        }
+        return IC_fused;
+    }
+    if (length < 3 || instruction[2].code == IC_push_literal) return IC_fused_fetch;
+
+    fused->routine = instruction[2].operand.entry->routine;
+    fused->operand_form = find_operand_form(instruction + 2);
+    if (fused->operand_form) return IC_fused_fetch_operand;
+    if (is_field_getter(fused->routine)) return IC_fused_fetch_field;
+    return IC_fused_fetch;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Rewrites every occurrence of a selected fusion in a definition.
+
+Longer sequences are tried first. Sequences don't overlap.
+*/
+// -----------------------------------------------------------------------------
+static void apply_fusions(Entry *entry) {
+    gint num_instructions = 0;
+    while (entry->code[num_instructions].code) num_instructions++;
+    gboolean *targets = find_branch_targets(entry->code, num_instructions);
+
+    for (gint i=0; i < num_instructions; i++) {
+        for (guint length=MAX_FUSION_LEN; length >= 2; length--) {
+            if (!can_fuse(entry->code, i, length, num_instructions, targets)) continue;
+
+            gchar *key = sequence_key(entry->code + i, length);
+            Fusion *fusion = g_hash_table_lookup(_fusions, key);
+            g_free(key);
+            if (!fusion) continue;
+
+            Instruction *instruction = entry->code + i;
+            Superinstruction *fused = g_new(Superinstruction, 1);
+            fused->first = *instruction;
+            fused->site = instruction;
+            fused->fusion = fusion;
+            g_ptr_array_add(fusion->sites, fused);
+
+            instruction->code = specialize_fusion(fused, length);
+            instruction->operand.fused = fused;
+
+            i += length - 1;
+            break;
+        }
+    }
+
+    g_free(targets);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Fuses the sequences that ran at least min_count times while profiling.
+
+Every definition containing one of these sequences is rewritten, whether or not
+that particular occurrence was hot.
+*/
+// -----------------------------------------------------------------------------
+void fuse_hot_sequences(guint64 min_count) {
+    if (!_dispatch_counts) return;
+
+    if (!_fusions) {
+        _fusions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_fusion);
+    }
+
+    for (GList *link = _dictionary; link; link = link->next) {
+        Entry *entry = link->data;
+        if (entry->routine == EC_execute && entry->code) select_fusions(entry, min_count);
+    }
+
+    for (GList *link = _dictionary; link; link = link->next) {
+        Entry *entry = link->data;
+        if (entry->routine == EC_execute && entry->code) apply_fusions(entry);
+    }
+
+    // A sequence chosen in one place may have been preempted everywhere
+    GHashTableIter iter;
+    gpointer gp_fusion;
+    g_hash_table_iter_init(&iter, _fusions);
+    while (g_hash_table_iter_next(&iter, NULL, &gp_fusion)) {
+        if (((Fusion *) gp_fusion)->sites->len == 0) g_hash_table_iter_remove(&iter);
+    }
+
+    // Addresses of fused Instructions will be dispatched differently now
+    g_hash_table_remove_all(_dispatch_counts);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Restores the original code of every fused Instruction.
+*/
+// -----------------------------------------------------------------------------
+void unfuse_all() {
+    if (!_fusions) return;
+
+    GHashTableIter iter;
+    gpointer gp_fusion;
+    g_hash_table_iter_init(&iter, _fusions);
+    while (g_hash_table_iter_next(&iter, NULL, &gp_fusion)) {
+        Fusion *fusion = gp_fusion;
+        for (guint i=0; i < fusion->sites->len; i++) {
+            Superinstruction *fused = g_ptr_array_index(fusion->sites, i);
+            *fused->site = fused->first;
+        }
+    }
+
+    g_hash_table_destroy(_fusions);
+    _fusions = NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Forgets all fusions and profile counts without touching any code.
+
+This is used when the code itself is about to be freed (see destroy_dictionary).
+*/
+// -----------------------------------------------------------------------------
+void clear_fusions() {
+    if (_fusions) {
+        g_hash_table_destroy(_fusions);
+        _fusions = NULL;
+    }
+
+    if (_dispatch_counts) {
+        g_hash_table_destroy(_dispatch_counts);
+        _dispatch_counts = NULL;
+    }
+
+    _dispatch_history[0] = NULL;
+    _dispatch_history[1] = NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints each fusion with its sites and the dispatches it has removed.
+*/
+// -----------------------------------------------------------------------------
+void print_fusions(FILE *file) {
+    if (!_fusions || g_hash_table_size(_fusions) == 0) {
+        fprintf(file, "No fusions\n");
+        return;
+    }
+
+    guint64 total_removed = 0;
+
+    GHashTableIter iter;
+    gpointer gp_fusion;
+    g_hash_table_iter_init(&iter, _fusions);
+    while (g_hash_table_iter_next(&iter, NULL, &gp_fusion)) {
+        Fusion *fusion = gp_fusion;
+        guint64 num_removed = fusion->num_runs * (fusion->length - 1);
+        total_removed += num_removed;
+
+        fprintf(file, "%s: sites %u, profiled %lu, runs %lu, dispatches removed %lu\n",
+                fusion->name, fusion->sites->len, fusion->num_profiled, fusion->num_runs, num_removed);
+    }
+
+    fprintf(file, "Total dispatches removed: %lu\n", total_removed);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Starts counting adjacent Instructions as they are dispatched.
+*/
+// -----------------------------------------------------------------------------
+void EC_profile_on(gpointer gp_entry) {
+    _profile_dispatch = 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Stops counting adjacent Instructions.
+*/
+// -----------------------------------------------------------------------------
+void EC_profile_off(gpointer gp_entry) {
+    _profile_dispatch = 0;
+    _dispatch_history[0] = NULL;
+    _dispatch_history[1] = NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Fuses the sequences that ran at least the given number of times.
+
+(min-count -- )
+*/
+// -----------------------------------------------------------------------------
+void EC_fuse(gpointer gp_entry) {
+    Param param_count;
+    if (!pop_value(&param_count)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    if (param_count.type != 'I' || param_count.val_int < 1) {
+        handle_error(ERR_INVALID_PARAM);
+        fprintf(stderr, "-----> 'fuse' needs a positive count\n");
+        clear_param(&param_count);
+        return;
+    }
+
+    fuse_hot_sequences(param_count.val_int);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Restores the original code of all fused definitions.
+*/
+// -----------------------------------------------------------------------------
+void EC_unfuse(gpointer gp_entry) {
+    unfuse_all();
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints the fusions that have been applied.
+*/
+// -----------------------------------------------------------------------------
+void EC_print_fusions(gpointer gp_entry) {
+    print_fusions(stdout);
+}
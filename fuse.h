@@ -0,0 +1,26 @@
+/** \file fuse.h
+*/
+
+#pragma once
+
+typedef void (*operand_routine_ptr)(const Param *operand);  /**< \brief Function pointer type for operand forms (see add_operand_form) */
+
+void add_operand_form(routine_ptr routine, operand_routine_ptr operand_form);
+void profile_dispatch(Instruction *instruction);
+const Instruction *unfused_instruction(const Instruction *instruction);
+void fuse_hot_sequences(guint64 min_count);
+void unfuse_all();
+void clear_fusions();
+void print_fusions(FILE *file);
+
+void IC_fused(Instruction *instruction);
+void IC_fused_fetch(Instruction *instruction);
+void IC_fused_fetch_field(Instruction *instruction);
+void IC_fused_fetch_operand(Instruction *instruction);
+void IC_fused_literal(Instruction *instruction);
+
+void EC_profile_on(gpointer gp_entry);
+void EC_profile_off(gpointer gp_entry);
+void EC_fuse(gpointer gp_entry);
+void EC_unfuse(gpointer gp_entry);
+void EC_print_fusions(gpointer gp_entry);
@@ -11,9 +11,27 @@ _stack, and _return_stack.
 // Globals
 // =============================================================================
 
-GList *_dictionary = NULL;      /**< \brief Global Forth dictionary */
-GQueue *_stack = NULL;          /**< \brief Global Param stack */
-GQueue *_return_stack = NULL;   /**< \brief Global return stack */
+GList *_dictionary = NULL;      /**< \brief Global Forth dictionary (newest Entry first) */
+GHashTable *_dictionary_index = NULL;  /**< \brief Maps a word to its newest Entry */
+Entry *_latest_entry = NULL;    /**< \brief Most recently added Entry */
+GList *_wordlists = NULL;       /**< \brief All Wordlists in the order they were created */
+Wordlist *_current_wordlist = NULL;  /**< \brief Wordlist that add_entry adds to */
+GArray *_stack = NULL;          /**< \brief Global Param stack (array of Param values) */
+GArray *_array_marks = NULL;    /**< \brief Stack depths where open array literals start (see EC_open_array) */
+Pool _param_pool = {.name = "param"};  /**< \brief Allocates Param objects */
+Pool _entry_pool = {.name = "entry"};  /**< \brief Allocates Entry objects (including pseudo entries) */
+gboolean _release_transients = 0;  /**< \brief Set by handle_error so the control loop frees abandoned Params */
+Arena _arena;                   /**< \brief Scratch memory for the current command */
+Frame *_return_stack = NULL;    /**< \brief Global return stack */
+guint _return_stack_depth = 0;  /**< \brief Number of frames on the return stack */
+guint _return_stack_size = 0;   /**< \brief Number of frames allocated for the return stack */
+Param *_locals = NULL;          /**< \brief Slots for the locals of the Frames on the return stack */
+guint _locals_depth = 0;        /**< \brief Number of slots in use */
+guint _locals_size = 0;         /**< \brief Number of slots allocated */
+GPtrArray *_compile_locals = NULL;  /**< \brief Names of the locals of the definition being compiled */
+Loop *_loops = NULL;            /**< \brief Counted loops running in the Frames on the return stack */
+guint _loops_depth = 0;         /**< \brief Number of loops running */
+guint _loops_size = 0;          /**< \brief Number of Loops allocated */
 jmp_buf _error_jmp_buf;         /**< \brief Global jump buffer for error handling */
 
 
@@ -24,7 +42,39 @@ jmp_buf _error_jmp_buf;         /**< \brief Global jump buffer for error handlin
 */
 gchar _mode = 'E';              /**< \brief 'E'xecuting or 'C'ompiling */
 
-GSequenceIter *_ip = NULL;      /**< \brief Next instruction (Param) to execute in a definition */
+Instruction *_ip = NULL;        /**< \brief Next Instruction to execute in a definition */
+
+gboolean _optimize = 1;         /**< \brief 1 if compile_definition should run optimize_code */
+GHashTable *_pure_words = NULL; /**< \brief Maps the routine of a pure word to its PureWord (see add_pure_word) */
+GHashTable *_literal_words = NULL; /**< \brief Maps the routine of a literal word to its LiteralWord (see add_literal_word) */
+
+gboolean _profile_dispatch = 0; /**< \brief 1 if EC_execute should call profile_dispatch */
+GHashTable *_dispatch_counts = NULL;  /**< \brief Maps an Instruction to its DispatchCount (see fuse.c) */
+Instruction *_dispatch_history[2] = {NULL, NULL};  /**< \brief Last two Instructions dispatched while profiling */
+GHashTable *_fusions = NULL;    /**< \brief Maps the key of a fused sequence to its Fusion (see fuse.c) */
+GHashTable *_operand_forms = NULL;  /**< \brief Maps a routine to its operand form (see add_operand_form) */
+
+GHashTable *_quickeners = NULL; /**< \brief Maps a routine to its quickener (see add_quickener) */
+GHashTable *_field_getters = NULL;  /**< \brief Maps a field getter routine to its FieldGetter (see add_field_getter) */
+
+gboolean _aot = 0;              /**< \brief 1 if definitions are compiled ahead of time (see aot.c) */
+gpointer _native_library = NULL;  /**< \brief Handle of the loaded library of C routines */
+GHashTable *_native_definitions = NULL;  /**< \brief Maps a definition signature to its C routine */
+guint _num_native_definitions = 0;       /**< \brief Definitions bound to C routines */
+guint _num_interpreted_definitions = 0;  /**< \brief Definitions with no matching C routine */
+guint _native_depth = 0;        /**< \brief Calls made by C routines that haven't returned (see aot_call) */
+
+gboolean _line_mode = 1;        /**< \brief 1 if each line of input is compiled before it's run (see line.c) */
+Entry *_compile_target = NULL;  /**< \brief Line being compiled instead of the latest entry (see compile_target) */
+LineCache _line_cache;          /**< \brief Lines of input compiled by interpret_line */
+LineCache _string_cache;        /**< \brief Strings compiled by execute_string (e.g., for ",") */
+guint _dictionary_version = 0;  /**< \brief Changed whenever a word is redefined, making variable lookups stale (see variable_value) */
+
+VariableRef _tasks_db_ref;      /**< \brief Handle for the "tasks-db" variable (see ext_tasks.c) */
+VariableRef _cur_task_ref;      /**< \brief Handle for the "*cur-task" variable (see ext_tasks.c) */
+VariableRef _notes_db_ref;      /**< \brief Handle for the "notes-db" variable (see ext_notes.c) */
+GHashTable *_statement_caches = NULL;  /**< \brief Maps an sqlite3 connection to its prepared statements (see prepare_statement) */
+GHashTable *_close_hooks = NULL;  /**< \brief Functions run when a connection is closed (see add_close_hook) */
 
 gboolean _quit = 0;             /**< \brief To quit program cleanly, set _quit=1 */
 
@@ -41,6 +91,7 @@ static gchar unknown_token_type[] = "Unknown token type";
 static gchar stack_underflow[] = "Stack underflow";
 static gchar invalid_param[] = "Invalid parameter";
 static gchar generic_error[] = "Generic error";
+static gchar return_stack_overflow[] = "Return stack overflow";
 
 
 // -----------------------------------------------------------------------------
@@ -74,6 +125,10 @@ const gchar *error_type_to_string(gint error_type) {
             result = generic_error;
             break;
 
+        case ERR_RETURN_STACK_OVERFLOW:
+            result = return_stack_overflow;
+            break;
+
         default:
             result = unknown_error;
             break;
@@ -84,13 +139,13 @@ const gchar *error_type_to_string(gint error_type) {
 
 
 // -----------------------------------------------------------------------------
-/** Returns the next token from the input stream. If at the EOF, this returns a
-token with type equal to EOF.
+/** Returns the next token from the input stream, including the end of lines.
 
-\returns A Token representing the next token
+\returns A Token representing the next token. Its type is 'N' at the end of a
+          line and EOF at the end of the input.
 */
 // -----------------------------------------------------------------------------
-Token get_token() {
+Token get_line_token() {
     Token result;
     result.type = yylex();
 
@@ -113,9 +168,32 @@ Token get_token() {
 
 
 
+// -----------------------------------------------------------------------------
+/** Returns the next token from the input stream. If at the EOF, this returns a
+token with type equal to EOF.
+
+Line ends are skipped.
+
+\returns A Token representing the next token
+*/
+// -----------------------------------------------------------------------------
+Token get_token() {
+    Token result = get_line_token();
+    while (result.type == 'N') {
+        result = get_line_token();
+    }
+    return result;
+}
+
+
+
 // -----------------------------------------------------------------------------
 /** Prints out the error type and resets the state of the interpreter.
 
+Routines that hit an error usually return without freeing the Params they
+popped. These can't be freed here since the routine may still use them, so
+the control loop is asked to release them once the routine has returned (see
+release_transients).
 */
 // -----------------------------------------------------------------------------
 void handle_error(gint error_type) {
@@ -127,4 +205,6 @@ void handle_error(gint error_type) {
     clear_stack_r();
 
     _mode = 'E';
+
+    _release_transients = 1;
 }
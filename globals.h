@@ -15,6 +15,7 @@
 #define ERR_STACK_UNDERFLOW  3
 #define ERR_INVALID_PARAM  4
 #define ERR_GENERIC_ERROR  5
+#define ERR_RETURN_STACK_OVERFLOW  6
 
 
 // =============================================================================
@@ -58,14 +59,59 @@ typedef struct {
 
 
 extern GList *_dictionary;
-extern GQueue *_stack;
-extern GQueue *_return_stack;
+extern GHashTable *_dictionary_index;
+extern Entry *_latest_entry;
+extern GList *_wordlists;
+extern Wordlist *_current_wordlist;
+extern GArray *_stack;
+extern GArray *_array_marks;
+extern Pool _param_pool;
+extern Pool _entry_pool;
+extern gboolean _release_transients;
+extern Arena _arena;
+extern Frame *_return_stack;
+extern guint _return_stack_depth;
+extern guint _return_stack_size;
 extern gchar _mode;
 extern jmp_buf _error_jmp_buf;
-extern GSequenceIter *_ip;
+extern Instruction *_ip;
+extern gboolean _optimize;
+extern GHashTable *_pure_words;
+extern GHashTable *_literal_words;
+extern gboolean _profile_dispatch;
+extern GHashTable *_dispatch_counts;
+extern Instruction *_dispatch_history[2];
+extern GHashTable *_fusions;
+extern GHashTable *_operand_forms;
+extern GHashTable *_quickeners;
+extern GHashTable *_field_getters;
+extern gboolean _aot;
+extern gpointer _native_library;
+extern GHashTable *_native_definitions;
+extern guint _num_native_definitions;
+extern guint _num_interpreted_definitions;
+extern guint _native_depth;
+extern Param *_locals;
+extern guint _locals_depth;
+extern guint _locals_size;
+extern GPtrArray *_compile_locals;
+extern Loop *_loops;
+extern guint _loops_depth;
+extern guint _loops_size;
+extern gboolean _line_mode;
+extern Entry *_compile_target;
+extern LineCache _line_cache;
+extern LineCache _string_cache;
+extern guint _dictionary_version;
+extern VariableRef _tasks_db_ref;
+extern VariableRef _cur_task_ref;
+extern VariableRef _notes_db_ref;
+extern GHashTable *_statement_caches;
+extern GHashTable *_close_hooks;
 extern gboolean _quit;
 
 const gchar *error_type_to_string(gint error_type);
+Token get_line_token();
 Token get_token();
 void handle_error(gint error_type);
 void push_token(Token token);
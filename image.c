@@ -0,0 +1,887 @@
+/** \file image.c
+
+\brief Saves the dictionary to an image file and loads it back.
+
+Running a script like tasks.forth lexes and compiles every definition, loads
+each lexicon, and evaluates the `,` macros that redefine words. An image
+captures the resulting dictionary so that the next start can skip all of this
+(see "save-image", "load-image", and `kit --image`).
+
+An image holds a record for every complete Entry, oldest first:
+
+- Definitions are saved with their params, from which their threaded code is
+  compiled again when loaded (see compile_definition).
+- Constants and variables are saved with their values. Arrays are saved
+  element by element if they hold only numbers, strings, and such arrays.
+  Custom values (e.g., database connections) can't be saved, so they are left
+  unset and must be recreated by a startup script. So are objects and other
+  arrays, but save-image names the words that lose them.
+- Native entries (those whose routine is C code) are saved by wordlist and
+  word only. When loaded, they're bound to the entry with the same wordlist and
+  word that was registered by build_dictionary or by loading the lexicon named
+  after the wordlist (e.g., "lex-notes" for "notes").
+
+Records refer to strings by their offset into a string table and to entries by
+their index, so the image contains no pointers. When loading, the file is
+memory mapped and read in place. The routines of pseudo entries are rebound
+through the symbol table below.
+
+\note Images are tied to the build that saved them; the header is checked
+      against IMAGE_VERSION.
+*/
+
+#define IMAGE_MAGIC    "KITIMAGE"   /**< \brief First bytes of every image file */
+#define IMAGE_VERSION  1            /**< \brief Bump whenever the record layout changes */
+
+#define MAX_PSEUDO_DEPTH  4         /**< \brief Limits nesting of pseudo entry params */
+#define MAX_ARRAY_DEPTH  8          /**< \brief Limits nesting of arrays */
+
+#define KIND_NATIVE      'N'        /**< \brief Entry with a C routine */
+#define KIND_DEFINITION  'D'        /**< \brief Entry defined with ':' */
+#define KIND_CONSTANT    'K'        /**< \brief Entry defined with "constant" */
+#define KIND_VARIABLE    'V'        /**< \brief Entry defined with "variable" */
+
+
+/** \brief Start of an image file
+*/
+typedef struct {
+    gchar magic[8];             /**< \brief IMAGE_MAGIC */
+    guint32 version;            /**< \brief IMAGE_VERSION */
+    guint32 num_entries;        /**< \brief Number of ImageEntry records */
+    guint32 num_params;         /**< \brief Number of ImageParam records */
+    guint32 strings_size;       /**< \brief Size of the string table in bytes */
+    guint64 entries_offset;     /**< \brief File offset of the ImageEntry records */
+    guint64 params_offset;      /**< \brief File offset of the ImageParam records */
+    guint64 strings_offset;     /**< \brief File offset of the string table */
+} ImageHeader;
+
+
+/** \brief An Entry in an image file
+*/
+typedef struct {
+    guint32 word;               /**< \brief String offset of the word */
+    guint32 wordlist;           /**< \brief String offset of the wordlist name */
+    guint32 first_param;        /**< \brief Index of the Entry's first ImageParam */
+    guint32 num_params;         /**< \brief Number of params */
+    gchar kind;                 /**< \brief KIND_NATIVE, KIND_DEFINITION, etc. */
+    gchar immediate;            /**< \brief 1 if the Entry is immediate */
+} ImageEntry;
+
+
+/** \brief A Param in an image file
+*/
+typedef struct {
+    gchar type;                 /**< \brief Param type ('?' if it couldn't be saved) */
+    guint32 word;               /**< \brief 'P': String offset of the pseudo entry's word */
+    guint32 routine;            /**< \brief 'P': String offset of the routine's symbol */
+    guint32 first_param;        /**< \brief 'P': Index of the pseudo entry's first ImageParam; 'A': of the first element */
+    guint32 num_params;         /**< \brief 'P': Number of params of the pseudo entry; 'A': Number of elements */
+
+    union {
+        gint64 val_int;         /**< \brief 'I': Integer value */
+        gdouble val_double;     /**< \brief 'D': Double value */
+        guint32 val_string;     /**< \brief 'S': String offset of the value */
+        guint32 val_entry;      /**< \brief 'E': Index of the ImageEntry */
+    };
+} ImageParam;
+
+
+/** \brief Symbol table for the routines of pseudo entries
+*/
+static const struct {
+    const gchar *symbol;
+    routine_ptr routine;
+} pseudo_routines[] = {
+    {"push-param0", EC_push_param0},
+    {"jmp", EC_jmp},
+    {"jmp-if-false", EC_jmp_if_false},
+    {"pop-return-stack", EC_pop_return_stack},
+    {"enter-locals", EC_enter_locals},
+    {"fetch-local", EC_fetch_local},
+    {"store-local", EC_store_local},
+    {"enter-loop", EC_enter_loop},
+    {"next-loop", EC_next_loop},
+    {"next-loop-by", EC_next_loop_by},
+    {"exit-loop", EC_exit_loop},
+};
+
+
+// -----------------------------------------------------------------------------
+/** Returns the symbol for a pseudo entry routine (or NULL if it has none).
+*/
+// -----------------------------------------------------------------------------
+static const gchar *pseudo_routine_symbol(routine_ptr routine) {
+    for (guint i=0; i < G_N_ELEMENTS(pseudo_routines); i++) {
+        if (pseudo_routines[i].routine == routine) return pseudo_routines[i].symbol;
+    }
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the pseudo entry routine for a symbol (or NULL if it's unknown).
+*/
+// -----------------------------------------------------------------------------
+static routine_ptr pseudo_routine(const gchar *symbol) {
+    for (guint i=0; i < G_N_ELEMENTS(pseudo_routines); i++) {
+        if (g_strcmp0(pseudo_routines[i].symbol, symbol) == 0) return pseudo_routines[i].routine;
+    }
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the kind of record an Entry is saved as.
+*/
+// -----------------------------------------------------------------------------
+static gchar entry_kind(Entry *entry) {
+    if (entry->routine == EC_execute || entry->code) return KIND_DEFINITION;
+    if (entry->routine == EC_push_param0) return KIND_CONSTANT;
+    if (entry->routine == EC_push_entry_address) return KIND_VARIABLE;
+    return KIND_NATIVE;
+}
+
+
+
+// =============================================================================
+// Saving
+// =============================================================================
+
+/** \brief Records being built up by save_image
+*/
+typedef struct {
+    GArray *entries;            /**< \brief ImageEntry records */
+    GArray *params;             /**< \brief ImageParam records */
+    GString *strings;           /**< \brief String table */
+    GHashTable *string_offsets; /**< \brief Maps a string to its offset in the string table */
+    GHashTable *entry_indexes;  /**< \brief Maps an Entry to its index + 1 */
+    Entry *entry;               /**< \brief Entry whose params are being added (see add_image_entry) */
+} ImageWriter;
+
+
+// -----------------------------------------------------------------------------
+/** Adds a string to the string table (once) and returns its offset.
+*/
+// -----------------------------------------------------------------------------
+static guint32 add_image_string(ImageWriter *writer, const gchar *str) {
+    gpointer offset;
+    if (g_hash_table_lookup_extended(writer->string_offsets, str, NULL, &offset)) {
+        return GPOINTER_TO_UINT(offset);
+    }
+
+    guint32 result = writer->strings->len;
+    g_string_append_len(writer->strings, str, strlen(str) + 1);
+    g_hash_table_insert(writer->string_offsets, g_strdup(str), GUINT_TO_POINTER(result));
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Checks if an Array can be saved: it must hold numbers, strings, or arrays
+that can be saved themselves, and not be nested too deeply.
+*/
+// -----------------------------------------------------------------------------
+static gboolean can_save_array(const Array *array, guint depth) {
+    if (depth >= MAX_ARRAY_DEPTH) return 0;
+    if (array->type != '*') return 1;
+
+    for (guint i=0; i < array->len; i++) {
+        const Param *element = array->params + i;
+        if (element->type == 'I' || element->type == 'D' || element->type == 'S') continue;
+        if (element->type == 'A' && can_save_array(element->val_array, depth + 1)) continue;
+        return 0;
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Reserves ImageParam records for the elements of an Array and fills them out.
+
+\returns Index of the first ImageParam
+*/
+// -----------------------------------------------------------------------------
+static guint32 add_image_elements(ImageWriter *writer, const Array *array) {
+    guint32 result = writer->params->len;
+    g_array_set_size(writer->params, result + array->len);
+
+    for (guint i=0; i < array->len; i++) {
+        Param element;
+        get_array_element(array, i, &element);
+        ImageParam image_param = {.type = element.type};
+
+        switch (element.type) {
+            case 'I':
+                image_param.val_int = element.val_int;
+                break;
+
+            case 'D':
+                image_param.val_double = element.val_double;
+                break;
+
+            case 'S':
+                image_param.val_string = add_image_string(writer, element.val_string ? element.val_string : "");
+                break;
+
+            default:
+                // Only nested arrays are left (see can_save_array)
+                image_param.num_params = element.val_array->len;
+                image_param.first_param = add_image_elements(writer, element.val_array);
+                break;
+        }
+
+        g_array_index(writer->params, ImageParam, result + i) = image_param;
+        clear_param(&element);
+    }
+
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Reserves ImageParam records for a sequence of params and fills them out.
+
+\returns Index of the first ImageParam
+*/
+// -----------------------------------------------------------------------------
+static guint32 add_image_params(ImageWriter *writer, GSequence *params) {
+    guint32 result = writer->params->len;
+    g_array_set_size(writer->params, result + g_sequence_get_length(params));
+
+    guint32 index = result;
+    for (GSequenceIter *iter = g_sequence_get_begin_iter(params);
+         !g_sequence_iter_is_end(iter);
+         iter = g_sequence_iter_next(iter), index++) {
+
+        Param *param = g_sequence_get(iter);
+        ImageParam image_param = {.type = param->type};
+        guint entry_index;
+        const gchar *symbol;
+
+        switch (param->type) {
+            case 'I':
+                image_param.val_int = param->val_int;
+                break;
+
+            case 'D':
+                image_param.val_double = param->val_double;
+                break;
+
+            case 'S':
+                image_param.val_string = add_image_string(writer, param->val_string ? param->val_string : "");
+                break;
+
+            case 'E':
+                entry_index = GPOINTER_TO_UINT(g_hash_table_lookup(writer->entry_indexes, param->val_entry));
+                if (entry_index) {
+                    image_param.val_entry = entry_index - 1;
+                }
+                else {
+                    image_param.type = '?';
+                }
+                break;
+
+            case 'P':
+                symbol = pseudo_routine_symbol(param->val_pseudo_entry->routine);
+                if (!symbol) {
+                    image_param.type = '?';
+                    break;
+                }
+                image_param.word = add_image_string(writer, param->val_pseudo_entry->word);
+                image_param.routine = add_image_string(writer, symbol);
+                image_param.num_params = g_sequence_get_length(param->val_pseudo_entry->params);
+                image_param.first_param = add_image_params(writer, param->val_pseudo_entry->params);
+                break;
+
+            case 'A':
+                if (can_save_array(param->val_array, 0)) {
+                    image_param.num_params = param->val_array->len;
+                    image_param.first_param = add_image_elements(writer, param->val_array);
+                    break;
+                }
+                image_param.type = '?';
+                fprintf(stderr, "-----> Can't save the array in '%s'\n", writer->entry->word);
+                break;
+
+            case 'O':
+                image_param.type = '?';
+                fprintf(stderr, "-----> Can't save the object in '%s'\n", writer->entry->word);
+                break;
+
+            default:
+                // Routines and custom data can't be saved
+                image_param.type = '?';
+                break;
+        }
+
+        g_array_index(writer->params, ImageParam, index) = image_param;
+    }
+
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Adds an ImageEntry record for an Entry.
+*/
+// -----------------------------------------------------------------------------
+static void add_image_entry(ImageWriter *writer, Entry *entry) {
+    ImageEntry image_entry = {
+        .word = add_image_string(writer, entry->word),
+        .wordlist = add_image_string(writer, entry->wordlist->name),
+        .kind = entry_kind(entry),
+        .immediate = entry->immediate ? 1 : 0,
+    };
+
+    // Added first so a definition can refer to itself (see "recurse")
+    g_hash_table_insert(writer->entry_indexes, entry, GUINT_TO_POINTER(writer->entries->len + 1));
+
+    if (image_entry.kind != KIND_NATIVE) {
+        writer->entry = entry;
+        image_entry.num_params = g_sequence_get_length(entry->params);
+        image_entry.first_param = add_image_params(writer, entry->params);
+    }
+
+    g_array_append_val(writer->entries, image_entry);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Saves the dictionary to an image file.
+
+\param path: Image file to write
+\returns 1 on success; 0 otherwise (the error has been handled)
+*/
+// -----------------------------------------------------------------------------
+gboolean save_image(const gchar *path) {
+    gboolean result = 0;
+
+    if (_mode != 'E') {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Can't save an image while compiling\n");
+        return 0;
+    }
+
+    ImageWriter writer = {
+        .entries = g_array_new(FALSE, FALSE, sizeof(ImageEntry)),
+        .params = g_array_new(FALSE, FALSE, sizeof(ImageParam)),
+        .strings = g_string_new(NULL),
+        .string_offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+        .entry_indexes = g_hash_table_new(g_direct_hash, g_direct_equal),
+    };
+
+    // Offset 0 is the empty string
+    add_image_string(&writer, "");
+
+    // _dictionary is newest first
+    for (GList *link = g_list_last(_dictionary); link; link = link->prev) {
+        Entry *entry = link->data;
+        if (!entry->complete) continue;
+        add_image_entry(&writer, entry);
+    }
+
+    ImageHeader header = {
+        .version = IMAGE_VERSION,
+        .num_entries = writer.entries->len,
+        .num_params = writer.params->len,
+        .strings_size = writer.strings->len,
+    };
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.entries_offset = sizeof(ImageHeader);
+    header.params_offset = header.entries_offset + sizeof(ImageEntry) * header.num_entries;
+    header.strings_offset = header.params_offset + sizeof(ImageParam) * header.num_params;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Unable to open image file: %s\n", path);
+        goto done;
+    }
+
+    gboolean written =
+        fwrite(&header, sizeof(ImageHeader), 1, file) == 1 &&
+        fwrite(writer.entries->data, sizeof(ImageEntry), header.num_entries, file) == header.num_entries &&
+        fwrite(writer.params->data, sizeof(ImageParam), header.num_params, file) == header.num_params &&
+        fwrite(writer.strings->str, 1, header.strings_size, file) == header.strings_size;
+
+    if (fclose(file) != 0 || !written) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Problem writing image file: %s\n", path);
+        goto done;
+    }
+
+    result = 1;
+
+done:
+    g_array_free(writer.entries, TRUE);
+    g_array_free(writer.params, TRUE);
+    g_string_free(writer.strings, TRUE);
+    g_hash_table_destroy(writer.string_offsets);
+    g_hash_table_destroy(writer.entry_indexes);
+    return result;
+}
+
+
+
+// =============================================================================
+// Loading
+// =============================================================================
+
+/** \brief State used by load_image while reading a mapped image
+*/
+typedef struct {
+    const ImageHeader *header;  /**< \brief Start of the mapped image */
+    const ImageEntry *entries;  /**< \brief ImageEntry records in the mapped image */
+    const ImageParam *params;   /**< \brief ImageParam records in the mapped image */
+    const gchar *strings;       /**< \brief String table in the mapped image */
+    Entry **loaded;             /**< \brief Entry for each ImageEntry (NULL until loaded) */
+    GHashTable *registered;     /**< \brief Maps "wordlist:word" to a GQueue of natively registered entries */
+} ImageReader;
+
+
+// -----------------------------------------------------------------------------
+/** Returns a string from the image's string table (or NULL if the offset is bad).
+*/
+// -----------------------------------------------------------------------------
+static const gchar *image_string(ImageReader *reader, guint32 offset) {
+    if (offset >= reader->header->strings_size) return NULL;
+    return reader->strings + offset;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Notes the entries added to the dictionary since `stop` as registered natively.
+
+\param stop: Head of _dictionary before the entries were added (NULL for all)
+
+Entries are queued oldest first under their wordlist and word so that image
+records can be bound to them in order.
+*/
+// -----------------------------------------------------------------------------
+static void add_registered_entries(ImageReader *reader, GList *stop) {
+    // New entries were prepended, so walk back from the oldest one to the head
+    for (GList *link = stop ? stop->prev : g_list_last(_dictionary); link; link = link->prev) {
+        Entry *entry = link->data;
+        gchar *key = g_strconcat(entry->wordlist->name, ":", entry->word, NULL);
+
+        GQueue *queue = g_hash_table_lookup(reader->registered, key);
+        if (!queue) {
+            queue = g_queue_new();
+            g_hash_table_insert(reader->registered, key, queue);
+        }
+        else {
+            g_free(key);
+        }
+        g_queue_push_tail(queue, entry);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Removes and returns the oldest natively registered entry for a wordlist and word.
+*/
+// -----------------------------------------------------------------------------
+static Entry *take_registered_entry(ImageReader *reader, const gchar *wordlist, const gchar *word, gchar kind) {
+    gchar *key = g_strconcat(wordlist, ":", word, NULL);
+    GQueue *queue = g_hash_table_lookup(reader->registered, key);
+    g_free(key);
+
+    if (!queue || g_queue_is_empty(queue)) return NULL;
+    if (entry_kind(g_queue_peek_head(queue)) != kind) return NULL;
+    return g_queue_pop_head(queue);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Loads the lexicon for a wordlist by executing "lex-<wordlist>".
+
+\returns 1 if the lexicon was found and loaded; 0 otherwise
+*/
+// -----------------------------------------------------------------------------
+static gboolean load_lexicon(ImageReader *reader, const gchar *wordlist) {
+    gchar word[MAX_WORD_LEN];
+    snprintf(word, MAX_WORD_LEN, "lex-%s", wordlist);
+
+    Entry *lexicon = find_entry(word);
+    if (!lexicon) return 0;
+
+    GList *stop = _dictionary;
+    execute(lexicon);
+    add_registered_entries(reader, stop);
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Creates a Param from an ImageParam.
+
+\returns New Param or NULL if the ImageParam is invalid
+*/
+// -----------------------------------------------------------------------------
+static Param *load_param(ImageReader *reader, const ImageParam *image_param, guint depth);
+
+
+// -----------------------------------------------------------------------------
+/** Creates the params in a range of ImageParams and adds them to an Entry.
+
+\returns 1 on success; 0 if a param is invalid
+*/
+// -----------------------------------------------------------------------------
+static gboolean load_params(ImageReader *reader, Entry *entry, guint32 first_param, guint32 num_params, guint depth) {
+    if (depth > MAX_PSEUDO_DEPTH) return 0;
+    if (first_param > reader->header->num_params) return 0;
+    if (num_params > reader->header->num_params - first_param) return 0;
+
+    for (guint32 i=first_param; i < first_param + num_params; i++) {
+        Param *param = load_param(reader, reader->params + i, depth);
+        if (!param) return 0;
+        add_entry_param(entry, param);
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Creates an 'A' Param from the elements of an ImageParam.
+
+\returns New Param or NULL if an element is invalid
+*/
+// -----------------------------------------------------------------------------
+static Param *load_array_param(ImageReader *reader, const ImageParam *image_param, guint depth) {
+    guint32 first_param = image_param->first_param;
+    guint32 num_params = image_param->num_params;
+    if (depth >= MAX_ARRAY_DEPTH) return NULL;
+    if (first_param > reader->header->num_params) return NULL;
+    if (num_params > reader->header->num_params - first_param) return NULL;
+
+    Param *values = g_new(Param, num_params);
+    for (guint32 i=0; i < num_params; i++) {
+        const ImageParam *image_element = reader->params + first_param + i;
+        // Elements are numbers, strings, or arrays (see can_save_array)
+        Param *element = NULL;
+        if (image_element->type == 'A') {
+            element = load_array_param(reader, image_element, depth + 1);
+        }
+        else if (image_element->type == 'I' || image_element->type == 'D' || image_element->type == 'S') {
+            element = load_param(reader, image_element, 0);
+        }
+
+        if (!element) {
+            for (guint32 j=0; j < i; j++) clear_param(values + j);
+            g_free(values);
+            return NULL;
+        }
+
+        values[i] = *element;
+        element->type = '?';
+        free_param(element);
+    }
+
+    Param *result = new_param();
+    result->type = 'A';
+    result->val_array = new_array_from_values(values, num_params);
+    g_free(values);
+    return result;
+}
+
+
+
+static Param *load_param(ImageReader *reader, const ImageParam *image_param, guint depth) {
+    const gchar *str;
+    const gchar *word;
+    routine_ptr routine;
+    Entry *entry;
+    Param *result;
+
+    switch (image_param->type) {
+        case 'I':
+            return new_int_param(image_param->val_int);
+
+        case 'D':
+            return new_double_param(image_param->val_double);
+
+        case 'S':
+            str = image_string(reader, image_param->val_string);
+            return str ? new_str_param(str) : NULL;
+
+        case 'E':
+            if (image_param->val_entry >= reader->header->num_entries) return NULL;
+            entry = reader->loaded[image_param->val_entry];
+            return entry ? new_entry_param(entry) : NULL;
+
+        case 'P':
+            word = image_string(reader, image_param->word);
+            str = image_string(reader, image_param->routine);
+            routine = str ? pseudo_routine(str) : NULL;
+            if (!word || !routine) return NULL;
+
+            result = new_pseudo_entry_param(word, routine);
+            if (!load_params(reader, result->val_pseudo_entry, image_param->first_param,
+                             image_param->num_params, depth + 1)) {
+                free_param(result);
+                return NULL;
+            }
+            return result;
+
+        case 'A':
+            return load_array_param(reader, image_param, 0);
+
+        default:
+            return new_param();
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Binds or creates the Entry for an ImageEntry.
+
+\returns 1 on success; 0 if the ImageEntry couldn't be loaded
+*/
+// -----------------------------------------------------------------------------
+static gboolean load_entry(ImageReader *reader, guint32 index) {
+    const ImageEntry *image_entry = reader->entries + index;
+    const gchar *word = image_string(reader, image_entry->word);
+    const gchar *wordlist = image_string(reader, image_entry->wordlist);
+    if (!word || !wordlist) return 0;
+
+    // Bind to a natively registered entry, loading its lexicon if needed
+    Entry *entry = take_registered_entry(reader, wordlist, word, image_entry->kind);
+    if (!entry && g_strcmp0(wordlist, "forth") != 0 && load_lexicon(reader, wordlist)) {
+        entry = take_registered_entry(reader, wordlist, word, image_entry->kind);
+    }
+
+    if (!entry && image_entry->kind == KIND_NATIVE) {
+        fprintf(stderr, "-----> Unknown native word '%s:%s'\n", wordlist, word);
+        return 0;
+    }
+
+    // Registered variables keep their entry, but get the saved value
+    if (entry && image_entry->kind == KIND_VARIABLE && image_entry->num_params == 1) {
+        Param *value = load_param(reader, reader->params + image_entry->first_param, 0);
+        if (!value) return 0;
+
+        clear_param(entry->value);
+        *entry->value = *value;
+        value->type = '?';
+        free_param(value);
+    }
+
+    if (entry) {
+        reader->loaded[index] = entry;
+        return 1;
+    }
+
+
+    // Otherwise, create the entry in its wordlist
+    Wordlist *previous = set_current_wordlist(add_wordlist(wordlist));
+    gboolean result = 1;
+
+    switch (image_entry->kind) {
+        case KIND_DEFINITION:
+            entry = add_entry(word);
+            entry->routine = EC_execute;
+            entry->complete = 0;
+            reader->loaded[index] = entry;
+
+            result = load_params(reader, entry, image_entry->first_param, image_entry->num_params, 0);
+            if (result) {
+                compile_definition(entry);
+                entry->complete = entry->code ? 1 : 0;
+                result = entry->complete;
+            }
+            break;
+
+        case KIND_CONSTANT:
+            entry = add_entry(word);
+            entry->routine = EC_push_param0;
+            reader->loaded[index] = entry;
+            result = load_params(reader, entry, image_entry->first_param, image_entry->num_params, 0);
+            break;
+
+        case KIND_VARIABLE:
+            add_variable(word);
+            entry = latest_entry();
+            reader->loaded[index] = entry;
+            if (image_entry->num_params == 1) {
+                Param *value = load_param(reader, reader->params + image_entry->first_param, 0);
+                result = value != NULL;
+                if (value) {
+                    *entry->value = *value;
+                    value->type = '?';
+                    free_param(value);
+                }
+            }
+            break;
+
+        default:
+            result = 0;
+            break;
+    }
+
+    if (entry) entry->immediate = image_entry->immediate;
+
+    set_current_wordlist(previous);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Checks that the header and record offsets of a mapped image are valid.
+*/
+// -----------------------------------------------------------------------------
+static gboolean check_image(const ImageHeader *header, gsize size) {
+    if (size < sizeof(ImageHeader)) return 0;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0) return 0;
+    if (header->version != IMAGE_VERSION) return 0;
+
+    guint64 entries_end = header->entries_offset + (guint64) sizeof(ImageEntry) * header->num_entries;
+    guint64 params_end = header->params_offset + (guint64) sizeof(ImageParam) * header->num_params;
+    guint64 strings_end = header->strings_offset + header->strings_size;
+    if (entries_end > size || params_end > size || strings_end > size) return 0;
+
+    // The string table must end with a NUL so every string in it does too
+    const gchar *strings = (const gchar *) header + header->strings_offset;
+    if (header->strings_size == 0 || strings[header->strings_size - 1] != '\0') return 0;
+
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Replaces the dictionary with the one saved in an image file.
+
+\param path: Image file to load
+\returns 1 on success; 0 otherwise (the error has been handled)
+
+The dictionary is rebuilt from scratch, so anything referring to the old
+entries is cleared first: the param stack, the return stack, and _ip. This
+means that a definition calling "load-image" stops once the image is loaded.
+*/
+// -----------------------------------------------------------------------------
+gboolean load_image(const gchar *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Unable to open image file: %s\n", path);
+        return 0;
+    }
+
+    struct stat file_stat;
+    gpointer mapping = MAP_FAILED;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (mapping == MAP_FAILED || !check_image(mapping, file_stat.st_size)) {
+        if (mapping != MAP_FAILED) munmap(mapping, file_stat.st_size);
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Invalid image file: %s\n", path);
+        return 0;
+    }
+
+    // Start over from the natively registered words
+    _ip = NULL;
+    clear_stack();
+    clear_stack_r();
+    destroy_dictionary();
+    build_dictionary();
+
+    const ImageHeader *header = mapping;
+    ImageReader reader = {
+        .header = header,
+        .entries = (const ImageEntry *) ((const gchar *) mapping + header->entries_offset),
+        .params = (const ImageParam *) ((const gchar *) mapping + header->params_offset),
+        .strings = (const gchar *) mapping + header->strings_offset,
+        .loaded = g_new0(Entry *, header->num_entries + 1),
+        .registered = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_queue_free),
+    };
+    add_registered_entries(&reader, NULL);
+
+    gboolean result = 1;
+    for (guint32 i=0; i < header->num_entries; i++) {
+        if (!load_entry(&reader, i)) {
+            result = 0;
+            break;
+        }
+    }
+
+    if (!result) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Problem loading image file: %s\n", path);
+    }
+
+    g_free(reader.loaded);
+    g_hash_table_destroy(reader.registered);
+    munmap(mapping, file_stat.st_size);
+    return result;
+}
+
+
+
+// =============================================================================
+// Words
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+/** Pops an image filename and saves the dictionary to it.
+
+(str -- )
+*/
+// -----------------------------------------------------------------------------
+void EC_save_image(gpointer gp_entry) {
+    Param param_path;
+    if (!pop_value(&param_path)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    if (param_path.type == 'S') {
+        save_image(param_path.val_string);
+    }
+    else {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&param_path, stderr, "----> ");
+    }
+    clear_param(&param_path);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops an image filename and replaces the dictionary with the one saved in it.
+
+(str -- )
+*/
+// -----------------------------------------------------------------------------
+void EC_load_image(gpointer gp_entry) {
+    Param param_path;
+    if (!pop_value(&param_path)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    if (param_path.type == 'S') {
+        load_image(param_path.val_string);
+    }
+    else {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&param_path, stderr, "----> ");
+    }
+    clear_param(&param_path);
+}
@@ -0,0 +1,10 @@
+/** \file image.h
+*/
+
+#pragma once
+
+gboolean save_image(const gchar *path);
+gboolean load_image(const gchar *path);
+
+void EC_save_image(gpointer gp_entry);
+void EC_load_image(gpointer gp_entry);
@@ -79,21 +79,63 @@ void push_token(Token token) {
 
 // -----------------------------------------------------------------------------
 /** Sets up the interpreter and then runs the main control loop.
+
+Usage: kit [--image <image file>] [--aot <library>] [<forth file>]
+
+The options can be given in any order, but must come before the forth file.
+
+If an image is specified (see save-image), the dictionary is loaded from it
+before the forth file (or stdin) is read.
+
+If a library is specified, definitions are compiled ahead of time into it (see
+aot.c). Definitions found in the library run as native code, and the library
+is rebuilt at exit if any definition wasn't found.
 */
 // -----------------------------------------------------------------------------
 int main(int argc, char *argv[]) {
     Entry *entry;
     FILE *input_file = NULL;
+    const gchar *aot_path = NULL;
+    const gchar *image_path = NULL;
+    gint arg_index = 1;
 
+    create_pools();
+    create_arena();
     build_dictionary();
     create_stack();
     create_stack_r();
 
+    // Read the options
+    while (argc > arg_index + 1) {
+        if (g_strcmp0(argv[arg_index], "--image") == 0) {
+            image_path = argv[arg_index + 1];
+        }
+        else if (g_strcmp0(argv[arg_index], "--aot") == 0) {
+            aot_path = argv[arg_index + 1];
+        }
+        else {
+            break;
+        }
+        arg_index += 2;
+    }
+
+    // Load native library if specified so that definitions can be bound as
+    // they're compiled (including those loaded from an image)
+    if (aot_path) {
+        _aot = 1;
+        load_native_library(aot_path);
+    }
+
+    // Load image if specified
+    if (image_path && !load_image(image_path)) {
+        exit(1);
+    }
+
     // Open input file if specified; otherwise stdin
-    if (argc > 1) {
-        input_file = fopen(argv[1], "r");
+    if (argc > arg_index) {
+        input_file = fopen(argv[arg_index], "r");
         if (!input_file) {
-            fprintf(stderr, "Unable to open file: %s\n", argv[1]);
+            fprintf(stderr, "Unable to open file: %s\n", argv[arg_index]);
             exit(1);
         }
         scan_file(input_file);
@@ -105,6 +147,17 @@ int main(int argc, char *argv[]) {
 
     // Control loop
     while(!_quit) {
+        // Free any Params abandoned by a routine that hit an error along
+        // with the scratch memory of the previous command
+        release_transients();
+        arena_reset();
+
+        // Each line is compiled before it's run (see line.c)
+        if (_mode == 'E' && _line_mode) {
+            if (!interpret_line()) break;
+            continue;
+        }
+
         Token token = get_token();
 
         if (token.type == EOF) break;
@@ -127,10 +180,15 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (aot_path) update_native_library(aot_path);
+
     // Clean up
     destroy_dictionary();
     destroy_stack();
     destroy_stack_r();
+    destroy_pools();
+    destroy_arena();
+    unload_native_library();
 
     destroy_input_stack();
     yylex_destroy();
@@ -0,0 +1,564 @@
+/** \file line.c
+
+\brief Compiles each line of input into threaded code before running it.
+
+Words typed at the top level used to be looked up and executed one token at a
+time, so "if", "else", and "then" only worked inside a definition. In line
+mode (the default), interpret_line reads a whole line, compiles it into an
+anonymous definition (see compile_target), and runs that instead:
+
+    3 2 > if "bigger" else "smaller" then .
+
+Compiled lines are kept in an LRU cache keyed by their text, so a line that is
+repeated (e.g., by a script that runs the same command many times) is only
+compiled once. Each cached line records the entries its code calls, and when
+one of those words is redefined, only the lines calling it are dropped (see
+drop_lines_calling).
+
+Some words can't be compiled into a line because they read the rest of the
+input (e.g., ":", "constant", "variable"), run strings as input (","), or
+change the dictionary out from under the line ("load-image", "lex-*"). These
+are marked interpret_only, as is any definition that calls one. The same goes
+for unknown words and immediate words other than the control flow words
+("if", "do", "begin", and the rest). When one of them is reached, the part of
+the line before it is compiled and run, and then the word is handled as before.
+Since control flow words are compiled, loops work at the top level too:
+
+    10 0 do i . loop
+
+As with QUIT in other Forths, an error abandons the rest of the line.
+
+Strings run by execute_string (e.g., by "," and by lexicons that run words
+like "notes-db @") are compiled the same way and kept in their own cache, so
+running the same text again skips scanning and looking up its words. A string
+built by "," is cached by its template and the arguments substituted into it,
+so running it again skips the substitution as well. As with lines, the part of
+a string before a word that can't be compiled is compiled, and the rest is kept
+as text and interpreted. For a string that defines a word (e.g., the ones built
+by redefine-note-word in tasks.forth), that's everything from the ":" on.
+
+"line-mode-off" goes back to running one token at a time.
+*/
+
+#define LINE_CACHE_SIZE  64     /**< \brief Number of compiled lines kept in each LineCache */
+
+
+/** \brief A compiled line in a LineCache
+*/
+typedef struct {
+    gchar *key;                 /**< \brief Text of the line (or template and arguments of a string) */
+    Entry *entry;               /**< \brief Anonymous definition compiled from the line (NULL if nothing could be compiled) */
+    gchar *rest;                /**< \brief Text after the compiled part, interpreted a token at a time (NULL if none) */
+    GPtrArray *entries;         /**< \brief Entries called by the compiled part (see drop_lines_calling) */
+    guint num_running;          /**< \brief Number of runs of the line in progress */
+    GList *link;                /**< \brief Link of this line in the LRU list (NULL once removed) */
+} CachedLine;
+
+
+/** \brief A token read by read_line
+*/
+typedef struct {
+    Token token;                /**< \brief Token as read */
+    gchar *text;                /**< \brief Full text of a string literal (NULL otherwise) */
+} LineToken;
+
+
+// -----------------------------------------------------------------------------
+/** Frees a CachedLine along with its definition.
+*/
+// -----------------------------------------------------------------------------
+static void free_cached_line(CachedLine *line) {
+    if (line->entry) free_entry(line->entry);
+    g_ptr_array_free(line->entries, TRUE);
+    g_free(line->rest);
+    g_free(line->key);
+    g_free(line);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Removes a line from its cache.
+
+The line is freed once it's no longer running.
+*/
+// -----------------------------------------------------------------------------
+static void remove_cached_line(LineCache *cache, CachedLine *line) {
+    g_hash_table_remove(cache->lines, line->key);
+    g_queue_delete_link(cache->lru, line->link);
+    line->link = NULL;
+
+    if (!line->num_running) free_cached_line(line);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Drops all lines from a cache.
+*/
+// -----------------------------------------------------------------------------
+static void clear_cache(LineCache *cache) {
+    if (!cache->lines) return;
+
+    while (!g_queue_is_empty(cache->lru)) {
+        remove_cached_line(cache, g_queue_peek_head(cache->lru));
+    }
+    g_hash_table_destroy(cache->lines);
+    g_queue_free(cache->lru);
+    cache->lines = NULL;
+    cache->lru = NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Drops all compiled lines and strings.
+
+This is used when the entries the lines call are about to be freed (see
+destroy_dictionary).
+*/
+// -----------------------------------------------------------------------------
+void clear_line_cache() {
+    clear_cache(&_line_cache);
+    clear_cache(&_string_cache);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Drops the lines of a cache that call an entry with the given word.
+*/
+// -----------------------------------------------------------------------------
+static void drop_cached_lines_calling(LineCache *cache, const gchar *word) {
+    if (!cache->lines) return;
+
+    GList *link = cache->lru->head;
+    while (link) {
+        CachedLine *line = link->data;
+        link = link->next;
+
+        for (guint i=0; i < line->entries->len; i++) {
+            const Entry *entry = g_ptr_array_index(line->entries, i);
+            if (g_strcmp0(entry->word, word) == 0) {
+                remove_cached_line(cache, line);
+                break;
+            }
+        }
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Drops the compiled lines and strings that call a word being redefined.
+
+This is called when a new entry shadows an older one and again when the new
+entry is completed (see add_entry and EC_end_define). Lines that don't call the
+word are kept. A qualified word (e.g., "notes:N") is matched by its plain word,
+so its lines are recompiled whenever any version of the word is redefined.
+*/
+// -----------------------------------------------------------------------------
+void drop_lines_calling(const gchar *word) {
+    drop_cached_lines_calling(&_line_cache, word);
+    drop_cached_lines_calling(&_string_cache, word);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the compiled line with the given key or NULL if there isn't one.
+*/
+// -----------------------------------------------------------------------------
+static CachedLine *find_cached_line(LineCache *cache, const gchar *key) {
+    if (!cache->lines) return NULL;
+
+    CachedLine *line = g_hash_table_lookup(cache->lines, key);
+    if (!line) return NULL;
+
+    // Move to the front of the LRU list
+    g_queue_unlink(cache->lru, line->link);
+    g_queue_push_head_link(cache->lru, line->link);
+    return line;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Adds a compiled line to a cache, evicting the least recently used line
+if the cache is full.
+
+\param entry: Definition compiled from the line (NULL if nothing could be compiled)
+\param rest: Text to interpret after running entry (taken over; may be NULL)
+\param entries: Entries called by entry (taken over)
+*/
+// -----------------------------------------------------------------------------
+static CachedLine *add_cached_line(LineCache *cache, const gchar *key, Entry *entry,
+                                   gchar *rest, GPtrArray *entries) {
+    if (!cache->lines) {
+        cache->lines = g_hash_table_new(g_str_hash, g_str_equal);
+        cache->lru = g_queue_new();
+    }
+
+    if (g_queue_get_length(cache->lru) >= LINE_CACHE_SIZE) {
+        remove_cached_line(cache, g_queue_peek_tail(cache->lru));
+    }
+
+    CachedLine *result = g_new(CachedLine, 1);
+    result->key = g_strdup(key);
+    result->entry = entry;
+    result->rest = rest;
+    result->entries = entries;
+    result->num_running = 0;
+
+    g_queue_push_head(cache->lru, result);
+    result->link = g_queue_peek_head_link(cache->lru);
+    g_hash_table_insert(cache->lines, result->key, result);
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a compiled line and then interprets the rest of it (if any).
+
+The line can be removed from its cache while it runs (e.g., if what it calls
+compiles enough other lines or redefines a word it calls), so it's only freed
+when it's done.
+*/
+// -----------------------------------------------------------------------------
+static void run_cached_line(CachedLine *line) {
+    line->num_running++;
+    if (line->entry) execute(line->entry);
+    if (line->rest && !_release_transients) interpret_tokens(line->rest);
+    line->num_running--;
+
+    if (!line->num_running && !line->link) free_cached_line(line);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compiles tokens into an anonymous definition.
+
+\returns The definition or NULL if it couldn't be compiled
+*/
+// -----------------------------------------------------------------------------
+static Entry *compile_line(GArray *tokens) {
+    Entry *result = new_entry();
+    g_strlcpy(result->word, "(line)", MAX_WORD_LEN);
+    result->routine = EC_execute;
+
+    _compile_target = result;
+
+    for (guint i=0; i < tokens->len && !_release_transients; i++) {
+        LineToken *line_token = &g_array_index(tokens, LineToken, i);
+
+        if (line_token->token.type == 'W') {
+            compile(line_token->token);
+        }
+        else {
+            compile_literal(result, line_token->token.type,
+                            line_token->text ? line_token->text : line_token->token.word);
+        }
+    }
+
+    if (!_release_transients) {
+        add_entry_param(result, new_pseudo_entry_param(";", EC_pop_return_stack));
+        compile_definition(result);
+    }
+
+    _compile_target = NULL;
+
+    if (!result->code) {
+        free_entry(result);
+        return NULL;
+    }
+    return result;
+}
+
+
+
+/** \brief Control flow words that can be compiled into a line
+
+Each word opens (+1) or closes (-1) a control structure or goes in the middle
+of one (0).
+*/
+static const struct {
+    routine_ptr routine;
+    gint nesting;
+} control_flow_words[] = {
+    {EC_if, 1}, {EC_else, 0}, {EC_then, -1},
+    {EC_begin, 1}, {EC_while, 0}, {EC_until, -1}, {EC_again, -1}, {EC_repeat, -1},
+    {EC_do, 1}, {EC_leave, 0}, {EC_loop, -1}, {EC_plus_loop, -1},
+};
+
+
+// -----------------------------------------------------------------------------
+/** Returns the index of a control flow word in control_flow_words or -1 if
+the entry isn't one.
+*/
+// -----------------------------------------------------------------------------
+static gint find_control_flow_word(Entry *entry) {
+    for (guint i=0; i < G_N_ELEMENTS(control_flow_words); i++) {
+        if (control_flow_words[i].routine == entry->routine) return i;
+    }
+    return -1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if a word has to be handled by itself rather than compiled into
+a line.
+*/
+// -----------------------------------------------------------------------------
+static gboolean is_line_boundary(Entry *entry) {
+    if (!entry || entry->interpret_only) return 1;
+
+    if (entry->immediate) {
+        return find_control_flow_word(entry) < 0;
+    }
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Skips the rest of the current line.
+
+\returns Type of the token that ended the line ('N', '^', or EOF)
+*/
+// -----------------------------------------------------------------------------
+static gint skip_line() {
+    Token token = get_line_token();
+    while (token.type != 'N' && token.type != '^' && token.type != EOF) {
+        token = get_line_token();
+    }
+    return token.type;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Reads tokens up to the end of a line or a word that can't be compiled.
+
+\param tokens: Receives the LineTokens that were read
+\param text: Receives the tokens separated by spaces
+\param to_end: 1 if the end of a line should be read through
+\param entries: Receives the Entries of the words that were read
+\param entry_boundary: Receives the Entry of the word the line stopped at (NULL if unknown)
+\param balanced: Receives 0 if the control flow words don't match up
+\returns The token that stopped the line ('N', '^', EOF, or the 'W' of a word that
+          can't be compiled)
+*/
+// -----------------------------------------------------------------------------
+static Token read_line(GArray *tokens, GString *text, gboolean to_end, GPtrArray *entries,
+                       Entry **entry_boundary, gboolean *balanced) {
+    gint nesting = 0;
+    Token token;
+
+    *entry_boundary = NULL;
+    *balanced = 1;
+
+    while (1) {
+        token = to_end ? get_token() : get_line_token();
+        if (token.type == 'N' || token.type == '^' || token.type == EOF) break;
+
+        LineToken line_token = {token, NULL};
+
+        if (token.type == 'W') {
+            Entry *entry = find_entry(token.word);
+            if (is_line_boundary(entry)) {
+                *entry_boundary = entry;
+                break;
+            }
+
+            // Mismatched pairs like "if ... loop" are caught when the line is compiled
+            gint index = entry->immediate ? find_control_flow_word(entry) : -1;
+            if (index >= 0) {
+                if (nesting == 0 && control_flow_words[index].nesting <= 0) *balanced = 0;
+                nesting += control_flow_words[index].nesting;
+            }
+            g_ptr_array_add(entries, entry);
+        }
+        else if (token.type == 'S') {
+            // The token's word may be truncated
+            line_token.text = g_strdup(yytext);
+        }
+
+        g_string_append(text, line_token.text ? line_token.text : token.word);
+        g_string_append_c(text, ' ');
+        g_array_append_val(tokens, line_token);
+    }
+
+    if (nesting != 0) *balanced = 0;
+    return token;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees the LineTokens read by read_line.
+*/
+// -----------------------------------------------------------------------------
+static void free_tokens(GArray *tokens) {
+    for (guint i=0; i < tokens->len; i++) {
+        g_free(g_array_index(tokens, LineToken, i).text);
+    }
+    g_array_free(tokens, TRUE);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compiles and runs the next line of input.
+
+\returns 0 at the end of the input; 1 otherwise
+
+If the line contains a word that can't be compiled into it (see
+is_line_boundary), only the part of the line up to that word is compiled and
+run. The word is then executed (or reported if unknown), and the rest of the
+line is read by the next call.
+*/
+// -----------------------------------------------------------------------------
+gboolean interpret_line() {
+    GArray *tokens = g_array_new(FALSE, FALSE, sizeof(LineToken));
+    GString *text = g_string_new(NULL);
+    GPtrArray *entries = g_ptr_array_new();
+    Entry *entry_boundary;
+    gboolean balanced;
+
+    Token token = read_line(tokens, text, 0, entries, &entry_boundary, &balanced);
+
+    if (!balanced) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Unbalanced control flow in '%s'\n", text->str);
+    }
+    else if (tokens->len) {
+        CachedLine *line = find_cached_line(&_line_cache, text->str);
+        if (!line) {
+            Entry *entry_line = compile_line(tokens);
+            if (entry_line) {
+                line = add_cached_line(&_line_cache, text->str, entry_line, NULL, entries);
+                entries = NULL;
+            }
+        }
+        if (line) run_cached_line(line);
+    }
+
+    if (entries) g_ptr_array_free(entries, TRUE);
+    free_tokens(tokens);
+    g_string_free(text, TRUE);
+
+    // Handle the word the line stopped at
+    if (token.type == 'W' && !_release_transients) {
+        if (entry_boundary) {
+            execute(entry_boundary);
+        }
+        else {
+            push_token(token);
+        }
+    }
+
+    // Abandon the rest of the line after an error
+    if (token.type == 'W' && _release_transients) {
+        token.type = skip_line();
+    }
+
+    return token.type != EOF;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compiles and runs a string, reusing its code if it was run before.
+
+\param key: Key of the string in _string_cache (its text, or its template and
+            arguments; see EC_execute_string)
+\param str: The string (NULL to only run it if it's cached)
+\returns 1 if the string was run; 0 if it has to be interpreted a token at a
+          time (see execute_string) or str is NULL and it isn't cached
+
+A string that has a word that can't be compiled (see is_line_boundary) is
+cached with the part before that word compiled and the rest kept as text, so
+it's only scanned once here.
+*/
+// -----------------------------------------------------------------------------
+gboolean interpret_string(const gchar *key, const gchar *str) {
+    // Errors are only reported once per command, so leave this to execute_string
+    if (_release_transients) return 0;
+
+    CachedLine *line = find_cached_line(&_string_cache, key);
+
+    if (!line) {
+        if (!str) return 0;
+
+        GArray *tokens = g_array_new(FALSE, FALSE, sizeof(LineToken));
+        GString *text = g_string_new(NULL);
+        GPtrArray *entries = g_ptr_array_new();
+        Entry *entry_boundary;
+        gboolean balanced;
+        Entry *entry_line = NULL;
+        gchar *rest = NULL;
+
+        scan_string(str);
+        Token token = read_line(tokens, text, 1, entries, &entry_boundary, &balanced);
+
+        // Keep the tokens from the word the string stopped at for interpreting
+        if (token.type != '^' && token.type != EOF) {
+            GString *text_rest = g_string_new(NULL);
+            while (token.type != '^' && token.type != EOF) {
+                g_string_append(text_rest, yytext);
+                g_string_append_c(text_rest, ' ');
+                token = get_token();
+            }
+            rest = g_string_free(text_rest, FALSE);
+        }
+
+        guint num_tokens = tokens->len;
+        if (balanced && tokens->len) {
+            entry_line = compile_line(tokens);
+        }
+        free_tokens(tokens);
+        g_string_free(text, TRUE);
+
+        // An error was reported while compiling
+        if (_release_transients) {
+            g_ptr_array_free(entries, TRUE);
+            g_free(rest);
+            return 1;
+        }
+
+        // Interpret the whole string if its start couldn't be compiled
+        if (!entry_line && num_tokens) {
+            g_free(rest);
+            rest = g_strdup(str);
+            g_ptr_array_set_size(entries, 0);
+        }
+
+        line = add_cached_line(&_string_cache, key, entry_line, rest, entries);
+    }
+
+    run_cached_line(line);
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compiles each line of input before running it (the default).
+*/
+// -----------------------------------------------------------------------------
+void EC_line_mode_on(gpointer gp_entry) {
+    _line_mode = 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs input one token at a time.
+*/
+// -----------------------------------------------------------------------------
+void EC_line_mode_off(gpointer gp_entry) {
+    _line_mode = 0;
+}
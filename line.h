@@ -0,0 +1,12 @@
+/** \file line.h
+*/
+
+#pragma once
+
+gboolean interpret_line();
+gboolean interpret_string(const gchar *key, const gchar *str);
+void drop_lines_calling(const gchar *word);
+void clear_line_cache();
+
+void EC_line_mode_on(gpointer gp_entry);
+void EC_line_mode_off(gpointer gp_entry);
@@ -0,0 +1,281 @@
+/** \file locals.c
+
+\brief Named locals for definitions.
+
+A definition can declare locals with "{" as its first word, naming them in
+stack order. They are initialized from the stack when the definition starts:
+
+    : -rot { a b c -- c a b }  c a b ;
+
+Anything between "--" and "}" is a comment (the outputs of the definition).
+
+Inside the definition, the name of a local pushes its value and "to" followed
+by the name stores into it:
+
+    : choose { a b flag -- a|b }  flag if b to a then  a ;
+
+Locals are compiled into Instructions that address their slot directly:
+
+- IC_enter_locals: Pops the locals off the stack into the Frame's slots
+- IC_fetch_local: Pushes a local
+- IC_store_local: Pops a value into a local
+
+The slots of each Frame are kept in _locals, which grows and shrinks along with
+the return stack (see push_frame_r and pop_frame_r), so locals don't allocate
+anything once _locals has grown to the deepest nesting used.
+*/
+
+#define INITIAL_LOCALS_SIZE  256   /**< \brief Number of local slots preallocated */
+
+
+// -----------------------------------------------------------------------------
+/** Returns the index of a local of the definition being compiled or -1 if
+there is no such local.
+*/
+// -----------------------------------------------------------------------------
+gint find_local(const gchar *word) {
+    if (!_compile_locals || _mode != 'C' || _compile_target) return -1;
+
+    for (guint i=0; i < _compile_locals->len; i++) {
+        if (g_strcmp0(g_ptr_array_index(_compile_locals, i), word) == 0) return i;
+    }
+    return -1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Forgets the locals of the definition being compiled.
+
+This is called at the start and end of each definition.
+*/
+// -----------------------------------------------------------------------------
+void clear_compile_locals() {
+    if (_compile_locals) {
+        g_ptr_array_free(_compile_locals, TRUE);
+        _compile_locals = NULL;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compiles an Instruction that works on a local into the latest entry.
+
+\param word: Word of the pseudo entry (e.g., "local@")
+\param routine: Routine of the pseudo entry (e.g., EC_fetch_local)
+\param index: Index of the local (or the number of locals for EC_enter_locals)
+*/
+// -----------------------------------------------------------------------------
+void compile_local(const gchar *word, routine_ptr routine, gint index) {
+    Param *pseudo_param = new_pseudo_entry_param(word, routine);
+    add_entry_param(pseudo_param->val_pseudo_entry, new_int_param(index));
+    add_entry_param(latest_entry(), pseudo_param);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Releases the locals of a Frame.
+*/
+// -----------------------------------------------------------------------------
+void release_locals(Frame *frame) {
+    for (guint i=frame->locals; i < frame->locals + frame->num_locals; i++) {
+        clear_param(_locals + i);
+    }
+    _locals_depth = frame->locals;
+    frame->num_locals = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Releases the locals of every Frame.
+*/
+// -----------------------------------------------------------------------------
+void clear_locals() {
+    for (guint i=0; i < _locals_depth; i++) {
+        clear_param(_locals + i);
+    }
+    _locals_depth = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees the slots for locals.
+*/
+// -----------------------------------------------------------------------------
+void destroy_locals() {
+    clear_locals();
+    g_free(_locals);
+    _locals = NULL;
+    _locals_size = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops the locals of the current definition off the stack into its Frame.
+
+The operand is the number of locals. The last local is the top of the stack.
+*/
+// -----------------------------------------------------------------------------
+void IC_enter_locals(Instruction *instruction) {
+    guint num_locals = instruction->operand.local;
+    Frame *frame = top_frame_r();
+
+    // A recursive tail call reuses the Frame, so its locals are replaced
+    release_locals(frame);
+
+    if (stack_depth() < num_locals) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    if (_locals_depth + num_locals > _locals_size) {
+        _locals_size = MAX(_locals_size ? _locals_size * 2 : INITIAL_LOCALS_SIZE, _locals_depth + num_locals);
+        _locals = g_renew(Param, _locals, _locals_size);
+    }
+
+    for (gint i=num_locals-1; i >= 0; i--) {
+        pop_value(_locals + frame->locals + i);
+    }
+    frame->num_locals = num_locals;
+    _locals_depth = frame->locals + num_locals;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a local of the current definition.
+*/
+// -----------------------------------------------------------------------------
+void IC_fetch_local(Instruction *instruction) {
+    push_value(_locals + top_frame_r()->locals + instruction->operand.local);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a value into a local of the current definition.
+*/
+// -----------------------------------------------------------------------------
+void IC_store_local(Instruction *instruction) {
+    Param value;
+    if (!pop_value(&value)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return;
+    }
+
+    Param *local = _locals + top_frame_r()->locals + instruction->operand.local;
+    clear_param(local);
+    *local = value;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Routine of the pseudo entry that declares locals.
+
+Like the jmp pseudo entries, this is compiled into an Instruction
+(IC_enter_locals), so there's nothing to do here.
+*/
+// -----------------------------------------------------------------------------
+void EC_enter_locals(gpointer gp_entry) {
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Routine of the pseudo entry that pushes a local (see IC_fetch_local).
+*/
+// -----------------------------------------------------------------------------
+void EC_fetch_local(gpointer gp_entry) {
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Routine of the pseudo entry that stores into a local (see IC_store_local).
+*/
+// -----------------------------------------------------------------------------
+void EC_store_local(gpointer gp_entry) {
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Declares the locals of the definition being compiled.
+
+This reads words up to "}". Words before "--" are locals; the rest are a
+comment. "{" has to be the first word of the definition, so the locals are
+always set up before they're used.
+*/
+// -----------------------------------------------------------------------------
+void EC_begin_locals(gpointer gp_entry) {
+    if (_mode != 'C' || _compile_target) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Locals can only be declared in a definition\n");
+        return;
+    }
+
+    if (_compile_locals) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> '%s' already declares locals\n", latest_entry()->word);
+        return;
+    }
+
+    // IC_enter_locals has to run before any local is read
+    if (g_sequence_get_length(latest_entry()->params) > 0) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Locals must be declared at the start of '%s'\n", latest_entry()->word);
+        return;
+    }
+
+    _compile_locals = g_ptr_array_new_with_free_func(g_free);
+    gboolean is_comment = 0;
+
+    while (1) {
+        Token token = get_token();
+        if (token.type == EOF || token.type == '^') {
+            handle_error(ERR_GENERIC_ERROR);
+            fprintf(stderr, "-----> Missing '}' after locals\n");
+            return;
+        }
+
+        if (g_strcmp0(token.word, "}") == 0) break;
+        if (g_strcmp0(token.word, "--") == 0) is_comment = 1;
+        if (is_comment) continue;
+
+        if (token.type != 'W') {
+            handle_error(ERR_GENERIC_ERROR);
+            fprintf(stderr, "-----> Invalid local: %s\n", token.word);
+            return;
+        }
+        g_ptr_array_add(_compile_locals, g_strdup(token.word));
+    }
+
+    if (_compile_locals->len) {
+        compile_local("locals", EC_enter_locals, _compile_locals->len);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Compiles a store into the local named by the next word.
+*/
+// -----------------------------------------------------------------------------
+void EC_to(gpointer gp_entry) {
+    Token token = get_token();
+    gint index = find_local(token.word);
+
+    if (index < 0) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Unknown local: %s\n", token.word);
+        return;
+    }
+
+    compile_local("local!", EC_store_local, index);
+}
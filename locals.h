@@ -0,0 +1,22 @@
+/** \file locals.h
+*/
+
+#pragma once
+
+gint find_local(const gchar *word);
+void clear_compile_locals();
+void compile_local(const gchar *word, routine_ptr routine, gint index);
+
+void release_locals(Frame *frame);
+void clear_locals();
+void destroy_locals();
+
+void IC_enter_locals(Instruction *instruction);
+void IC_fetch_local(Instruction *instruction);
+void IC_store_local(Instruction *instruction);
+
+void EC_enter_locals(gpointer gp_entry);
+void EC_fetch_local(gpointer gp_entry);
+void EC_store_local(gpointer gp_entry);
+void EC_begin_locals(gpointer gp_entry);
+void EC_to(gpointer gp_entry);
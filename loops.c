@@ -0,0 +1,548 @@
+/** \file loops.c
+
+\brief Counted and indefinite loops for definitions.
+
+Indefinite loops only need branches, so they're compiled into jmp and
+jmp-if-false pseudo entries like "if", but with targets before the branch:
+
+    begin ... flag until
+    begin ... flag while ... repeat
+    begin ... again
+
+Counted loops run their body for each index from start up to (but not
+including) limit:
+
+    : squares   10 0 do  i i * .  loop ;
+
+"+loop" pops the step to add to the index instead of 1. The loop ends when the
+index crosses the boundary between limit-1 and limit, so a negative step counts
+down through limit. The body is skipped if start equals limit. "i" pushes the
+index of the innermost loop, "j" the index of the loop around it, and "leave"
+ends the innermost loop right away.
+
+Counted loops are compiled into Instructions that branch directly:
+
+- IC_do: Starts a loop (or jumps past it if start equals limit)
+- IC_loop, IC_plus_loop: Steps the index and jumps back to the body unless done
+- IC_leave: Ends the loop and jumps past it
+
+The index and limit of each running loop are kept in _loops, which grows and
+shrinks along with the return stack like _locals (see push_frame_r and
+pop_frame_r). Returning from a definition ends its loops, and loops don't
+allocate anything once _loops has grown to the deepest nesting used.
+*/
+
+#define INITIAL_LOOPS_SIZE  64     /**< \brief Number of Loops preallocated */
+
+
+// -----------------------------------------------------------------------------
+/** Ends every running loop.
+*/
+// -----------------------------------------------------------------------------
+void clear_loops() {
+    _loops_depth = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees the running loops.
+*/
+// -----------------------------------------------------------------------------
+void destroy_loops() {
+    g_free(_loops);
+    _loops = NULL;
+    _loops_depth = 0;
+    _loops_size = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops the start and limit of a counted loop and starts it.
+
+\returns 1 if the body should run; 0 if start equals limit; -1 on error
+*/
+// -----------------------------------------------------------------------------
+gint start_loop() {
+    const Param *start = peek_param(0);
+    const Param *limit = peek_param(1);
+
+    if (!limit) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return -1;
+    }
+
+    if (start->type != 'I' || limit->type != 'I') {
+        Param param;
+        copy_param(&param, start->type != 'I' ? start : limit);
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&param, stderr, "----> ");
+        clear_param(&param);
+        return -1;
+    }
+
+    if (start->val_int == limit->val_int) {
+        drop_values(2);
+        return 0;
+    }
+
+    if (_loops_depth == _loops_size) {
+        _loops_size = _loops_size ? _loops_size * 2 : INITIAL_LOOPS_SIZE;
+        _loops = g_renew(Loop, _loops, _loops_size);
+    }
+
+    Loop *loop = _loops + _loops_depth++;
+    loop->index = start->val_int;
+    loop->limit = limit->val_int;
+    drop_values(2);
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Adds a step to the index of the innermost loop.
+
+\returns 1 if the body should run again; 0 if the loop has ended
+*/
+// -----------------------------------------------------------------------------
+gboolean step_loop(gint64 step) {
+    Loop *loop = _loops + _loops_depth - 1;
+
+    // The loop ends when index - limit changes sign (ints wrap around here)
+    gint64 before = (gint64) ((guint64) loop->index - (guint64) loop->limit);
+    gint64 after = (gint64) ((guint64) before + (guint64) step);
+    loop->index = (gint64) ((guint64) loop->index + (guint64) step);
+
+    if ((before ^ after) < 0) {
+        _loops_depth--;
+        return 0;
+    }
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a step and adds it to the index of the innermost loop.
+
+\returns 1 if the body should run again; 0 if the loop has ended; -1 on error
+*/
+// -----------------------------------------------------------------------------
+gint step_loop_by_top() {
+    Param step;
+    if (!pop_value(&step)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        return -1;
+    }
+
+    if (step.type != 'I') {
+        handle_error(ERR_INVALID_PARAM);
+        print_param(&step, stderr, "----> ");
+        clear_param(&step);
+        return -1;
+    }
+
+    return step_loop(step.val_int);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends the innermost loop.
+*/
+// -----------------------------------------------------------------------------
+void end_loop() {
+    _loops_depth--;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Starts a counted loop or jumps past it.
+*/
+// -----------------------------------------------------------------------------
+void IC_do(Instruction *instruction) {
+    if (start_loop() == 0) {
+        _ip = instruction->operand.target;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Steps a counted loop by 1 and jumps back to its body unless it's done.
+*/
+// -----------------------------------------------------------------------------
+void IC_loop(Instruction *instruction) {
+    if (step_loop(1)) {
+        _ip = instruction->operand.target;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Steps a counted loop by a popped step and jumps back to its body unless
+it's done.
+*/
+// -----------------------------------------------------------------------------
+void IC_plus_loop(Instruction *instruction) {
+    if (step_loop_by_top() == 1) {
+        _ip = instruction->operand.target;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends a counted loop and jumps past it.
+*/
+// -----------------------------------------------------------------------------
+void IC_leave(Instruction *instruction) {
+    end_loop();
+    _ip = instruction->operand.target;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Routine of the pseudo entry that starts a counted loop.
+
+Like the jmp pseudo entries, the pseudo entries of counted loops are compiled
+into Instructions (IC_do, IC_loop, IC_plus_loop, and IC_leave), so there's
+nothing to do here. Their first param is the offset of the Instruction to jump
+to.
+*/
+// -----------------------------------------------------------------------------
+void EC_enter_loop(gpointer gp_entry) {
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Routine of the pseudo entry that steps a counted loop by 1 (see IC_loop).
+*/
+// -----------------------------------------------------------------------------
+void EC_next_loop(gpointer gp_entry) {
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Routine of the pseudo entry that steps a counted loop by a popped step
+(see IC_plus_loop).
+*/
+// -----------------------------------------------------------------------------
+void EC_next_loop_by(gpointer gp_entry) {
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Routine of the pseudo entry that ends a counted loop (see IC_leave).
+*/
+// -----------------------------------------------------------------------------
+void EC_exit_loop(gpointer gp_entry) {
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes the index of a loop running in the current definition.
+
+\param depth: 0 for the innermost loop, 1 for the one around it
+*/
+// -----------------------------------------------------------------------------
+static void push_loop_index(guint depth, const gchar *word) {
+    Frame *frame = top_frame_r();
+    if (!frame || _loops_depth <= frame->loops + depth) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> '%s' used outside a loop\n", word);
+        return;
+    }
+
+    push_int(_loops[_loops_depth - 1 - depth].index);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** ( -- index) Pushes the index of the innermost loop.
+*/
+// -----------------------------------------------------------------------------
+void EC_i(gpointer gp_entry) {
+    push_loop_index(0, "i");
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** ( -- index) Pushes the index of the loop around the innermost one.
+*/
+// -----------------------------------------------------------------------------
+void EC_j(gpointer gp_entry) {
+    push_loop_index(1, "j");
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if loops can be compiled; otherwise handles the error.
+*/
+// -----------------------------------------------------------------------------
+static gboolean check_compiling(const gchar *word) {
+    if (_mode == 'C' || _compile_target) return 1;
+
+    handle_error(ERR_GENERIC_ERROR);
+    fprintf(stderr, "-----> '%s' can only be compiled\n", word);
+    return 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Adds a loop pseudo entry to the definition being compiled.
+
+\param target: Offset of the Instruction to jump to (or -1 to fill it in later)
+\returns The pseudo entry
+*/
+// -----------------------------------------------------------------------------
+static Entry *add_loop_param(const gchar *word, routine_ptr routine, gint64 target) {
+    Param *pseudo_param = new_pseudo_entry_param(word, routine);
+    if (target >= 0) add_entry_param(pseudo_param->val_pseudo_entry, new_int_param(target));
+    add_entry_param(compile_target(), pseudo_param);
+    return pseudo_param->val_pseudo_entry;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the offset of the next param of the definition being compiled.
+*/
+// -----------------------------------------------------------------------------
+static gint64 next_offset() {
+    return g_sequence_get_length(compile_target()->params);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops the offset pushed by "begin".
+
+\returns The offset or -1 (after handling the error) if there isn't one
+*/
+// -----------------------------------------------------------------------------
+static gint64 pop_dest(const gchar *word) {
+    Param *param = pop_param();
+    gint64 result = param && param->type == 'I' ? param->val_int : -1;
+    if (param) free_param(param);
+
+    if (result < 0) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> '%s' without 'begin'\n", word);
+    }
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a pseudo entry pushed by a loop word.
+
+\param routine: Routine the pseudo entry should have
+\returns The pseudo entry or NULL (after handling the error) if there isn't one
+*/
+// -----------------------------------------------------------------------------
+static Entry *pop_orig(const gchar *word, routine_ptr routine, const gchar *opening_word) {
+    Param *param = pop_param();
+    Entry *result = param && param->type == 'E' && param->val_entry &&
+                    ((Entry *) param->val_entry)->routine == routine ? param->val_entry : NULL;
+    if (param) free_param(param);
+
+    if (!result) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> '%s' without '%s'\n", word, opening_word);
+    }
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Starts an indefinite loop by pushing the offset of its body.
+*/
+// -----------------------------------------------------------------------------
+void EC_begin(gpointer gp_entry) {
+    if (!check_compiling("begin")) return;
+    push_param(new_int_param(next_offset()));
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends an indefinite loop that repeats until a popped flag is true.
+*/
+// -----------------------------------------------------------------------------
+void EC_until(gpointer gp_entry) {
+    gint64 dest = pop_dest("until");
+    if (dest < 0) return;
+    add_loop_param("jmp-if-false", EC_jmp_if_false, dest);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends an indefinite loop that only ends with an error or a return.
+*/
+// -----------------------------------------------------------------------------
+void EC_again(gpointer gp_entry) {
+    gint64 dest = pop_dest("again");
+    if (dest < 0) return;
+    add_loop_param("jmp", EC_jmp, dest);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Exits an indefinite loop if a popped flag is false.
+
+The jmp-if-false is filled in by "repeat", so it's pushed beneath the offset
+of the body.
+*/
+// -----------------------------------------------------------------------------
+void EC_while(gpointer gp_entry) {
+    gint64 dest = pop_dest("while");
+    if (dest < 0) return;
+
+    Entry *pseudo_entry = add_loop_param("jmp-if-false", EC_jmp_if_false, -1);
+    push_param(new_entry_param(pseudo_entry));
+    push_param(new_int_param(dest));
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends an indefinite loop with a "while" by jumping back to its body.
+*/
+// -----------------------------------------------------------------------------
+void EC_repeat(gpointer gp_entry) {
+    gint64 dest = pop_dest("repeat");
+    if (dest < 0) return;
+
+    Entry *entry_while = pop_orig("repeat", EC_jmp_if_false, "while");
+    if (!entry_while) return;
+
+    add_loop_param("jmp", EC_jmp, dest);
+    add_entry_param(entry_while, new_int_param(next_offset()));
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Starts a counted loop.
+
+The target of the pseudo entry is filled in by "loop" or "+loop", so the
+pseudo entry is pushed onto the stack.
+*/
+// -----------------------------------------------------------------------------
+void EC_do(gpointer gp_entry) {
+    if (!check_compiling("do")) return;
+
+    Entry *pseudo_entry = add_loop_param("do", EC_enter_loop, -1);
+    push_param(new_entry_param(pseudo_entry));
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Exits the innermost counted loop.
+
+The target is filled in by the "loop" or "+loop" that ends the loop.
+*/
+// -----------------------------------------------------------------------------
+void EC_leave(gpointer gp_entry) {
+    if (!check_compiling("leave")) return;
+
+    // The loop may be inside an "if" or an indefinite loop
+    gboolean in_loop = 0;
+    for (guint i=0; i < stack_depth(); i++) {
+        const Param *param = peek_param(i);
+        if (param->type == 'E' && param->val_entry && ((Entry *) param->val_entry)->routine == EC_enter_loop) {
+            in_loop = 1;
+            break;
+        }
+    }
+
+    if (!in_loop) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> 'leave' without 'do'\n");
+        return;
+    }
+
+    add_loop_param("leave", EC_exit_loop, -1);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends a counted loop with a pseudo entry that jumps back to its body.
+
+The "do" and any "leave"s in the body (but not in nested loops, which already
+have theirs) jump to the Instruction after the loop.
+*/
+// -----------------------------------------------------------------------------
+static void end_counted_loop(const gchar *word, routine_ptr routine) {
+    Entry *entry_do = pop_orig(word, EC_enter_loop, "do");
+    if (!entry_do) return;
+
+    Entry *entry_target = compile_target();
+
+    // Find the "do" from the end, since loops are usually short
+    GSequenceIter *iter = g_sequence_get_end_iter(entry_target->params);
+    gint64 offset_do = next_offset();
+    Param *param;
+    do {
+        iter = g_sequence_iter_prev(iter);
+        offset_do--;
+        param = g_sequence_get(iter);
+    } while (param->type != 'P' || param->val_pseudo_entry != entry_do);
+
+    add_loop_param(word, routine, offset_do + 1);
+    gint64 offset_end = next_offset();
+
+    for (iter = g_sequence_get_iter_at_pos(entry_target->params, offset_do);
+         !g_sequence_iter_is_end(iter);
+         iter = g_sequence_iter_next(iter)) {
+
+        param = g_sequence_get(iter);
+        if (param->type != 'P') continue;
+
+        Entry *pseudo_entry = param->val_pseudo_entry;
+        gboolean is_open = g_sequence_is_empty(pseudo_entry->params);
+        if (pseudo_entry == entry_do || (pseudo_entry->routine == EC_exit_loop && is_open)) {
+            add_entry_param(pseudo_entry, new_int_param(offset_end));
+        }
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends a counted loop that steps by 1.
+*/
+// -----------------------------------------------------------------------------
+void EC_loop(gpointer gp_entry) {
+    end_counted_loop("loop", EC_next_loop);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Ends a counted loop that steps by a popped step.
+*/
+// -----------------------------------------------------------------------------
+void EC_plus_loop(gpointer gp_entry) {
+    end_counted_loop("+loop", EC_next_loop_by);
+}
@@ -0,0 +1,34 @@
+/** \file loops.h
+*/
+
+#pragma once
+
+void clear_loops();
+void destroy_loops();
+
+gint start_loop();
+gboolean step_loop(gint64 step);
+gint step_loop_by_top();
+void end_loop();
+
+void IC_do(Instruction *instruction);
+void IC_loop(Instruction *instruction);
+void IC_plus_loop(Instruction *instruction);
+void IC_leave(Instruction *instruction);
+
+void EC_enter_loop(gpointer gp_entry);
+void EC_next_loop(gpointer gp_entry);
+void EC_next_loop_by(gpointer gp_entry);
+void EC_exit_loop(gpointer gp_entry);
+
+void EC_i(gpointer gp_entry);
+void EC_j(gpointer gp_entry);
+void EC_begin(gpointer gp_entry);
+void EC_until(gpointer gp_entry);
+void EC_again(gpointer gp_entry);
+void EC_while(gpointer gp_entry);
+void EC_repeat(gpointer gp_entry);
+void EC_do(gpointer gp_entry);
+void EC_leave(gpointer gp_entry);
+void EC_loop(gpointer gp_entry);
+void EC_plus_loop(gpointer gp_entry);
@@ -0,0 +1,236 @@
+/** \file object.c
+
+\brief Defines objects: reference counted custom data with a type descriptor.
+
+An 'O' param holds an Object. The ObjectType of an Object says how to free,
+copy, print, and inspect its data, so generic words (e.g., "pop", ".", and
+"len") work on any kind of object without knowing what's in it.
+
+Like arrays, objects are shared rather than copied: copy_param acquires another
+reference and clear_param releases it, so "dup" and variables share a sequence
+of Tasks, and the sequence is freed when the last param is released. A word
+that changes an object in place (e.g., sorting a sequence) calls
+unshare_object first, so other params sharing it don't see the change.
+
+'C' params are still used for borrowed pointers (e.g., an element of an object
+or a database connection); they're never freed by the interpreter. When a
+borrowed element has to outlive the param holding its collection (e.g., "nth"),
+it's turned into an element object that keeps the collection alive (see
+own_element).
+*/
+
+
+/** \brief Data of an element object: a borrowed pointer and what it points into
+*/
+typedef struct {
+    gpointer item;              /**< \brief The borrowed custom data (e.g., a Task) */
+    const gchar *comment;       /**< \brief Interned comment of the 'C' param it came from */
+    gpointer owner;             /**< \brief What item points into (e.g., an Object or Array) */
+    GDestroyNotify release_owner;  /**< \brief Releases the reference to owner */
+} Element;
+
+
+// -----------------------------------------------------------------------------
+/** Creates an Object that owns some custom data.
+
+\param type: Describes the data (must outlive the Object)
+\param data: Data to take over (freed with type->free)
+\returns A new Object with one reference
+*/
+// -----------------------------------------------------------------------------
+Object *new_object(const ObjectType *type, gpointer data) {
+    Object *result = g_new(Object, 1);
+    result->ref_count = 1;
+    result->type = type;
+    result->data = data;
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Acquires another reference to an Object.
+*/
+// -----------------------------------------------------------------------------
+Object *acquire_object(Object *object) {
+    object->ref_count++;
+    return object;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Releases a reference to an Object, freeing its data once nothing shares it.
+*/
+// -----------------------------------------------------------------------------
+void release_object(Object *object) {
+    if (--object->ref_count > 0) return;
+
+    if (object->data) object->type->free(object->data);
+    g_free(object);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints an Object on one line (by default, its type name and length).
+*/
+// -----------------------------------------------------------------------------
+void print_object(const Object *object, FILE *file) {
+    const ObjectType *type = object->type;
+
+    if (type->print) {
+        type->print(object->data, file);
+    }
+    else if (type->length) {
+        fprintf(file, "%s (%u)", type->name, type->length(object->data));
+    }
+    else {
+        fprintf(file, "%s", type->name);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets the data of an object param so it can be changed in place.
+
+\param param: 'O' param (it gets its own copy of the Object if other params
+              share it)
+\returns The data or NULL (after handling the error) if it can't be copied
+*/
+// -----------------------------------------------------------------------------
+gpointer unshare_object(Param *param) {
+    Object *object = param->val_object;
+    if (object->ref_count == 1) return object->data;
+
+    if (!object->type->clone) {
+        handle_error(ERR_GENERIC_ERROR);
+        fprintf(stderr, "-----> Can't change a shared %s\n", object->type->name);
+        return NULL;
+    }
+
+    param->val_object = new_object(object->type, object->type->clone(object->data));
+    release_object(object);
+    return param->val_object->data;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops an object param off the stack.
+
+\param dst: Receives the param (release it with clear_param when done)
+\param type: Required type of the Object (NULL for any type)
+\returns The data of the Object or NULL (after handling the error) if the top
+         of the stack isn't that kind of object
+*/
+// -----------------------------------------------------------------------------
+gpointer pop_object(Param *dst, const ObjectType *type) {
+    if (!pop_value(dst)) {
+        handle_error(ERR_STACK_UNDERFLOW);
+        dst->type = '?';
+        return NULL;
+    }
+
+    if (dst->type == 'O' && (!type || dst->val_object->type == type)) {
+        return dst->val_object->data;
+    }
+
+    handle_error(ERR_INVALID_PARAM);
+    print_param(dst, stderr, "----> ");
+    if (type) fprintf(stderr, "-----> Expected %s\n", type->name);
+    clear_param(dst);
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Releases the owner of an element object (see element_type).
+*/
+// -----------------------------------------------------------------------------
+static void free_element(gpointer data) {
+    Element *element = data;
+    element->release_owner(element->owner);
+    g_free(element);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints an element object like the 'C' param it came from.
+*/
+// -----------------------------------------------------------------------------
+static void print_element(gconstpointer data, FILE *file) {
+    const Element *element = data;
+    fprintf(file, "%s", element->comment);
+}
+
+
+
+/** \brief Type of the objects made by own_element
+*/
+static const ObjectType element_type = {
+    .name = "element",
+    .free = free_element,
+    .print = print_element
+};
+
+
+
+// -----------------------------------------------------------------------------
+/** Makes a borrowed element keep what it points into alive.
+
+\param param: Element of a collection (e.g., from get_element). A 'C' param is
+              turned into an element object; anything else is left as is.
+\param owner: A reference to what the element points into (taken over)
+\param release_owner: Releases owner (e.g., release_object)
+
+Words that get custom data from a param (e.g., field getters) should use
+custom_data so they work with element objects as well as 'C' params.
+*/
+// -----------------------------------------------------------------------------
+void own_element(Param *param, gpointer owner, GDestroyNotify release_owner) {
+    if (param->type != 'C') {
+        release_owner(owner);
+        return;
+    }
+
+    Element *element = g_new(Element, 1);
+    element->item = param->val_custom;
+    element->comment = param->val_custom_comment;
+    element->owner = owner;
+    element->release_owner = release_owner;
+
+    param->type = 'O';
+    param->val_object = new_object(&element_type, element);
+    param->val_custom_comment = NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets the custom data of a 'C' param or an element object (see own_element).
+
+\param comment: Receives the interned comment of the data (may be NULL)
+\returns The custom data or NULL if the param doesn't have any
+*/
+// -----------------------------------------------------------------------------
+gpointer custom_data(const Param *param, const gchar **comment) {
+    gpointer result = NULL;
+    const gchar *result_comment = NULL;
+
+    if (param->type == 'C') {
+        result = param->val_custom;
+        result_comment = param->val_custom_comment;
+    }
+    else if (param->type == 'O' && param->val_object->type == &element_type) {
+        const Element *element = param->val_object->data;
+        result = element->item;
+        result_comment = element->comment;
+    }
+
+    if (comment) *comment = result_comment;
+    return result;
+}
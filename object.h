@@ -0,0 +1,15 @@
+/** \file object.h
+*/
+
+#pragma once
+
+Object *new_object(const ObjectType *type, gpointer data);
+Object *acquire_object(Object *object);
+void release_object(Object *object);
+
+void print_object(const Object *object, FILE *file);
+gpointer unshare_object(Param *param);
+gpointer pop_object(Param *dst, const ObjectType *type);
+
+void own_element(Param *param, gpointer owner, GDestroyNotify release_owner);
+gpointer custom_data(const Param *param, const gchar **comment);
@@ -0,0 +1,453 @@
+/** \file optimize.c
+
+\brief Simplifies the threaded code of a definition when it's completed.
+
+compile_definition turns each param of a definition into one Instruction, so
+the code follows the source exactly. Before the code is used, optimize_code
+makes these passes over it until nothing changes:
+
+- Jump threading: A branch (including those of counted loops) whose target is
+  a jmp goes straight to that jmp's target. A jmp to the end of the definition
+  becomes an exit, and a jmp to the next Instruction is removed.
+- Constant conditions: An int literal followed by a jmp-if-false is replaced
+  by a jmp (if the literal is 0) or removed (otherwise).
+- Constant folding: Calls to constants become literals. A pure word (see
+  add_pure_word) whose inputs are all literals is run at compile time and is
+  replaced along with its inputs by its result.
+- Dead code: Instructions after a jmp, a leave, or an exit that can't be
+  branched to are removed.
+
+Once nothing else changes, a numeric literal followed by a call to a literal
+word (see add_literal_word) is merged into one Instruction that takes the
+literal as its operand, e.g. "2 *" multiplies the top of the stack by 2.
+
+An Instruction that is the target of a branch is never merged with the one
+before it. Literals created by folding are kept in entry->code_params.
+
+Optimization can be turned off with "optimize-off" so that ".d" shows the code
+exactly as it was compiled.
+*/
+
+
+/** \brief A word that can be run at compile time (see add_pure_word)
+*/
+typedef struct {
+    guint num_inputs;           /**< \brief Number of params popped */
+    guint num_outputs;          /**< \brief Number of params pushed (0 or 1) */
+    const gchar *input_types;   /**< \brief Param types the inputs may have (NULL for any) */
+} PureWord;
+
+
+// -----------------------------------------------------------------------------
+/** Registers a routine as pure so calls to it can be folded at compile time.
+
+\param routine: Routine of a native word
+\param num_inputs: Number of params it pops
+\param num_outputs: Number of params it pushes (0 or 1)
+\param input_types: Types each input must have to be folded (e.g., "ID"), or
+                    NULL if any type will do
+
+A pure routine only depends on its inputs, has no side effects, and can't fail
+when its inputs have one of the input_types.
+*/
+// -----------------------------------------------------------------------------
+void add_pure_word(routine_ptr routine, guint num_inputs, guint num_outputs, const gchar *input_types) {
+    if (!_pure_words) {
+        _pure_words = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+
+    PureWord *pure_word = g_new(PureWord, 1);
+    pure_word->num_inputs = num_inputs;
+    pure_word->num_outputs = num_outputs;
+    pure_word->input_types = input_types;
+    g_hash_table_replace(_pure_words, (gpointer) routine, pure_word);
+}
+
+
+
+/** \brief A word that can take a literal operand (see add_literal_word)
+*/
+typedef struct {
+    instruction_ptr literal_code;   /**< \brief Code that takes the literal as its operand */
+    const gchar *word;              /**< \brief Word printed for the merged Instruction */
+} LiteralWord;
+
+
+// -----------------------------------------------------------------------------
+/** Registers the code that replaces a call to a word on a numeric literal.
+
+\param routine: Routine of a native word that pops two params
+\param literal_code: Code that works like the routine, but with the second
+                     param taken from its operand (an int or double literal)
+\param word: Word of the native word (e.g., "*")
+*/
+// -----------------------------------------------------------------------------
+void add_literal_word(routine_ptr routine, instruction_ptr literal_code, const gchar *word) {
+    if (!_literal_words) {
+        _literal_words = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+
+    LiteralWord *literal_word = g_new(LiteralWord, 1);
+    literal_word->literal_code = literal_code;
+    literal_word->word = word;
+    g_hash_table_replace(_literal_words, (gpointer) routine, literal_word);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the word of a literal word's code (or NULL if the code isn't one).
+*/
+// -----------------------------------------------------------------------------
+const gchar *literal_word(instruction_ptr code) {
+    if (!_literal_words) return NULL;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, _literal_words);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const LiteralWord *literal_word = value;
+        if (literal_word->literal_code == code) return literal_word->word;
+    }
+    return NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if an Instruction is a call to an entry with the given routine.
+*/
+// -----------------------------------------------------------------------------
+static gboolean is_call_to(Instruction *instruction, routine_ptr routine) {
+    return instruction->code == IC_call && instruction->operand.entry->routine == routine;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if an Instruction branches to its target.
+*/
+// -----------------------------------------------------------------------------
+gboolean is_branch(const Instruction *instruction) {
+    return instruction->code == IC_jmp || instruction->code == IC_jmp_if_false ||
+           instruction->code == IC_do || instruction->code == IC_loop ||
+           instruction->code == IC_plus_loop || instruction->code == IC_leave;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Notes which Instructions are branched to.
+
+\returns Array with an element for each Instruction (and the terminator)
+*/
+// -----------------------------------------------------------------------------
+static gboolean *find_targets(Instruction *code, gint num_instructions) {
+    gboolean *result = g_new0(gboolean, num_instructions + 1);
+    for (gint i=0; i < num_instructions; i++) {
+        if (is_branch(code + i)) {
+            result[code[i].operand.target - code] = 1;
+        }
+    }
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Removes Instructions and updates branch targets.
+
+\returns Number of Instructions left
+
+A branch to a removed Instruction goes to the next Instruction that's left.
+*/
+// -----------------------------------------------------------------------------
+static gint remove_instructions(Instruction *code, gint num_instructions, gboolean *removed) {
+    gint *new_index = g_new(gint, num_instructions + 1);
+    gint num_left = 0;
+    for (gint i=0; i <= num_instructions; i++) {
+        new_index[i] = num_left;
+        if (i < num_instructions && !removed[i]) num_left++;
+    }
+
+    gint dst = 0;
+    for (gint i=0; i < num_instructions; i++) {
+        if (removed[i]) continue;
+
+        Instruction instruction = code[i];
+        if (is_branch(&instruction)) {
+            instruction.operand.target = code + new_index[instruction.operand.target - code];
+        }
+        code[dst++] = instruction;
+    }
+    code[dst] = code[num_instructions];
+
+    g_free(new_index);
+    return num_left;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Threads jumps through jmps and removes jmps to the next Instruction.
+*/
+// -----------------------------------------------------------------------------
+static gboolean thread_jumps(Instruction *code, gint num_instructions, gboolean *removed) {
+    gboolean result = 0;
+
+    for (gint i=0; i < num_instructions; i++) {
+        if (!is_branch(code + i)) continue;
+
+        // Follow jmp chains (bounded in case of a loop)
+        Instruction *target = code[i].operand.target;
+        for (gint hops=0; target->code == IC_jmp && target != code + i && hops < num_instructions; hops++) {
+            target = target->operand.target;
+        }
+        if (target != code[i].operand.target) {
+            code[i].operand.target = target;
+            result = 1;
+        }
+
+        if (code[i].code != IC_jmp) continue;
+
+        if (target->code == IC_exit) {
+            code[i].code = IC_exit;
+            code[i].operand.entry = NULL;
+            result = 1;
+        }
+        else if (target == code + i + 1) {
+            removed[i] = 1;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Resolves jmp-if-falses whose condition is an int literal.
+*/
+// -----------------------------------------------------------------------------
+static gboolean fold_conditions(Instruction *code, gint num_instructions, gboolean *targets, gboolean *removed) {
+    gboolean result = 0;
+
+    for (gint i=1; i < num_instructions; i++) {
+        if (code[i].code != IC_jmp_if_false || targets[i]) continue;
+        if (code[i-1].code != IC_push_literal || removed[i-1]) continue;
+
+        Param *condition = code[i-1].operand.param;
+        if (condition->type != 'I') continue;
+
+        removed[i-1] = 1;
+        if (condition->val_int == 0) {
+            code[i].code = IC_jmp;
+        }
+        else {
+            removed[i] = 1;
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Runs a pure word on literals and returns its result.
+
+\param literals: Instructions pushing the pure word's inputs
+\param result: Receives the output, if the pure word has one
+\returns 1 if the pure word was run; 0 if it can't be folded
+*/
+// -----------------------------------------------------------------------------
+static gboolean run_pure_word(Entry *entry, const PureWord *pure_word, Instruction *literals, Param *result) {
+    for (guint i=0; i < pure_word->num_inputs; i++) {
+        const Param *input = literals[i].operand.param;
+        if (pure_word->input_types && !strchr(pure_word->input_types, input->type)) return 0;
+    }
+
+    // Whatever is on the stack during compilation (e.g., from "if") is left alone
+    guint depth = stack_depth();
+    for (guint i=0; i < pure_word->num_inputs; i++) {
+        push_value(literals[i].operand.param);
+    }
+    execute(entry);
+
+    if (stack_depth() != depth + pure_word->num_outputs) {
+        while (stack_depth() > depth) {
+            Param extra;
+            pop_value(&extra);
+            clear_param(&extra);
+        }
+        return 0;
+    }
+
+    if (pure_word->num_outputs) pop_value(result);
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Replaces calls to constants and pure words on literals with their results.
+*/
+// -----------------------------------------------------------------------------
+static gboolean fold_literals(Entry *entry, Instruction *code, gint num_instructions, gboolean *targets, gboolean *removed) {
+    gboolean result = 0;
+
+    for (gint i=0; i < num_instructions; i++) {
+        if (code[i].code != IC_call) continue;
+        Entry *callee = code[i].operand.entry;
+
+        // Constants can't change, so their values can be pushed directly
+        if (is_call_to(code + i, EC_push_param0) && !g_sequence_is_empty(callee->params)) {
+            code[i].code = IC_push_literal;
+            code[i].operand.param = g_sequence_get(g_sequence_get_begin_iter(callee->params));
+            result = 1;
+            continue;
+        }
+
+        const PureWord *pure_word = _pure_words ? g_hash_table_lookup(_pure_words, (gpointer) callee->routine) : NULL;
+        if (!pure_word) continue;
+
+        // The inputs must be literals that can't be branched to (except the first)
+        gint first = i - pure_word->num_inputs;
+        if (first < 0) continue;
+
+        gboolean foldable = 1;
+        for (gint j=first; j < i; j++) {
+            if (code[j].code != IC_push_literal || removed[j]) foldable = 0;
+            if (j > first && targets[j]) foldable = 0;
+        }
+        if (targets[i] && pure_word->num_inputs > 0) foldable = 0;
+        if (!foldable) continue;
+
+        Param output;
+        if (!run_pure_word(callee, pure_word, code + first, &output)) continue;
+
+        for (gint j=first; j <= i; j++) removed[j] = 1;
+
+        if (pure_word->num_outputs) {
+            if (!entry->code_params) {
+                entry->code_params = g_ptr_array_new_with_free_func(free_param);
+            }
+            Param *literal = new_param();
+            *literal = output;
+            pool_adopt(literal);
+            g_ptr_array_add(entry->code_params, literal);
+
+            code[first].code = IC_push_literal;
+            code[first].operand.param = literal;
+            removed[first] = 0;
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Removes Instructions after a jmp, leave, or exit that can't be reached.
+*/
+// -----------------------------------------------------------------------------
+static gboolean remove_dead_code(Instruction *code, gint num_instructions, gboolean *targets, gboolean *removed) {
+    gboolean result = 0;
+
+    for (gint i=0; i < num_instructions; i++) {
+        if (code[i].code != IC_jmp && code[i].code != IC_leave && code[i].code != IC_exit) continue;
+        if (removed[i]) continue;
+
+        for (gint j=i+1; j < num_instructions && !targets[j]; j++) {
+            if (removed[j]) continue;
+            removed[j] = 1;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Merges numeric literals into the literal words that follow them.
+*/
+// -----------------------------------------------------------------------------
+static gboolean specialize_literals(Instruction *code, gint num_instructions, gboolean *targets, gboolean *removed) {
+    gboolean result = 0;
+
+    for (gint i=1; i < num_instructions; i++) {
+        if (code[i].code != IC_call || targets[i]) continue;
+        if (code[i-1].code != IC_push_literal) continue;
+
+        const Param *literal = code[i-1].operand.param;
+        if (literal->type != 'I' && literal->type != 'D') continue;
+
+        const LiteralWord *literal_word = _literal_words ?
+            g_hash_table_lookup(_literal_words, (gpointer) code[i].operand.entry->routine) : NULL;
+        if (!literal_word) continue;
+
+        code[i-1].code = literal_word->literal_code;
+        removed[i] = 1;
+        result = 1;
+    }
+
+    return result;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Optimizes the threaded code of a definition in place.
+
+\param entry: Definition the code belongs to
+\param code: Threaded code (terminated by an Instruction with NULL code)
+\param num_instructions: Number of Instructions before the terminator
+\returns Number of Instructions left
+*/
+// -----------------------------------------------------------------------------
+gint optimize_code(Entry *entry, Instruction *code, gint num_instructions) {
+    gboolean changed = 1;
+
+    while (changed) {
+        changed = 0;
+
+        // Each pass works from fresh branch targets
+        for (gint pass=0; pass < 4; pass++) {
+            gboolean *targets = find_targets(code, num_instructions);
+            gboolean *removed = g_new0(gboolean, num_instructions + 1);
+            gboolean pass_changed = 0;
+
+            switch (pass) {
+                case 0: pass_changed = thread_jumps(code, num_instructions, removed); break;
+                case 1: pass_changed = fold_conditions(code, num_instructions, targets, removed); break;
+                case 2: pass_changed = fold_literals(entry, code, num_instructions, targets, removed); break;
+                case 3: pass_changed = remove_dead_code(code, num_instructions, targets, removed); break;
+            }
+
+            if (pass_changed) {
+                num_instructions = remove_instructions(code, num_instructions, removed);
+                changed = 1;
+            }
+
+            g_free(targets);
+            g_free(removed);
+        }
+    }
+
+    // Literals are only merged once folding can't use them anymore
+    gboolean *targets = find_targets(code, num_instructions);
+    gboolean *removed = g_new0(gboolean, num_instructions + 1);
+    if (specialize_literals(code, num_instructions, targets, removed)) {
+        num_instructions = remove_instructions(code, num_instructions, removed);
+    }
+    g_free(targets);
+    g_free(removed);
+
+    return num_instructions;
+}
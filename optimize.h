@@ -0,0 +1,10 @@
+/** \file optimize.h
+*/
+
+#pragma once
+
+void add_pure_word(routine_ptr routine, guint num_inputs, guint num_outputs, const gchar *input_types);
+void add_literal_word(routine_ptr routine, instruction_ptr literal_code, const gchar *word);
+const gchar *literal_word(instruction_ptr code);
+gboolean is_branch(const Instruction *instruction);
+gint optimize_code(Entry *entry, Instruction *code, gint num_instructions);
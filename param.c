@@ -6,20 +6,29 @@ A Param can be pushed onto the parameter stack. They can also be added to the
 params array of an Entry.
 
 See \ref param_types "Param types" for a description of each type of parameter.
+
+Params on the stack are stored by value (see stack.c). The contents of a Param
+value (a string or a pseudo entry) can be released with clear_param without
+freeing the Param itself.
+
+Strings are immutable, reference counted GRefStrings. Copying a string Param
+(e.g., pushing a string literal or fetching a string variable) only acquires
+another reference to the same string. Arrays and objects are shared the same
+way (see array.c and object.c).
 */
 
 
 // -----------------------------------------------------------------------------
 /** Creates a new Param.
 
-\returns newly allocated Param
+\returns newly allocated Param (from _param_pool)
 */
 // -----------------------------------------------------------------------------
 Param *new_param() {
-    Param *result = g_new(Param, 1);
+    Param *result = pool_alloc(&_param_pool);
     result->type = '?';
-    result->val_string = NULL;
-    result->val_custom = NULL;
+    result->val_int = 0;
+    result->val_custom_comment = NULL;
     return result;
 }
 
@@ -60,13 +69,13 @@ Param *new_double_param(gdouble val_double) {
 // -----------------------------------------------------------------------------
 /** Creates a new string-valued Param
 
-\param str: String to copy
+\param str: String to copy into a new GRefString
 */
 // -----------------------------------------------------------------------------
 Param *new_str_param(const gchar *str) {
     Param *result = new_param();
     result->type = 'S';
-    result->val_string = g_strdup(str);
+    result->val_string = str ? g_ref_string_new(str) : NULL;
     return result;
 }
 
@@ -120,9 +129,9 @@ constants from a definition onto the param stack.
 Param *new_pseudo_entry_param(const gchar *word, routine_ptr routine) {
     Param *result = new_param();
     result->type = 'P';
-    g_strlcpy(result->val_pseudo_entry.word, word, MAX_WORD_LEN);
-    result->val_pseudo_entry.routine = routine;
-    result->val_pseudo_entry.params = g_sequence_new(free_param);
+    result->val_pseudo_entry = new_entry();
+    g_strlcpy(result->val_pseudo_entry->word, word, MAX_WORD_LEN);
+    result->val_pseudo_entry->routine = routine;
     return result;
 }
 
@@ -140,7 +149,7 @@ Param *new_custom_param(gpointer val_custom, const gchar *comment) {
     Param *result = new_param();
     result->type = 'C';
     result->val_custom = val_custom;
-    g_strlcpy(result->val_custom_comment, comment, MAX_WORD_LEN);
+    result->val_custom_comment = g_intern_string(comment);
     return result;
 }
 
@@ -149,15 +158,23 @@ Param *new_custom_param(gpointer val_custom, const gchar *comment) {
 // -----------------------------------------------------------------------------
 /** Copies fields of Param to another Param
 
-\note The string value is duplicated so that the destination Param can be freed
-      independently of the source Param.
+\note The destination Param acquires its own reference to a string, array, or
+      object value so that it can be freed independently of the source Param. Anything the
+      destination held before is *not* released (see clear_param).
 */
 // -----------------------------------------------------------------------------
-void copy_param(Param *dst, Param *src) {
+void copy_param(Param *dst, const Param *src) {
     *dst = *src;
 
-    // Make a copy of the string since the dst needs to own it
-    dst->val_string = g_strdup(src->val_string);
+    if (src->type == 'S' && src->val_string) {
+        dst->val_string = g_ref_string_acquire(src->val_string);
+    }
+    else if (src->type == 'A') {
+        acquire_array(src->val_array);
+    }
+    else if (src->type == 'O') {
+        acquire_object(src->val_object);
+    }
 }
 
 
@@ -171,7 +188,7 @@ void copy_param(Param *dst, Param *src) {
 
 */
 // -----------------------------------------------------------------------------
-void print_param(Param *param, FILE *file, const gchar *prefix) {
+void print_param(const Param *param, FILE *file, const gchar *prefix) {
     Entry *entry;
 
     switch (param->type) {
@@ -197,13 +214,25 @@ void print_param(Param *param, FILE *file, const gchar *prefix) {
             break;
 
         case 'P':
-            fprintf(file, "%sP: %s\n", prefix, param->val_pseudo_entry.word);
+            fprintf(file, "%sP: %s\n", prefix, param->val_pseudo_entry->word);
             break;
 
         case 'C':
             fprintf(file, "%sC: %s\n", prefix, param->val_custom_comment);
             break;
 
+        case 'A':
+            fprintf(file, "%sA: ", prefix);
+            print_array(param->val_array, file);
+            fprintf(file, "\n");
+            break;
+
+        case 'O':
+            fprintf(file, "%sO: ", prefix);
+            print_object(param->val_object, file);
+            fprintf(file, "\n");
+            break;
+
         default:
             fprintf(file, "%s%c: %s\n", prefix, param->type, "Unknown type");
             break;
@@ -212,6 +241,42 @@ void print_param(Param *param, FILE *file, const gchar *prefix) {
 
 
 
+// -----------------------------------------------------------------------------
+/** Releases the contents of a param and leaves it with an unknown type.
+
+\param param: Param whose string, array, object, or pseudo entry should be freed
+
+This is used for Param values that aren't dynamically allocated themselves
+(e.g., those popped with pop_value).
+
+\note This function does *not* free custom data.
+*/
+// -----------------------------------------------------------------------------
+void clear_param(Param *param) {
+    switch (param->type) {
+        case 'S':
+            if (param->val_string) g_ref_string_release(param->val_string);
+            break;
+
+        case 'P':
+            free_entry(param->val_pseudo_entry);
+            break;
+
+        case 'A':
+            release_array(param->val_array);
+            break;
+
+        case 'O':
+            release_object(param->val_object);
+            break;
+    }
+
+    param->type = '?';
+    param->val_int = 0;
+}
+
+
+
 // -----------------------------------------------------------------------------
 /** Frees memory for a param.
 
@@ -222,12 +287,8 @@ void print_param(Param *param, FILE *file, const gchar *prefix) {
 // -----------------------------------------------------------------------------
 void free_param(gpointer gp_param) {
     Param *param = gp_param;
-    g_free(param->val_string);
-
-
-    if (param->type == 'P') {
-        g_sequence_free(param->val_pseudo_entry.params);
-    }
+    if (!param) return;
 
-    g_free(param);
+    clear_param(param);
+    pool_free(&_param_pool, param);
 }
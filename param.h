@@ -12,6 +12,7 @@ Param *new_entry_param(Entry *val_entry);
 Param *new_routine_param(routine_ptr val_routine);
 Param *new_pseudo_entry_param(const gchar *word, routine_ptr routine);
 Param *new_custom_param(gpointer val_custom, const gchar *comment);
-void copy_param(Param *dst, Param *src);
-void print_param(Param *param, FILE *f, const gchar *prefix);
+void copy_param(Param *dst, const Param *src);
+void print_param(const Param *param, FILE *f, const gchar *prefix);
+void clear_param(Param *param);
 void free_param(gpointer param);
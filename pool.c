@@ -0,0 +1,194 @@
+/** \file pool.c
+
+\brief Free-list allocators for Param and Entry objects.
+
+Params and pseudo entries are created and freed constantly: literals are
+compiled into pseudo entries, routines pop and free Params, and sort
+comparators create a Param for every value they compare. Instead of going to
+g_new and g_free each time, these objects come from a Pool.
+
+A Pool carves fixed-size slots out of large slabs. Freed slots go onto a free
+list and are handed out again before a new slot is carved. Slabs are only
+returned to the system when the pools are destroyed at shutdown.
+
+Every slot has a small header noting whether it is free, transient, or owned.
+New objects are transient. A Param that is added to an Entry (see
+add_entry_param) is adopted and becomes owned. Transient Params are the ones
+that routines pop and are expected to free. When a routine hits an error it
+usually returns early without freeing them, so after an error the control loop
+calls release_transients to free them all at once.
+
+The number of live, peak, and recycled objects in each Pool can be printed
+with ".pool".
+*/
+
+#define SLAB_SLOTS  256   /**< \brief Number of slots carved from each slab */
+
+#define SLOT_FREE       0   /**< \brief Slot is on the free list */
+#define SLOT_TRANSIENT  1   /**< \brief Slot holds an object that hasn't been adopted */
+#define SLOT_OWNED      2   /**< \brief Slot holds an object owned by an Entry */
+
+
+/** \brief Header at the start of every slot. The object follows it.
+*/
+typedef struct _Slot {
+    struct _Slot *next_free;    /**< \brief Next slot on the free list */
+    gint state;                 /**< \brief SLOT_FREE, SLOT_TRANSIENT, or SLOT_OWNED */
+} Slot;
+
+
+#define SLOT_OBJECT(_slot_)  ((gpointer) ((Slot *) (_slot_) + 1))         /**< \brief Object held by a slot */
+#define OBJECT_SLOT(_obj_)   ((Slot *) (_obj_) - 1)                      /**< \brief Slot holding an object */
+
+
+// -----------------------------------------------------------------------------
+/** Sets the size of the objects a Pool allocates.
+
+\param pool: Pool to set up
+\param object_size: Size of each object (e.g., sizeof(Param))
+*/
+// -----------------------------------------------------------------------------
+void create_pool(Pool *pool, gsize object_size) {
+    pool->slot_size = sizeof(Slot) + ((object_size + 15) & ~(gsize) 15);
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->slab_used = SLAB_SLOTS;
+    pool->num_live = 0;
+    pool->num_peak = 0;
+    pool->num_recycled = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees all of a Pool's slabs, including any objects still allocated from them.
+*/
+// -----------------------------------------------------------------------------
+void destroy_pool(Pool *pool) {
+    g_slist_free_full(pool->slabs, g_free);
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->slab_used = SLAB_SLOTS;
+    pool->num_live = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Allocates a transient object from a Pool.
+
+\returns Uninitialized memory for one object
+*/
+// -----------------------------------------------------------------------------
+gpointer pool_alloc(Pool *pool) {
+    Slot *slot;
+
+    if (pool->free_list) {
+        slot = pool->free_list;
+        pool->free_list = slot->next_free;
+        pool->num_recycled++;
+    }
+    else {
+        if (pool->slab_used == SLAB_SLOTS) {
+            pool->slabs = g_slist_prepend(pool->slabs, g_malloc0(pool->slot_size * SLAB_SLOTS));
+            pool->slab_used = 0;
+        }
+        slot = (Slot *) ((gchar *) pool->slabs->data + pool->slot_size * pool->slab_used++);
+    }
+
+    slot->state = SLOT_TRANSIENT;
+    slot->next_free = NULL;
+
+    pool->num_live++;
+    if (pool->num_live > pool->num_peak) pool->num_peak = pool->num_live;
+
+    return SLOT_OBJECT(slot);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns an object to its Pool's free list.
+*/
+// -----------------------------------------------------------------------------
+void pool_free(Pool *pool, gpointer object) {
+    if (!object) return;
+
+    Slot *slot = OBJECT_SLOT(object);
+    slot->state = SLOT_FREE;
+    slot->next_free = pool->free_list;
+    pool->free_list = slot;
+
+    pool->num_live--;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Marks a transient object as owned so release_transients leaves it alone.
+*/
+// -----------------------------------------------------------------------------
+void pool_adopt(gpointer object) {
+    OBJECT_SLOT(object)->state = SLOT_OWNED;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees every transient Param if an error has requested it.
+
+This is called from the control loop, where no routine is running and so no
+transient Param is still in use. Slots that haven't been carved yet are zeroed
+and so look free.
+*/
+// -----------------------------------------------------------------------------
+void release_transients() {
+    if (!_release_transients) return;
+    _release_transients = 0;
+
+    for (GSList *slab = _param_pool.slabs; slab; slab = slab->next) {
+        for (guint i=0; i < SLAB_SLOTS; i++) {
+            Slot *slot = (Slot *) ((gchar *) slab->data + _param_pool.slot_size * i);
+            if (slot->state == SLOT_TRANSIENT) {
+                free_param(SLOT_OBJECT(slot));
+            }
+        }
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Creates the Param and Entry pools.
+*/
+// -----------------------------------------------------------------------------
+void create_pools() {
+    create_pool(&_param_pool, sizeof(Param));
+    create_pool(&_entry_pool, sizeof(Entry));
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Frees the Param and Entry pools.
+
+This is done at shutdown, after the dictionary has been destroyed, and
+releases anything that leaked along with the slabs.
+*/
+// -----------------------------------------------------------------------------
+void destroy_pools() {
+    destroy_pool(&_param_pool);
+    destroy_pool(&_entry_pool);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Prints the counts for a Pool.
+*/
+// -----------------------------------------------------------------------------
+void print_pool(Pool *pool, FILE *file) {
+    fprintf(file, "%s: live %u, peak %u, recycled %u, slabs %u\n",
+            pool->name, pool->num_live, pool->num_peak, pool->num_recycled,
+            g_slist_length(pool->slabs));
+}
@@ -0,0 +1,15 @@
+/** \file pool.h
+*/
+
+#pragma once
+
+void create_pool(Pool *pool, gsize object_size);
+void destroy_pool(Pool *pool);
+gpointer pool_alloc(Pool *pool);
+void pool_free(Pool *pool, gpointer object);
+void pool_adopt(gpointer object);
+void print_pool(Pool *pool, FILE *file);
+
+void create_pools();
+void release_transients();
+void destroy_pools();
@@ -0,0 +1,349 @@
+/** \file quicken.c
+
+\brief Rewrites calls to generic routines into type-specialized Instructions.
+
+Some routines check the types of their inputs every time they run even though a
+given call site almost always sees the same types. For instance, "@" in
+
+    : refresh-cur-task  *cur-task @ task_id g ;
+
+always fetches *cur-task, and task_id is always applied to a Task.
+
+When a definition is compiled, calls to routines that have a quickener (see
+add_quickener) are compiled into IC_quicken. The first time IC_quicken runs, the
+quickener looks at the stack and, if it recognizes the inputs, rewrites the
+Instruction in place into a specialized one whose inline cache remembers what
+it saw:
+
+- "@" on a variable: IC_fetch_variable, which pushes the variable's value slot
+  directly
+- "!" on a variable: IC_store_variable, which stores into the value slot
+  directly
+- A field getter on its object type (see add_field_getter): IC_get_field,
+  which loads the field at a known offset with a known type
+
+Each specialized Instruction starts with a guard that checks that the inputs
+are the ones in its inline cache. If they aren't, the Instruction is rewritten
+back into a plain IC_call of the generic routine, which it uses from then on.
+If a quickener doesn't recognize the inputs, the same happens right away.
+
+Quickening is part of optimization and is turned off by "optimize-off".
+*/
+
+
+/** \brief Describes a routine that pushes a field of a custom object (see add_field_getter)
+*/
+typedef struct {
+    const gchar *comment;       /**< \brief Interned comment of the objects the field belongs to */
+    gsize offset;               /**< \brief Offset of the field in the object */
+    gint field_type;            /**< \brief FIELD_INT64, FIELD_INT, FIELD_DOUBLE, or FIELD_CHARS */
+} FieldGetter;
+
+
+// -----------------------------------------------------------------------------
+/** Reads a field of an object into a param.
+*/
+// -----------------------------------------------------------------------------
+static void read_field(const FieldGetter *getter, gconstpointer obj, Param *dst) {
+    const gchar *field = (const gchar *) obj + getter->offset;
+    dst->val_custom_comment = NULL;
+
+    switch (getter->field_type) {
+        case FIELD_INT64:
+            dst->type = 'I';
+            dst->val_int = *(const gint64 *) field;
+            break;
+
+        case FIELD_INT:
+            dst->type = 'I';
+            dst->val_int = *(const gint *) field;
+            break;
+
+        case FIELD_DOUBLE:
+            dst->type = 'D';
+            dst->val_double = *(const gdouble *) field;
+            break;
+
+        case FIELD_CHARS:
+            dst->type = 'S';
+            dst->val_string = g_ref_string_new(field);
+            break;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Registers a quickener for calls to a routine.
+
+\param routine: Routine of a native word
+\param quickener: Function that specializes an Instruction calling the routine
+                  based on the stack, returning 1 if it did
+*/
+// -----------------------------------------------------------------------------
+void add_quickener(routine_ptr routine, quickener_ptr quickener) {
+    if (!_quickeners) {
+        _quickeners = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    g_hash_table_replace(_quickeners, (gpointer) routine, (gpointer) quickener);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Registers a routine that pushes a field of a custom object.
+
+\param routine: Routine defined with EC_OBJ_FIELD_GETTER
+\param comment: Comment of the custom Params holding the objects (e.g., "Task")
+\param offset: Offset of the field (e.g., G_STRUCT_OFFSET(Task, id))
+\param field_type: FIELD_INT64, FIELD_INT, FIELD_DOUBLE, or FIELD_CHARS
+
+Calls to the routine are quickened into typed loads of the field, and words
+that run it on many objects read the field directly instead (see get_field).
+*/
+// -----------------------------------------------------------------------------
+void add_field_getter(routine_ptr routine, const gchar *comment, gsize offset, gint field_type) {
+    if (!_field_getters) {
+        _field_getters = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+
+    FieldGetter *getter = g_new(FieldGetter, 1);
+    getter->comment = g_intern_string(comment);
+    getter->offset = offset;
+    getter->field_type = field_type;
+    g_hash_table_replace(_field_getters, (gpointer) routine, getter);
+
+    add_quickener(routine, quicken_get_field);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if calls to an Entry should be compiled into IC_quicken.
+*/
+// -----------------------------------------------------------------------------
+gboolean can_quicken(Entry *entry) {
+    return _quickeners && g_hash_table_contains(_quickeners, (gpointer) entry->routine);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if an Instruction is a call that is quickened or waiting to be.
+
+Like IC_call, these have the called Entry as their operand.
+*/
+// -----------------------------------------------------------------------------
+gboolean is_quickened_call(const Instruction *instruction) {
+    return instruction->code == IC_quicken ||
+           instruction->code == IC_fetch_variable ||
+           instruction->code == IC_store_variable ||
+           instruction->code == IC_get_field;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Turns an Instruction back into a generic call and runs it.
+*/
+// -----------------------------------------------------------------------------
+static void deoptimize(Instruction *instruction) {
+    instruction->code = IC_call;
+    instruction->cache.guard = NULL;
+    instruction->cache.data = NULL;
+    IC_call(instruction);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Specializes an Instruction the first time it runs.
+*/
+// -----------------------------------------------------------------------------
+void IC_quicken(Instruction *instruction) {
+    quickener_ptr quickener = g_hash_table_lookup(_quickeners, (gpointer) instruction->operand.entry->routine);
+
+    if (quickener && quickener(instruction)) {
+        instruction->code(instruction);
+        return;
+    }
+
+    deoptimize(instruction);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the variable Entry on top of the stack or NULL if there isn't one.
+*/
+// -----------------------------------------------------------------------------
+static Entry *top_variable() {
+    const Param *param_var = peek_param(0);
+    if (!param_var || param_var->type != 'E') return NULL;
+
+    Entry *entry_var = param_var->val_entry;
+    return entry_var->value ? entry_var : NULL;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Caches the variable on top of the stack and its value slot.
+*/
+// -----------------------------------------------------------------------------
+static gboolean cache_variable(Instruction *instruction, instruction_ptr code) {
+    Entry *entry_var = top_variable();
+    if (!entry_var) return 0;
+
+    instruction->code = code;
+    instruction->cache.guard = entry_var;
+    instruction->cache.data = entry_var->value;
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Quickens "@" on a variable into IC_fetch_variable.
+*/
+// -----------------------------------------------------------------------------
+gboolean quicken_fetch_variable(Instruction *instruction) {
+    return cache_variable(instruction, IC_fetch_variable);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Quickens "!" on a variable into IC_store_variable.
+*/
+// -----------------------------------------------------------------------------
+gboolean quicken_store_variable(Instruction *instruction) {
+    if (stack_depth() < 2) return 0;
+    return cache_variable(instruction, IC_store_variable);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Quickens a field getter on its object type into IC_get_field.
+*/
+// -----------------------------------------------------------------------------
+gboolean quicken_get_field(Instruction *instruction) {
+    FieldGetter *getter = g_hash_table_lookup(_field_getters, (gpointer) instruction->operand.entry->routine);
+    const Param *param_obj = peek_param(0);
+    if (!getter || !param_obj) return 0;
+
+    const gchar *comment;
+    if (!custom_data(param_obj, &comment) || comment != getter->comment) return 0;
+
+    instruction->code = IC_get_field;
+    instruction->cache.guard = getter->comment;
+    instruction->cache.data = getter;
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes the value of the cached variable, replacing its address.
+
+(variable -- val)
+*/
+// -----------------------------------------------------------------------------
+void IC_fetch_variable(Instruction *instruction) {
+    const Param *param_var = peek_param(0);
+    if (!param_var || param_var->type != 'E' || param_var->val_entry != instruction->cache.guard) {
+        deoptimize(instruction);
+        return;
+    }
+
+    // Variable addresses own nothing, so this just drops it
+    Param p_var;
+    pop_value(&p_var);
+
+    push_value(instruction->cache.data);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Stores a value in the cached variable's slot.
+
+(val variable -- )
+*/
+// -----------------------------------------------------------------------------
+void IC_store_variable(Instruction *instruction) {
+    const Param *param_var = peek_param(0);
+    if (stack_depth() < 2 || param_var->type != 'E' || param_var->val_entry != instruction->cache.guard) {
+        deoptimize(instruction);
+        return;
+    }
+
+    Param p_var;
+    pop_value(&p_var);
+
+    Param *var_value = instruction->cache.data;
+    clear_param(var_value);
+    pop_value(var_value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a field of the object on top of the stack, leaving the object there.
+
+(obj -- obj val)
+*/
+// -----------------------------------------------------------------------------
+void IC_get_field(Instruction *instruction) {
+    const Param *param_obj = peek_param(0);
+    const gchar *comment;
+    gpointer obj = param_obj ? custom_data(param_obj, &comment) : NULL;
+    if (!obj || comment != instruction->cache.guard) {
+        deoptimize(instruction);
+        return;
+    }
+
+    Param value;
+    read_field(instruction->cache.data, obj, &value);
+    push_value(&value);
+    clear_param(&value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Gets a field of an object directly if a routine is a field getter for it.
+
+\param routine: Routine of a word like "task_value" (obj -- obj val)
+\param param_obj: The object (a 'C' param or an element object; see custom_data)
+\param dst: Receives the value the routine would push (release it with
+           clear_param)
+\returns 1 if the field was read; 0 if the routine isn't a field getter for
+         this kind of object
+
+This lets words that apply a getter to many objects (e.g., sorting) skip
+running it.
+*/
+// -----------------------------------------------------------------------------
+gboolean get_field(routine_ptr routine, const Param *param_obj, Param *dst) {
+    const gchar *comment;
+    gpointer obj = custom_data(param_obj, &comment);
+    if (!_field_getters || !obj) return 0;
+
+    const FieldGetter *getter = g_hash_table_lookup(_field_getters, (gpointer) routine);
+    if (!getter || getter->comment != comment) return 0;
+
+    read_field(getter, obj, dst);
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns 1 if a routine was registered with add_field_getter.
+*/
+// -----------------------------------------------------------------------------
+gboolean is_field_getter(routine_ptr routine) {
+    return _field_getters && g_hash_table_lookup(_field_getters, (gpointer) routine);
+}
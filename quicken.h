@@ -0,0 +1,27 @@
+/** \file quicken.h
+*/
+
+#pragma once
+
+#define FIELD_INT64   0   /**< \brief Field is a gint64 */
+#define FIELD_INT     1   /**< \brief Field is a gint (or gboolean) */
+#define FIELD_DOUBLE  2   /**< \brief Field is a double */
+#define FIELD_CHARS   3   /**< \brief Field is a NUL terminated array of gchar */
+
+typedef gboolean (*quickener_ptr)(Instruction *instruction);  /**< \brief Function pointer type for quickeners (see add_quickener) */
+
+void add_quickener(routine_ptr routine, quickener_ptr quickener);
+void add_field_getter(routine_ptr routine, const gchar *comment, gsize offset, gint field_type);
+gboolean get_field(routine_ptr routine, const Param *param_obj, Param *dst);
+gboolean is_field_getter(routine_ptr routine);
+gboolean can_quicken(Entry *entry);
+gboolean is_quickened_call(const Instruction *instruction);
+
+gboolean quicken_fetch_variable(Instruction *instruction);
+gboolean quicken_store_variable(Instruction *instruction);
+gboolean quicken_get_field(Instruction *instruction);
+
+void IC_quicken(Instruction *instruction);
+void IC_fetch_variable(Instruction *instruction);
+void IC_store_variable(Instruction *instruction);
+void IC_get_field(Instruction *instruction);
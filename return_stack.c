@@ -3,17 +3,30 @@
 \brief Defines functions for creating, manipulating, and freeing the return stack.
 
 The return stack is used to keep track of execution stack frames when definitions
-are executed.
+are executed. Each Frame notes the definition being executed and the Instruction
+to return to once it's done.
+
+The return stack is a preallocated array of Frames so that calling a definition
+doesn't allocate or recurse in C. If a deep recursion fills it up, the array is
+doubled in size, up to MAX_RETURN_STACK_DEPTH frames.
+
+The locals of each Frame are kept alongside it in _locals (see locals.c), and
+the counted loops it's running in _loops (see loops.c).
 
 */
 
+#define INITIAL_RETURN_STACK_SIZE  256       /**< \brief Number of frames preallocated */
+#define MAX_RETURN_STACK_DEPTH     (1<<20)   /**< \brief Most frames the return stack can hold */
+
 
 // -----------------------------------------------------------------------------
 /** Creates a new return stack
 */
 // -----------------------------------------------------------------------------
 void create_stack_r() {
-    _return_stack = g_queue_new();
+    _return_stack_size = INITIAL_RETURN_STACK_SIZE;
+    _return_stack = g_new(Frame, _return_stack_size);
+    _return_stack_depth = 0;
 }
 
 
@@ -26,7 +39,9 @@ good initial state.
 */
 // -----------------------------------------------------------------------------
 void clear_stack_r() {
-    g_queue_clear(_return_stack);
+    _return_stack_depth = 0;
+    clear_locals();
+    clear_loops();
 }
 
 
@@ -36,27 +51,71 @@ void clear_stack_r() {
 */
 // -----------------------------------------------------------------------------
 void destroy_stack_r() {
-    g_queue_free(_return_stack);
+    destroy_locals();
+    destroy_loops();
+    g_free(_return_stack);
+    _return_stack = NULL;
+    _return_stack_size = 0;
+    _return_stack_depth = 0;
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Pushes a param pointer onto the return stack.
+/** Pushes a new frame onto the return stack.
+
+\param return_ip: Instruction to continue with when the frame is popped
+\param entry: Definition being executed in the frame
+\returns 1 if the frame was pushed; 0 if the return stack overflowed
 
+On overflow, the error is handled before returning.
 */
 // -----------------------------------------------------------------------------
-void push_param_r(GSequenceIter* param) {
-    g_queue_push_tail(_return_stack, param);
+gboolean push_frame_r(Instruction *return_ip, Entry *entry) {
+    if (_return_stack_depth == _return_stack_size) {
+        if (_return_stack_size >= MAX_RETURN_STACK_DEPTH) {
+            handle_error(ERR_RETURN_STACK_OVERFLOW);
+            fprintf(stderr, "-----> %s\n", entry->word);
+            return 0;
+        }
+        _return_stack_size *= 2;
+        _return_stack = g_renew(Frame, _return_stack, _return_stack_size);
+    }
+
+    Frame *frame = _return_stack + _return_stack_depth++;
+    frame->return_ip = return_ip;
+    frame->entry = entry;
+    frame->locals = _locals_depth;
+    frame->num_locals = 0;
+    frame->loops = _loops_depth;
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a frame off the return stack and returns the Instruction to return to.
+
+*/
+// -----------------------------------------------------------------------------
+Instruction *pop_frame_r() {
+    if (_return_stack_depth == 0) return NULL;
+
+    Frame *frame = _return_stack + --_return_stack_depth;
+    if (frame->num_locals) release_locals(frame);
+    _loops_depth = frame->loops;
+    return frame->return_ip;
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Pops a parameter off the return stack.
+/** Returns the top frame of the return stack (or NULL if it's empty).
 
+\note The frame is only valid until the next push_frame_r.
 */
 // -----------------------------------------------------------------------------
-GSequenceIter *pop_param_r() {
-    return g_queue_pop_tail(_return_stack);
+Frame *top_frame_r() {
+    if (_return_stack_depth == 0) return NULL;
+    return _return_stack + _return_stack_depth - 1;
 }
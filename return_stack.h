@@ -3,8 +3,9 @@
 
 #pragma once
 
-void push_param_r(GSequenceIter *param_iter);
-GSequenceIter *pop_param_r();
+gboolean push_frame_r(Instruction *return_ip, Entry *entry);
+Instruction *pop_frame_r();
+Frame *top_frame_r();
 
 void create_stack_r();
 void clear_stack_r();
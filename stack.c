@@ -5,52 +5,198 @@
 The parameter stack is used to pass arguments and results between words and entry
 routines.
 
-The Param objects on the stack are dynamically allocated. Clients who pop items
-off the stack are responsible for freeing them. Any items left on the stack are
-automatically freed when the stack is cleared or destroyed.
+The stack is a growable array of Param values, so pushing and popping doesn't
+allocate memory. Values are pushed with push_value (or one of the push_* helpers)
+and popped with pop_value. A popped value owns its contents and must be released
+with clear_param when the caller is done with it. Any items left on the stack
+are automatically released when the stack is cleared or destroyed.
+
+Words that compute in place (e.g., "+") change the params returned by
+stack_param and then drop_values what they consumed.
+
+push_param, pop_param, and top work with dynamically allocated Param objects
+as before. Clients who pop items off the stack with pop_param are responsible
+for freeing them with free_param.
 */
 
+#define INITIAL_STACK_SIZE  64   /**< \brief Number of Param values preallocated */
+
 
 // -----------------------------------------------------------------------------
 /** Creates a new stack
 */
 // -----------------------------------------------------------------------------
 void create_stack() {
-    _stack = g_queue_new();
+    _stack = g_array_sized_new(FALSE, FALSE, sizeof(Param), INITIAL_STACK_SIZE);
+    _array_marks = g_array_new(FALSE, FALSE, sizeof(guint));
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Helper function used to free a parameter
+/** Clears stack, releasing all Param values on the stack
+
+Any open array literals (see EC_open_array) are abandoned as well.
 */
 // -----------------------------------------------------------------------------
-static void _free_param(gpointer param, gpointer unused) {
-    free_param(param);
+void clear_stack() {
+    for (guint i=0; i < _stack->len; i++) {
+        clear_param(&g_array_index(_stack, Param, i));
+    }
+    g_array_set_size(_stack, 0);
+    g_array_set_size(_array_marks, 0);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Clears stack, freeing all Param objects on the stack
+/** Frees memory for a stack
+
+The stack is cleared and all Param values on the stack are released as well.
 */
 // -----------------------------------------------------------------------------
-void clear_stack() {
-    g_queue_foreach(_stack, _free_param, NULL);
-    g_queue_clear(_stack);
+void destroy_stack() {
+    clear_stack();
+    g_array_free(_stack, TRUE);
+    g_array_free(_array_marks, TRUE);
 }
 
 
 
 // -----------------------------------------------------------------------------
-/** Frees memory for a stack
+/** Pushes a copy of a param value onto the stack.
 
-The stack is cleared and all Param objects on the stack are freed as well.
+\param value: Param to copy (strings are shared by reference; see copy_param)
 */
 // -----------------------------------------------------------------------------
-void destroy_stack() {
-    clear_stack();
-    g_queue_free(_stack);
+void push_value(const Param *value) {
+    g_array_set_size(_stack, _stack->len + 1);
+    copy_param(&g_array_index(_stack, Param, _stack->len - 1), value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops a param value off the stack into dst.
+
+\param dst: Receives the value that was on top of the stack
+\returns 1 if a value was popped; 0 if the stack was empty
+
+\note The caller is responsible for releasing dst with clear_param.
+*/
+// -----------------------------------------------------------------------------
+gboolean pop_value(Param *dst) {
+    if (_stack->len == 0) {
+        return 0;
+    }
+
+    *dst = g_array_index(_stack, Param, _stack->len - 1);
+    g_array_set_size(_stack, _stack->len - 1);
+    return 1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops the top params off the stack into dst.
+
+\param dst: Receives the values in stack order (the top of the stack is last)
+\param count: Number of values to pop (must not be more than the stack depth)
+
+\note The caller is responsible for releasing the values with clear_param.
+*/
+// -----------------------------------------------------------------------------
+void pop_values(Param *dst, guint count) {
+    memcpy(dst, &g_array_index(_stack, Param, _stack->len - count), sizeof(Param) * count);
+    g_array_set_size(_stack, _stack->len - count);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes an int value onto the stack.
+*/
+// -----------------------------------------------------------------------------
+void push_int(gint64 val_int) {
+    Param value = {.type = 'I', .val_int = val_int};
+    push_value(&value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a double value onto the stack.
+*/
+// -----------------------------------------------------------------------------
+void push_double(gdouble val_double) {
+    Param value = {.type = 'D', .val_double = val_double};
+    push_value(&value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes a copy of a string onto the stack.
+
+\param str: String to copy into a new GRefString
+*/
+// -----------------------------------------------------------------------------
+void push_str(const gchar *str) {
+    Param value = {.type = 'S', .val_string = g_ref_string_new(str)};
+    g_array_append_val(_stack, value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes an entry address onto the stack.
+*/
+// -----------------------------------------------------------------------------
+void push_entry(Entry *entry) {
+    Param value = {.type = 'E', .val_entry = entry};
+    push_value(&value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes custom data onto the stack.
+
+\param val_custom: Custom data (*not* freed when the value is released)
+\param comment: Describes the custom data
+*/
+// -----------------------------------------------------------------------------
+void push_custom(gpointer val_custom, const gchar *comment) {
+    Param value = {.type = 'C', .val_custom = val_custom,
+                   .val_custom_comment = g_intern_string(comment)};
+    push_value(&value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes an array onto the stack.
+
+\param array: Array whose reference is moved onto the stack
+*/
+// -----------------------------------------------------------------------------
+void push_array(Array *array) {
+    Param value = {.type = 'A', .val_array = array};
+    g_array_append_val(_stack, value);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pushes custom data onto the stack as an object.
+
+\param type: Describes the data
+\param data: Data that the new Object takes over (see new_object)
+*/
+// -----------------------------------------------------------------------------
+void push_object(const ObjectType *type, gpointer data) {
+    Param value = {.type = 'O', .val_object = new_object(type, data)};
+    g_array_append_val(_stack, value);
 }
 
 
@@ -58,10 +204,13 @@ void destroy_stack() {
 // -----------------------------------------------------------------------------
 /** Pushes a param onto the stack.
 
+\param param: A dynamically allocated Param. Its value is moved onto the stack
+              and the Param itself is freed.
 */
 // -----------------------------------------------------------------------------
 void push_param(Param* param) {
-    g_queue_push_tail(_stack, param);
+    g_array_append_val(_stack, *param);
+    pool_free(&_param_pool, param);
 }
 
 
@@ -73,11 +222,13 @@ void push_param(Param* param) {
 */
 // -----------------------------------------------------------------------------
 Param *pop_param() {
-    if (g_queue_is_empty(_stack)) {
+    if (_stack->len == 0) {
         return NULL;
     }
 
-    return g_queue_pop_tail(_stack);
+    Param *result = pool_alloc(&_param_pool);
+    pop_value(result);
+    return result;
 }
 
 
@@ -85,8 +236,73 @@ Param *pop_param() {
 // -----------------------------------------------------------------------------
 /** Returns top of stack so caller can peek at it.
 
+\note The returned Param is only valid until the stack is next changed.
 */
 // -----------------------------------------------------------------------------
 const Param *top() {
-    return g_queue_peek_tail(_stack);
+    return peek_param(0);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns a param on the stack so the caller can peek at it.
+
+\param depth: 0 for the top of the stack, 1 for the one below it, etc.
+\returns The Param or NULL if the stack isn't that deep
+
+\note The returned Param is only valid until the stack is next changed.
+*/
+// -----------------------------------------------------------------------------
+const Param *peek_param(guint depth) {
+    if (depth >= _stack->len) {
+        return NULL;
+    }
+
+    return &g_array_index(_stack, Param, _stack->len - depth - 1);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns a param on the stack so the caller can change it in place.
+
+\param depth: 0 for the top of the stack, 1 for the one below it, etc.
+\returns The Param or NULL if the stack isn't that deep
+
+\note The returned Param is only valid until the stack is next changed. If the
+      caller replaces its value, it must release the old one first.
+*/
+// -----------------------------------------------------------------------------
+Param *stack_param(guint depth) {
+    if (depth >= _stack->len) {
+        return NULL;
+    }
+
+    return &g_array_index(_stack, Param, _stack->len - depth - 1);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Pops params off the stack and releases them.
+
+\param count: Number of params to drop (must not be more than the stack depth)
+*/
+// -----------------------------------------------------------------------------
+void drop_values(guint count) {
+    for (guint i=_stack->len - count; i < _stack->len; i++) {
+        clear_param(&g_array_index(_stack, Param, i));
+    }
+    g_array_set_size(_stack, _stack->len - count);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/** Returns the number of params on the stack.
+*/
+// -----------------------------------------------------------------------------
+guint stack_depth() {
+    return _stack->len;
 }
@@ -3,9 +3,24 @@
 
 #pragma once
 
+void push_value(const Param *value);
+gboolean pop_value(Param *dst);
+void pop_values(Param *dst, guint count);
+void push_int(gint64 val_int);
+void push_double(gdouble val_double);
+void push_str(const gchar *str);
+void push_entry(Entry *entry);
+void push_custom(gpointer val_custom, const gchar *comment);
+void push_array(Array *array);
+void push_object(const ObjectType *type, gpointer data);
+
 void push_param(Param *param);
 Param *pop_param();
 const Param *top();
+const Param *peek_param(guint depth);
+Param *stack_param(guint depth);
+void drop_values(guint count);
+guint stack_depth();
 
 void create_stack();
 void clear_stack();